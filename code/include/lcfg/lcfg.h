@@ -28,6 +28,8 @@
 #define LCFG_H
 
 #include <stdlib.h>
+#include <sys/types.h>
+#include <stdint.h>
 
 struct lcfg;
 
@@ -35,25 +37,325 @@ enum lcfg_status { lcfg_status_ok, lcfg_status_error };
 
 typedef enum lcfg_status (*lcfg_visitor_function)(const char *key, void *data, size_t size, void *user_data);
 
+/* a configuration element. key and value are NUL-terminated, the value
+ * may contain NULs. */
+struct lcfg_entry
+{
+	const char *key;
+	size_t key_len;
+	const char *value;
+	size_t value_len;
+};
+
+/* count consecutive configuration elements as parallel arrays */
+struct lcfg_batch
+{
+	size_t count;
+	const char *const *keys;
+	const size_t *key_lens;
+	const char *const *values;
+	const size_t *value_lens;
+};
+
+typedef enum lcfg_status (*lcfg_batch_visitor_function)(const struct lcfg_batch *, void *user_data);
+
+/* tokens of lcfg syntax passed to an lcfg_token_function */
+enum lcfg_scan_token
+{
+	lcfg_scan_identifier = 0,
+	lcfg_scan_equals,
+	lcfg_scan_string,
+	lcfg_scan_list_open,
+	lcfg_scan_list_close,
+	lcfg_scan_comma,
+	lcfg_scan_map_open,
+	lcfg_scan_map_close
+};
+
+/* text is the NUL-terminated name of an identifier or the decoded bytes
+ * of a string, NULL for the other tokens */
+typedef enum lcfg_status (*lcfg_token_function)(enum lcfg_scan_token, const char *text, size_t len, uint64_t line, uint64_t col, void *user_data);
+
+/* input source for lcfg_new_reader(): fill up to len bytes of buf and
+ * return their number, 0 at the end of input or -1 on error (with errno
+ * set). */
+typedef ssize_t (*lcfg_reader_function)(void *ctx, void *buf, size_t len);
+
+/* memory allocator used for all memory of an lcfg context; ctx is passed
+ * to every call. free and realloc receive the size of the block. */
+struct lcfg_allocator
+{
+	void *(*alloc)(void *ctx, size_t size);
+	void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+	void  (*free)(void *ctx, void *ptr, size_t size);
+	void *ctx;
+};
+
+#define LCFG_STATS_TOKEN_TYPES 9
+
+/* statistics of the last parse, see lcfg_stats_enable() */
+struct lcfg_stats
+{
+	size_t bytes_read;                       /* input bytes consumed */
+	size_t read_calls;                       /* number of read() calls */
+	size_t tokens[LCFG_STATS_TOKEN_TYPES];   /* tokens by type, see lcfg_stats_token_name() */
+	size_t values;                           /* values stored */
+	size_t values_interned;                  /* values sharing the storage of an equal one */
+	size_t bytes_interned;                   /* value bytes saved by that */
+	size_t max_depth;                        /* deepest nesting of lists and maps */
+	size_t bytes_allocated;                  /* bytes requested from the heap, including growth by realloc */
+	size_t allocations;                      /* number of malloc/realloc calls */
+	double scan_time;                        /* seconds spent in the scanner */
+	double parse_time;                       /* seconds spent in the parser, excluding scan_time */
+	double build_time;                       /* seconds spent building indexes and trees */
+};
+
 
 /* open a new config file */
 struct lcfg *        lcfg_new(const char *filename);
 
-/* parse config into memory */
+/* open a new config file, allocating all memory through the given allocator */
+struct lcfg *        lcfg_new_allocator(const char *filename, const struct lcfg_allocator *);
+
+/* read the config from a callback instead of a file, e.g. a pipe or a
+ * decompression stream. the scan buffer passed to the reader is
+ * buffer_size bytes, 0 selects the default. the input is read once by the
+ * next lcfg_parse() or lcfg_parse_filtered(); lazy parsing needs a file. */
+struct lcfg *        lcfg_new_reader(lcfg_reader_function, void *ctx, size_t buffer_size);
+
+/* read the config from a callback, allocating all memory through the given allocator */
+struct lcfg *        lcfg_new_reader_allocator(lcfg_reader_function, void *ctx, size_t buffer_size, const struct lcfg_allocator *);
+
+/* parse config into memory.
+ *
+ * a statement `include "path"' at the top level or in a map splices the
+ * values of another config file in at that point. relative paths are
+ * resolved against the directory of the including file, or the working
+ * directory for input without a file name. every file is parsed once per
+ * process and reused by later includes until it, or a file it includes,
+ * changes on disk. include cycles are errors. lazy parsing does not
+ * support includes. */
 enum lcfg_status     lcfg_parse(struct lcfg *);
 
+/* forget all cached include files. they are kept with the allocator of
+ * the instance that read them, which must stay usable until then. */
+void                 lcfg_include_cache_flush(void);
+
+enum lcfg_interpolation
+{
+	lcfg_interpolation_off = 0,  /* values are taken literally (default) */
+	lcfg_interpolation_strict,   /* references to missing keys are errors */
+	lcfg_interpolation_keep      /* references to missing keys stay as they are */
+};
+
+/* replace ${key} in values by the value of key after every subsequent
+ * complete parse, e.g. "${cluster.name}-cache". referenced values are
+ * resolved first, each one once, cycles are errors. $${ stands for a
+ * literal ${. keys skipped by lcfg_parse_filtered() count as missing,
+ * lazy parsing does not resolve references. */
+void                 lcfg_interpolation_set(struct lcfg *, enum lcfg_interpolation);
+
+enum lcfg_schema_type
+{
+	lcfg_schema_any = 0,
+	lcfg_schema_string,
+	lcfg_schema_integer,
+	lcfg_schema_boolean,   /* true, false, yes, no, on or off */
+	lcfg_schema_list,
+	lcfg_schema_map
+};
+
+struct lcfg_schema_rule
+{
+	const char *key;       /* "*" as a path component matches every map key or list index */
+	enum lcfg_schema_type type;
+	int required;
+	long long min;         /* bounds of integers and list lengths, unless both are 0 */
+	long long max;
+	const char **values;   /* NULL-terminated list of allowed values, or NULL */
+};
+
+/* check subsequent parses against the rules, terminated by a rule with a
+ * NULL key, while they run: the first violation fails the parse with its
+ * position. a key without a rule is not checked, prefixes of rules must be
+ * lists or maps. required keys are not checked for lcfg_parse_filtered(),
+ * lazy parsing is not checked at all, included values only against the
+ * rules for their keys. the rules must stay valid, NULL removes them. */
+enum lcfg_status     lcfg_schema_set(struct lcfg *, const struct lcfg_schema_rule *rules);
+
+/* a member of a caller's struct that lcfg_bind() fills from the value at
+ * key. the member is a const char * for lcfg_schema_string, pointing into
+ * the config, a long long for lcfg_schema_integer and an int, 0 or 1, for
+ * lcfg_schema_boolean. */
+struct lcfg_binding
+{
+	const char *key;
+	size_t offset;         /* offsetof() the member */
+	enum lcfg_schema_type type;
+	const char *fallback;  /* converted if the key is missing, NULL leaves the member alone */
+};
+
+/* fill object in one pass over the parsed config from a table of
+ * bindings terminated by a NULL key, binding a key twice is an error.
+ * every value is converted as a schema rule of its type would check it,
+ * the first one that does not convert fails the call with the object
+ * partly set. */
+enum lcfg_status     lcfg_bind(struct lcfg *, const struct lcfg_binding *table, void *object);
+
+/* parse only the values at or below one of the NULL-terminated key
+ * prefixes, e.g. { "server", "upstreams.0.host", NULL }. everything else
+ * is skipped at scan speed and only checked for balanced brackets. */
+enum lcfg_status     lcfg_parse_filtered(struct lcfg *, const char **prefixes);
+
+/* called by lcfg_validate() for every error it finds */
+typedef void (*lcfg_error_function)(const char *message, void *user_data);
+
+/* only scan the input and pass every token to fn, for parsers that are
+ * specialized to one layout of config, see lcfg --generate. nothing is
+ * stored and includes are not followed. fn returns lcfg_status_error to
+ * stop the scan, after setting a message with lcfg_error_set(). */
+enum lcfg_status     lcfg_scan(struct lcfg *, lcfg_token_function fn, void *user_data);
+
+/* check the config, and the schema if one is set, without storing any
+ * values. every error is passed to fn, which may be NULL, and checking
+ * resumes at the next statement, so later errors may be consequences of
+ * earlier ones. returns lcfg_status_ok if there was no error, the last
+ * one is kept for lcfg_error_get(). */
+enum lcfg_status     lcfg_validate(struct lcfg *, lcfg_error_function fn, void *user_data);
+
+/* alternative to lcfg_parse() for input that arrives in pieces, e.g. from
+ * a socket: pass every chunk as it comes in and call lcfg_feed_end() after
+ * the last one. chunks may split tokens anywhere and are not referenced
+ * after the call returns. the filename given to lcfg_new() is not used and
+ * may be NULL. errors are reported by the call that detects them, after
+ * which the instance takes no more input. */
+enum lcfg_status     lcfg_feed(struct lcfg *, const void *buf, size_t len);
+enum lcfg_status     lcfg_feed_end(struct lcfg *);
+
+/* alternative to lcfg_parse(): only record where each top-level statement
+ * is located. a statement is parsed when a lookup or traversal first
+ * touches it, syntax errors inside it are reported at that point. the
+ * file is kept open until lcfg_delete(). access is thread-safe. */
+enum lcfg_status     lcfg_parse_lazy(struct lcfg *);
+
 /* visit all configuration elements */
 enum lcfg_status     lcfg_accept(struct lcfg *, lcfg_visitor_function, void *);
 
+/* visit all configuration elements at or below key */
+enum lcfg_status     lcfg_accept_subtree(struct lcfg *, const char *key, lcfg_visitor_function, void *);
+
+/* visit all configuration elements, in the order of lcfg_accept(), passing
+ * up to batch_size of them per call, 0 selects LCFG_BATCH_SIZE. the
+ * arrays point into the parsed config; an attached image is copied out in
+ * batches of at most LCFG_BATCH_SIZE. statements of lcfg_parse_lazy() are
+ * all parsed first. */
+#define LCFG_BATCH_SIZE 64
+enum lcfg_status     lcfg_accept_batched(struct lcfg *, size_t batch_size, lcfg_batch_visitor_function, void *);
+
+/* a cursor over all configuration elements in the order of lcfg_accept(),
+ * the members are private */
+struct lcfg_iter
+{
+	struct lcfg *lcfg;
+	struct lcfg_batch batch;   /* elements up to the next refill */
+	size_t next;               /* in batch */
+	size_t run;                /* position of the refill */
+	size_t index;
+};
+
+/* position it before the first element. statements of lcfg_parse_lazy()
+ * are all parsed here, which may fail. the cursor and the entries it
+ * returns stay valid until the config is parsed again or deleted. */
+enum lcfg_status     lcfg_iter_begin(struct lcfg *, struct lcfg_iter *it);
+
+/* the next element, 0 after the last one */
+int                  lcfg_iter_next(struct lcfg_iter *it, struct lcfg_entry *);
+
 /* access a value by path */
 enum lcfg_status     lcfg_value_get(struct lcfg *, const char *, void **, size_t *);
 
+/* publish the parsed config as a read-only, position-independent image in
+ * POSIX shared memory under name, e.g. "/myconfig". publishing again
+ * replaces the image, processes attached to the previous one keep it until
+ * they attach again. there must only be one publisher per name. */
+enum lcfg_status     lcfg_publish_shared(struct lcfg *, const char *name);
+
+/* alternative to lcfg_parse(): map the image published under name.
+ * lcfg_value_get(), lcfg_accept() and lcfg_accept_subtree() are answered
+ * from the mapping without copying, it is released by lcfg_delete(). */
+enum lcfg_status     lcfg_attach_shared(struct lcfg *, const char *name);
+
+/* generation of the attached image, counting publications from 1 */
+uint64_t             lcfg_shared_generation(struct lcfg *);
+
+/* true once a newer image has been published, call lcfg_attach_shared()
+ * again to switch to it */
+int                  lcfg_shared_stale(struct lcfg *);
+
+/* write the config as canonical lcfg text: one statement per line, tab
+ * indentation, non-printable bytes escaped */
+enum lcfg_status     lcfg_write(struct lcfg *, int fd);
+
+/* like lcfg_write(), into a NUL-terminated buffer of len + 1 bytes from
+ * the allocator of the instance, malloc() by default, that the caller
+ * releases. on errors *buf is NULL and *len 0. */
+enum lcfg_status     lcfg_write_buffer(struct lcfg *, char **buf, size_t *len);
+
+struct lcfg_memory_usage
+{
+	size_t keys;      /* key strings */
+	size_t values;    /* value strings */
+	size_t indexes;   /* hash table and the statement index of lcfg_parse_lazy() */
+	size_t overhead;  /* value table, unused space and bookkeeping */
+	size_t shared;    /* image mapped by lcfg_attach_shared() */
+};
+
+/* heap memory held by the config, in bytes. keys and values are stored
+ * back to back in one exactly sized block after a complete parse. */
+void                 lcfg_memory_usage(struct lcfg *, struct lcfg_memory_usage *);
+
 /* return the last error message */
 const char *         lcfg_error_get(struct lcfg *);
 
 /* set error */
 void                 lcfg_error_set(struct lcfg *, const char *fmt, ...);
 
+/* let equal values share their storage in all subsequent parses, for
+ * configs that repeat the same values often (off by default) */
+void                 lcfg_intern_enable(struct lcfg *);
+
+/* collect statistics for all subsequent parses (off by default) */
+void                 lcfg_stats_enable(struct lcfg *);
+
+/* statistics of the last parse, NULL if collection is not enabled */
+const struct lcfg_stats *lcfg_stats_get(struct lcfg *);
+
+/* name of the token type at index i of lcfg_stats.tokens */
+const char *         lcfg_stats_token_name(unsigned int i);
+
+/* a stack of parsed configs, e.g. a base config and per-host overrides.
+ * lookups try the layers from the top down, a traversal visits every key
+ * once, at its position in the lowest layer that has it, with the value of
+ * the highest layer. maps are merged key by key, anything else that a
+ * layer sets replaces the whole value below it: a list replaces the list,
+ * a string replaces a map. the overlay neither copies nor owns the
+ * layers, which must outlive it. layers are indexed when they are added
+ * or set, so they must be parsed by then and set again after a parse. */
+struct lcfg_overlay;
+
+struct lcfg_overlay *lcfg_overlay_new(void);
+
+/* put c on top, returns its layer index */
+size_t               lcfg_overlay_add(struct lcfg_overlay *, struct lcfg *);
+
+/* replace a layer, e.g. by a re-parsed version of its file */
+void                 lcfg_overlay_set(struct lcfg_overlay *, size_t layer, struct lcfg *);
+
+enum lcfg_status     lcfg_overlay_value_get(struct lcfg_overlay *, const char *, void **, size_t *);
+enum lcfg_status     lcfg_overlay_accept(struct lcfg_overlay *, lcfg_visitor_function, void *);
+enum lcfg_status     lcfg_overlay_accept_subtree(struct lcfg_overlay *, const char *key, lcfg_visitor_function, void *);
+void                 lcfg_overlay_delete(struct lcfg_overlay *);
+
 /* destroy lcfg context */
 void                 lcfg_delete(struct lcfg *);
 
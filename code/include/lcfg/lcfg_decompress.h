@@ -0,0 +1,51 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef LCFG_DECOMPRESS_H
+#define LCFG_DECOMPRESS_H
+
+#include "lcfg/lcfg.h"
+
+enum lcfg_compression { lcfg_compression_none, lcfg_compression_gzip, lcfg_compression_zstd };
+
+struct lcfg_decompress;
+
+/* number of leading bytes lcfg_decompress_detect() wants to see */
+#define LCFG_DECOMPRESS_MAGIC_SIZE 4
+
+enum lcfg_compression    lcfg_decompress_detect(const char *buf, size_t len);
+
+/* stream decompressor reading compressed input from reader. the first
+ * pending_len bytes of input were already read into pending. NULL if
+ * support for the format is not built in, with the error set. */
+struct lcfg_decompress * lcfg_decompress_new(struct lcfg *, enum lcfg_compression, lcfg_reader_function reader, void *ctx, size_t buffer_size, const char *pending, size_t pending_len);
+
+/* an lcfg_reader_function for the decompressed data, errors are set on
+ * the lcfg instance */
+ssize_t                  lcfg_decompress_read(void *, void *buf, size_t len);
+void                     lcfg_decompress_delete(struct lcfg_decompress *);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef LCFG_HASH_H
+#define LCFG_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* FNV-1a over a NUL-terminated key */
+static inline uint64_t lcfg_hash(const char *key)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while( *key != '\0' )
+	{
+		h ^= (unsigned char)*key++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+/* FNV-1a over len bytes, equal to lcfg_hash() of the same key */
+static inline uint64_t lcfg_hash_buf(const char *key, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while( len-- > 0 )
+	{
+		h ^= (unsigned char)*key++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+#endif
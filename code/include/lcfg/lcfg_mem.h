@@ -0,0 +1,54 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef LCFG_MEM_H
+#define LCFG_MEM_H
+
+#include "lcfg/lcfg.h"
+
+/* allocation context shared by all objects of one lcfg instance */
+struct lcfg_mem
+{
+	struct lcfg_allocator allocator;
+	struct lcfg_stats *stats; /* NULL unless statistics are enabled */
+};
+
+struct lcfg_mem *     lcfg_mem_get(struct lcfg *);
+void                  lcfg_mem_init(struct lcfg_mem *, const struct lcfg_allocator *);
+void *                lcfg_mem_alloc(struct lcfg_mem *, size_t);
+void *                lcfg_mem_realloc(struct lcfg_mem *, void *, size_t old_size, size_t new_size);
+
+/* NULL if out of memory, for callers that can fail cleanly. a failed
+ * realloc leaves the block alone. */
+void *                lcfg_mem_try_alloc(struct lcfg_mem *, size_t);
+void *                lcfg_mem_try_realloc(struct lcfg_mem *, void *, size_t old_size, size_t new_size);
+void                  lcfg_mem_free(struct lcfg_mem *, void *, size_t);
+char *                lcfg_mem_strdup(struct lcfg_mem *, const char *);
+
+/* monotonic wall clock in seconds, for lcfg_stats timings */
+double                lcfg_stats_clock(void);
+
+#endif
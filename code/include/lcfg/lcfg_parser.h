@@ -32,9 +32,29 @@
 struct lcfg_parser;
 
 struct lcfg_parser *  lcfg_parser_new(struct lcfg *, const char *);
+void                  lcfg_parser_reader_set(struct lcfg_parser *, lcfg_reader_function, void *, size_t);
+void                  lcfg_parser_intern_enable(struct lcfg_parser *);
+void                  lcfg_parser_interpolation_set(struct lcfg_parser *, enum lcfg_interpolation);
+enum lcfg_status      lcfg_parser_schema_set(struct lcfg_parser *, const struct lcfg_schema_rule *);
 enum lcfg_status      lcfg_parser_run(struct lcfg_parser *);
+enum lcfg_status      lcfg_parser_run_filtered(struct lcfg_parser *, const char **);
+enum lcfg_status      lcfg_parser_run_lazy(struct lcfg_parser *);
+enum lcfg_status      lcfg_parser_run_scan(struct lcfg_parser *, lcfg_token_function, void *);
+enum lcfg_status      lcfg_parser_run_validate(struct lcfg_parser *, lcfg_error_function, void *);
+enum lcfg_status      lcfg_parser_feed(struct lcfg_parser *, const char *, size_t);
+enum lcfg_status      lcfg_parser_feed_end(struct lcfg_parser *);
+int                   lcfg_parser_is_pushing(struct lcfg_parser *);
+int                   lcfg_parser_is_lazy(struct lcfg_parser *);
 enum lcfg_status      lcfg_parser_accept(struct lcfg_parser *, lcfg_visitor_function, void *);
+enum lcfg_status      lcfg_parser_accept_subtree(struct lcfg_parser *, const char *, lcfg_visitor_function, void *);
+enum lcfg_status      lcfg_parser_accept_batched(struct lcfg_parser *, size_t, lcfg_batch_visitor_function, void *);
+enum lcfg_status      lcfg_parser_load_all(struct lcfg_parser *);
+size_t                lcfg_parser_batch(struct lcfg_parser *, size_t *run, size_t *index, size_t max, struct lcfg_batch *);
 void                  lcfg_parser_delete(struct lcfg_parser *);
 enum lcfg_status      lcfg_parser_get(struct lcfg_parser *, const char *, void **, size_t *);
+void                  lcfg_parser_memory_usage(struct lcfg_parser *, struct lcfg_memory_usage *);
+
+/* implemented in lcfg.c */
+int                   lcfg_is_lazy(struct lcfg *);
 
 #endif
@@ -27,15 +27,28 @@
 #ifndef LCFG_SCANNER_H
 #define LCFG_SCANNER_H
 
+#include <stdint.h>
+
 #include "lcfg/lcfg.h"
 
 struct lcfg_scanner;
 struct lcfg_token;
 
-struct lcfg_scanner *    lcfg_scanner_new(struct lcfg *, int fd);
-enum lcfg_status         lcfg_scanner_init(struct lcfg_scanner *);
+#define LCFG_SCANNER_BUFFER_SIZE 0x10000
+
+struct lcfg_scanner *    lcfg_scanner_new(struct lcfg *, int fd, size_t buffer_size);
+struct lcfg_scanner *    lcfg_scanner_new_reader(struct lcfg *, lcfg_reader_function, void *ctx, size_t buffer_size);
+struct lcfg_scanner *    lcfg_scanner_new_range(struct lcfg *, int fd, size_t buffer_size, uint64_t start, uint64_t end, uint64_t line, uint64_t col);
+struct lcfg_scanner *    lcfg_scanner_new_push(struct lcfg *);
+void                     lcfg_scanner_feed(struct lcfg_scanner *, const char *buf, size_t len);
+void                     lcfg_scanner_feed_end(struct lcfg_scanner *);
 enum lcfg_status         lcfg_scanner_next_token(struct lcfg_scanner *, struct lcfg_token *);
-int                      lcfg_scanner_has_next(struct lcfg_scanner *);
+enum lcfg_status         lcfg_scanner_skip(struct lcfg_scanner *, char open);
+
+/* continue behind the character a scan error was reported for, fails if
+ * the error cannot be recovered from (end of input, read errors) */
+enum lcfg_status         lcfg_scanner_recover(struct lcfg_scanner *);
+uint64_t                 lcfg_scanner_position(struct lcfg_scanner *);
 void                     lcfg_scanner_delete(struct lcfg_scanner *);
 
 #endif
@@ -0,0 +1,73 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef LCFG_SCHEMA_H
+#define LCFG_SCHEMA_H
+
+#include "lcfg/lcfg.h"
+#include "lcfg/lcfg_token.h"
+
+/* the schema rules compiled into a tree of path components that the parser
+ * descends along with its state stack */
+struct lcfg_schema_node
+{
+	char *name;                             /* path component, "*" for any */
+	const struct lcfg_schema_rule *rule;    /* NULL if only a prefix of other rules */
+	size_t index;                           /* slot in the parser's seen array */
+	size_t required;                        /* number of required children */
+	struct lcfg_schema_node *children;
+	struct lcfg_schema_node *next;          /* sibling */
+};
+
+struct lcfg_schema;
+
+/* compile a rule table terminated by a NULL key, NULL on errors */
+struct lcfg_schema *            lcfg_schema_new(struct lcfg *, const struct lcfg_schema_rule *);
+const struct lcfg_schema_node * lcfg_schema_root(struct lcfg_schema *);
+size_t                          lcfg_schema_node_count(struct lcfg_schema *);
+
+/* "an integer" etc. for error messages */
+const char *                    lcfg_schema_type_name(enum lcfg_schema_type);
+
+/* convert values of lcfg_schema_integer and lcfg_schema_boolean, 0 if
+ * the value is not one */
+int                             lcfg_schema_integer_value(const char *value, size_t len, long long *i);
+int                             lcfg_schema_boolean_value(const char *value, int *b);
+
+/* child of n matching the path component name, NULL if there is no rule */
+const struct lcfg_schema_node * lcfg_schema_child(const struct lcfg_schema_node *n, const char *name, size_t len);
+
+/* checks against the rule of n, the error is reported at t */
+enum lcfg_status                lcfg_schema_check_value(struct lcfg *, const struct lcfg_schema_node *n, const char *key, const char *value, size_t len, struct lcfg_token *t);
+enum lcfg_status                lcfg_schema_check_container(struct lcfg *, const struct lcfg_schema_node *n, const char *key, enum lcfg_schema_type, struct lcfg_token *t);
+enum lcfg_status                lcfg_schema_check_length(struct lcfg *, const struct lcfg_schema_node *n, const char *key, size_t count, struct lcfg_token *t);
+
+/* every required child of n must have seen[child->index] == stamp */
+enum lcfg_status                lcfg_schema_check_required(struct lcfg *, const struct lcfg_schema_node *n, const char *key, const size_t *seen, size_t stamp, struct lcfg_token *t);
+
+void                            lcfg_schema_delete(struct lcfg_schema *);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef LCFG_SHARED_H
+#define LCFG_SHARED_H
+
+#include <stdint.h>
+
+#include "lcfg/lcfg.h"
+
+struct lcfg_shared;
+
+enum lcfg_status      lcfg_shared_publish(struct lcfg *, const char *name);
+struct lcfg_shared *  lcfg_shared_attach(struct lcfg *, const char *name);
+enum lcfg_status      lcfg_shared_get(struct lcfg_shared *, const char *key, void **data, size_t *len);
+enum lcfg_status      lcfg_shared_accept_subtree(struct lcfg_shared *, const char *key, lcfg_visitor_function, void *);
+enum lcfg_status      lcfg_shared_accept_batched(struct lcfg_shared *, size_t, lcfg_batch_visitor_function, void *);
+int                   lcfg_shared_entry(struct lcfg_shared *, size_t index, struct lcfg_entry *);
+size_t                lcfg_shared_image_size(struct lcfg_shared *);
+uint64_t              lcfg_shared_image_generation(struct lcfg_shared *);
+int                   lcfg_shared_image_stale(struct lcfg_shared *);
+void                  lcfg_shared_detach(struct lcfg_shared *);
+
+#endif
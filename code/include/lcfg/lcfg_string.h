@@ -27,17 +27,23 @@
 #ifndef LCFG_STRING_H
 #define LCFG_STRING_H
 
-struct lcfg_string *  lcfg_string_new();
+#include <stddef.h>
+#include <sys/types.h>
+
+struct lcfg_mem;
+
+struct lcfg_string *  lcfg_string_new(struct lcfg_mem *);
 struct lcfg_string *  lcfg_string_new_copy(struct lcfg_string *);
-int                   lcfg_string_set(struct lcfg_string *, const char *);
-int                   lcfg_string_cat_char(struct lcfg_string *, char);
-int                   lcfg_string_cat_cstr(struct lcfg_string *, const char *);
-int                   lcfg_string_cat_uint(struct lcfg_string *, unsigned int);
-int                   lcfg_string_find(struct lcfg_string *, char);
-int                   lcfg_string_rfind(struct lcfg_string *, char);
-void                  lcfg_string_trunc(struct lcfg_string *, unsigned int);
+size_t                lcfg_string_set(struct lcfg_string *, const char *);
+size_t                lcfg_string_cat_char(struct lcfg_string *, char);
+size_t                lcfg_string_cat_cstr(struct lcfg_string *, const char *);
+size_t                lcfg_string_cat_uint(struct lcfg_string *, size_t);
+size_t                lcfg_string_cat_buf(struct lcfg_string *, const char *, size_t);
+ssize_t               lcfg_string_find(struct lcfg_string *, char);
+ssize_t               lcfg_string_rfind(struct lcfg_string *, char);
+void                  lcfg_string_trunc(struct lcfg_string *, size_t);
 const char *          lcfg_string_cstr(struct lcfg_string *);
-unsigned int          lcfg_string_len(struct lcfg_string *);
+size_t                lcfg_string_len(struct lcfg_string *);
 void                  lcfg_string_delete(struct lcfg_string *);
 
 #endif
@@ -27,6 +27,8 @@
 #ifndef LCFG_TOKEN_H
 #define LCFG_TOKEN_H
 
+#include <stdint.h>
+
 #include "lcfg/lcfg_string.h"
 
 enum lcfg_token_type
@@ -48,8 +50,9 @@ struct lcfg_token
 {
 	enum lcfg_token_type type;
 	struct lcfg_string *string;
-	short line;
-	short col;
+	uint64_t offset; /* input offset of the first character */
+	uint64_t line;
+	uint64_t col;
 };
 
 
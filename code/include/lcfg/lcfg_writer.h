@@ -0,0 +1,65 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef LCFG_WRITER_H
+#define LCFG_WRITER_H
+
+#include "lcfg/lcfg.h"
+#include "lcfg/lcfg_mem.h"
+
+/* buffered output of lcfg text, either to a file descriptor or into a
+ * growing buffer that is handed to the caller */
+struct lcfg_writer
+{
+	struct lcfg_mem *mem;
+	int fd;          /* -1 to collect the output in buf */
+	char *buf;
+	size_t len;
+	size_t capacity;
+	int error;       /* errno of the first failure, output is dropped after it */
+	int line_open;   /* the last item has not been terminated yet */
+};
+
+void                  lcfg_writer_init(struct lcfg_writer *, struct lcfg_mem *, int fd);
+void                  lcfg_writer_raw(struct lcfg_writer *, const void *, size_t);
+void                  lcfg_writer_string(struct lcfg_writer *, const void *, size_t);
+
+/* start an item at the given nesting depth: key is NULL inside lists,
+ * sibling adds the comma separating it from the previous list element */
+void                  lcfg_writer_item(struct lcfg_writer *, size_t depth, const char *key, int sibling);
+void                  lcfg_writer_close(struct lcfg_writer *, size_t depth, char bracket);
+
+/* write all values of a config, restoring lists and maps from their keys */
+enum lcfg_status      lcfg_writer_config(struct lcfg_writer *, struct lcfg *);
+
+/* flush, and for buffer output hand over the NUL-terminated buffer of
+ * exactly len + 1 bytes. on errors *buf is NULL and *len 0. */
+enum lcfg_status      lcfg_writer_finish(struct lcfg_writer *, char **buf, size_t *len);
+
+/* release a buffer handed over by lcfg_writer_finish() */
+void                  lcfg_writer_free(struct lcfg_writer *, char **buf, size_t *len);
+
+#endif
@@ -54,11 +54,25 @@ struct lcfgx_tree_node
 	struct lcfgx_tree_node *next;
 };
 
+/* build a tree, allocating from the allocator of the lcfg context.
+ * for a config parsed with lcfg_parse_lazy() top-level subtrees are only
+ * built when lcfgx_get() on the root first looks them up, and the tree
+ * must not outlive the config. */
 struct lcfgx_tree_node *lcfgx_tree_new(struct lcfg *);
 
+/* build a tree, allocating from the given allocator */
+struct lcfgx_tree_node *lcfgx_tree_new_allocator(struct lcfg *, const struct lcfg_allocator *);
+
+/* destroy a tree, or a subtree that has been unlinked from its parent */
 void lcfgx_tree_delete(struct lcfgx_tree_node *);
 void lcfgx_tree_dump(struct lcfgx_tree_node *node, int depth);
 
+/* write a subtree as lcfg text, see lcfg_write(). a map node is written
+ * as the statements it contains, any other node as a single statement.
+ * the buffer comes from the allocator of the tree. */
+enum lcfg_status lcfgx_tree_write(struct lcfgx_tree_node *node, int fd);
+enum lcfg_status lcfgx_tree_write_buffer(struct lcfgx_tree_node *node, char **buf, size_t *len);
+
 enum lcfgx_path_access
 {
 	LCFGX_PATH_NOT_FOUND,
@@ -1,6 +1,6 @@
 #!/bin/sh
 
-INFILES="include/lcfg/lcfg_string.h include/lcfg/lcfg_token.h include/lcfg/lcfg_scanner.h include/lcfg/lcfg_parser.h include/lcfgx/lcfgx_tree.h src/lcfg_string.c src/lcfg_token.c src/lcfg_scanner.c src/lcfg_parser.c src/lcfg.c src/lcfgx_tree.c"
+INFILES="include/lcfg/lcfg_mem.h include/lcfg/lcfg_hash.h include/lcfg/lcfg_decompress.h include/lcfg/lcfg_string.h include/lcfg/lcfg_token.h include/lcfg/lcfg_scanner.h include/lcfg/lcfg_parser.h include/lcfg/lcfg_shared.h include/lcfg/lcfg_schema.h include/lcfg/lcfg_writer.h include/lcfgx/lcfgx_tree.h src/lcfg_mem.c src/lcfg_overlay.c src/lcfg_decompress.c src/lcfg_string.c src/lcfg_token.c src/lcfg_writer.c src/lcfg_scanner.c src/lcfg_shared.c src/lcfg_schema.c src/lcfg_bind.c src/lcfg_parser.c src/lcfg.c src/lcfgx_tree.c"
 
 HFILE="lcfg_static.h"
 CFILE="lcfg_static.c"
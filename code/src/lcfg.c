@@ -32,18 +32,34 @@
 
 #include "lcfg/lcfg.h"
 #include "lcfg/lcfg_parser.h"
+#include "lcfg/lcfg_token.h"
+#include "lcfg/lcfg_mem.h"
+#include "lcfg/lcfg_writer.h"
+#include "lcfg/lcfg_shared.h"
 
 struct lcfg
 {
 	char error[0xff];
 	struct lcfg_parser *parser;
+	struct lcfg_shared *shared; /* set by lcfg_attach_shared() */
+	struct lcfg_mem mem;
+	struct lcfg_stats stats;
 };
 
 struct lcfg *lcfg_new(const char *filename)
 {
-	struct lcfg *c = malloc(sizeof(struct lcfg));
-	assert(c);
+	return lcfg_new_allocator(filename, NULL);
+}
+
+struct lcfg *lcfg_new_allocator(const char *filename, const struct lcfg_allocator *a)
+{
+	struct lcfg_mem mem;
+
+	lcfg_mem_init(&mem, a);
+
+	struct lcfg *c = lcfg_mem_alloc(&mem, sizeof(struct lcfg));
 	memset(c, 0, sizeof(struct lcfg));
+	c->mem = mem;
 
 	c->parser = lcfg_parser_new(c, filename);
 	assert(c->parser);
@@ -51,10 +67,43 @@ struct lcfg *lcfg_new(const char *filename)
 	return c;
 }
 
+struct lcfg *lcfg_new_reader(lcfg_reader_function reader, void *ctx, size_t buffer_size)
+{
+	return lcfg_new_reader_allocator(reader, ctx, buffer_size, NULL);
+}
+
+struct lcfg *lcfg_new_reader_allocator(lcfg_reader_function reader, void *ctx, size_t buffer_size, const struct lcfg_allocator *a)
+{
+	struct lcfg *c = lcfg_new_allocator(NULL, a);
+
+	lcfg_parser_reader_set(c->parser, reader, ctx, buffer_size);
+
+	return c;
+}
+
 void lcfg_delete(struct lcfg *c)
 {
+	struct lcfg_mem mem = c->mem;
+
+	if( c->shared != NULL )
+	{
+		lcfg_shared_detach(c->shared);
+	}
 	lcfg_parser_delete(c->parser);
-	free(c);
+	lcfg_mem_free(&mem, c, sizeof(struct lcfg));
+}
+
+void lcfg_memory_usage(struct lcfg *c, struct lcfg_memory_usage *u)
+{
+	memset(u, 0, sizeof(struct lcfg_memory_usage));
+
+	u->overhead = sizeof(struct lcfg);
+	lcfg_parser_memory_usage(c->parser, u);
+
+	if( c->shared != NULL )
+	{
+		u->shared = lcfg_shared_image_size(c->shared);
+	}
 }
 
 const char *lcfg_error_get(struct lcfg *c)
@@ -62,21 +111,272 @@ const char *lcfg_error_get(struct lcfg *c)
 	return c->error;
 }
 
+struct lcfg_mem *lcfg_mem_get(struct lcfg *c)
+{
+	return &c->mem;
+}
+
+enum lcfg_status lcfg_schema_set(struct lcfg *c, const struct lcfg_schema_rule *rules)
+{
+	return lcfg_parser_schema_set(c->parser, rules);
+}
+
+void lcfg_interpolation_set(struct lcfg *c, enum lcfg_interpolation interpolation)
+{
+	lcfg_parser_interpolation_set(c->parser, interpolation);
+}
+
 enum lcfg_status lcfg_parse(struct lcfg *c)
 {
+	if( c->mem.stats != NULL )
+	{
+		memset(c->mem.stats, 0, sizeof(struct lcfg_stats));
+	}
+
 	return lcfg_parser_run(c->parser);
 }
 
+enum lcfg_status lcfg_parse_filtered(struct lcfg *c, const char **prefixes)
+{
+	if( c->mem.stats != NULL )
+	{
+		memset(c->mem.stats, 0, sizeof(struct lcfg_stats));
+	}
+
+	return lcfg_parser_run_filtered(c->parser, prefixes);
+}
+
+enum lcfg_status lcfg_validate(struct lcfg *c, lcfg_error_function fn, void *user_data)
+{
+	if( c->mem.stats != NULL )
+	{
+		memset(c->mem.stats, 0, sizeof(struct lcfg_stats));
+	}
+
+	return lcfg_parser_run_validate(c->parser, fn, user_data);
+}
+
+enum lcfg_status lcfg_scan(struct lcfg *c, lcfg_token_function fn, void *user_data)
+{
+	if( c->mem.stats != NULL )
+	{
+		memset(c->mem.stats, 0, sizeof(struct lcfg_stats));
+	}
+
+	return lcfg_parser_run_scan(c->parser, fn, user_data);
+}
+
+enum lcfg_status lcfg_parse_lazy(struct lcfg *c)
+{
+	if( c->mem.stats != NULL )
+	{
+		memset(c->mem.stats, 0, sizeof(struct lcfg_stats));
+	}
+
+	return lcfg_parser_run_lazy(c->parser);
+}
+
+enum lcfg_status lcfg_feed(struct lcfg *c, const void *buf, size_t len)
+{
+	if( c->mem.stats != NULL && !lcfg_parser_is_pushing(c->parser) )
+	{
+		memset(c->mem.stats, 0, sizeof(struct lcfg_stats));
+	}
+
+	return lcfg_parser_feed(c->parser, buf, len);
+}
+
+enum lcfg_status lcfg_feed_end(struct lcfg *c)
+{
+	if( c->mem.stats != NULL && !lcfg_parser_is_pushing(c->parser) )
+	{
+		memset(c->mem.stats, 0, sizeof(struct lcfg_stats));
+	}
+
+	return lcfg_parser_feed_end(c->parser);
+}
+
+int lcfg_is_lazy(struct lcfg *c)
+{
+	return lcfg_parser_is_lazy(c->parser);
+}
+
+void lcfg_intern_enable(struct lcfg *c)
+{
+	lcfg_parser_intern_enable(c->parser);
+}
+
+void lcfg_stats_enable(struct lcfg *c)
+{
+	c->mem.stats = &c->stats;
+}
+
+const struct lcfg_stats *lcfg_stats_get(struct lcfg *c)
+{
+	return c->mem.stats;
+}
+
+const char *lcfg_stats_token_name(unsigned int i)
+{
+	if( i >= LCFG_STATS_TOKEN_TYPES )
+	{
+		return NULL;
+	}
+
+	return lcfg_token_map[i];
+}
+
 enum lcfg_status lcfg_accept(struct lcfg *c, lcfg_visitor_function fn, void *user_data)
 {
+	if( c->shared != NULL )
+	{
+		return lcfg_shared_accept_subtree(c->shared, "", fn, user_data);
+	}
+
 	return lcfg_parser_accept(c->parser, fn, user_data);
 }
 
+enum lcfg_status lcfg_accept_subtree(struct lcfg *c, const char *key, lcfg_visitor_function fn, void *user_data)
+{
+	if( c->shared != NULL )
+	{
+		return lcfg_shared_accept_subtree(c->shared, key, fn, user_data);
+	}
+
+	return lcfg_parser_accept_subtree(c->parser, key, fn, user_data);
+}
+
+enum lcfg_status lcfg_accept_batched(struct lcfg *c, size_t batch_size, lcfg_batch_visitor_function fn, void *user_data)
+{
+	if( batch_size == 0 )
+	{
+		batch_size = LCFG_BATCH_SIZE;
+	}
+
+	if( c->shared != NULL )
+	{
+		return lcfg_shared_accept_batched(c->shared, batch_size, fn, user_data);
+	}
+
+	return lcfg_parser_accept_batched(c->parser, batch_size, fn, user_data);
+}
+
+enum lcfg_status lcfg_iter_begin(struct lcfg *c, struct lcfg_iter *it)
+{
+	it->lcfg = c;
+	it->batch.count = 0;
+	it->next = 0;
+	it->run = 0;
+	it->index = 0;
+
+	if( c->shared != NULL )
+	{
+		return lcfg_status_ok;
+	}
+
+	return lcfg_parser_load_all(c->parser);
+}
+
+int lcfg_iter_next(struct lcfg_iter *it, struct lcfg_entry *e)
+{
+	if( it->lcfg->shared != NULL )
+	{
+		return lcfg_shared_entry(it->lcfg->shared, it->index++, e);
+	}
+
+	/* a whole run at a time, the batch points into the parser */
+	if( it->next == it->batch.count )
+	{
+		it->next = 0;
+		if( lcfg_parser_batch(it->lcfg->parser, &it->run, &it->index, (size_t)-1, &it->batch) == 0 )
+		{
+			return 0;
+		}
+	}
+
+	e->key = it->batch.keys[it->next];
+	e->key_len = it->batch.key_lens[it->next];
+	e->value = it->batch.values[it->next];
+	e->value_len = it->batch.value_lens[it->next];
+	it->next++;
+
+	return 1;
+}
+
 enum lcfg_status lcfg_value_get(struct lcfg *c, const char *key, void **data, size_t *len)
 {
+	if( c->shared != NULL )
+	{
+		return lcfg_shared_get(c->shared, key, data, len);
+	}
+
 	return lcfg_parser_get(c->parser, key, data, len);
 }
 
+enum lcfg_status lcfg_publish_shared(struct lcfg *c, const char *name)
+{
+	return lcfg_shared_publish(c, name);
+}
+
+enum lcfg_status lcfg_attach_shared(struct lcfg *c, const char *name)
+{
+	struct lcfg_shared *shared = lcfg_shared_attach(c, name);
+
+	if( shared == NULL )
+	{
+		return lcfg_status_error;
+	}
+
+	if( c->shared != NULL )
+	{
+		lcfg_shared_detach(c->shared);
+	}
+	c->shared = shared;
+
+	return lcfg_status_ok;
+}
+
+uint64_t lcfg_shared_generation(struct lcfg *c)
+{
+	return c->shared != NULL ? lcfg_shared_image_generation(c->shared) : 0;
+}
+
+int lcfg_shared_stale(struct lcfg *c)
+{
+	return c->shared != NULL && lcfg_shared_image_stale(c->shared);
+}
+
+static enum lcfg_status lcfg_write_to(struct lcfg *c, int fd, char **buf, size_t *len)
+{
+	struct lcfg_writer w;
+	enum lcfg_status status;
+
+	lcfg_writer_init(&w, lcfg_mem_get(c), fd);
+
+	status = lcfg_writer_config(&w, c);
+	if( lcfg_writer_finish(&w, buf, len) != lcfg_status_ok )
+	{
+		lcfg_error_set(c, "write(): %s", strerror(w.error));
+		status = lcfg_status_error;
+	}
+	else if( status != lcfg_status_ok && buf != NULL )
+	{
+		lcfg_writer_free(&w, buf, len);
+	}
+
+	return status;
+}
+
+enum lcfg_status lcfg_write(struct lcfg *c, int fd)
+{
+	return lcfg_write_to(c, fd, NULL, NULL);
+}
+
+enum lcfg_status lcfg_write_buffer(struct lcfg *c, char **buf, size_t *len)
+{
+	return lcfg_write_to(c, -1, buf, len);
+}
+
 void lcfg_error_set(struct lcfg *c, const char *fmt, ...)
 {
 	va_list ap;
@@ -0,0 +1,155 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <string.h>
+
+#include "lcfg/lcfg.h"
+#include "lcfg/lcfg_hash.h"
+#include "lcfg/lcfg_mem.h"
+#include "lcfg/lcfg_schema.h"
+
+/* open addressing over the table, slots hold binding index + 1 */
+struct lcfg_bind_index
+{
+	size_t *slots;
+	size_t mask;
+};
+
+static size_t lcfg_bind_find(const struct lcfg_bind_index *h, const struct lcfg_binding *table, const char *key, size_t len)
+{
+	size_t i, slot;
+
+	for( slot = lcfg_hash_buf(key, len) & h->mask; (i = h->slots[slot]) != 0; slot = (slot + 1) & h->mask )
+	{
+		if( !strncmp(table[i - 1].key, key, len) && table[i - 1].key[len] == '\0' )
+		{
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+static enum lcfg_status lcfg_bind_value(struct lcfg *c, const struct lcfg_binding *b, void *object, const char *value, size_t len)
+{
+	char *member = (char *)object + b->offset;
+	long long i;
+	int flag;
+
+	switch( b->type )
+	{
+		case lcfg_schema_string:
+			*(const char **)member = value;
+			return lcfg_status_ok;
+		case lcfg_schema_integer:
+			if( lcfg_schema_integer_value(value, len, &i) )
+			{
+				*(long long *)member = i;
+				return lcfg_status_ok;
+			}
+			break;
+		case lcfg_schema_boolean:
+			if( lcfg_schema_boolean_value(value, &flag) )
+			{
+				*(int *)member = flag;
+				return lcfg_status_ok;
+			}
+			break;
+		default:
+			lcfg_error_set(c, "`%s' cannot be bound to %s", b->key, lcfg_schema_type_name(b->type));
+			return lcfg_status_error;
+	}
+
+	lcfg_error_set(c, "`%s' must be %s", b->key, lcfg_schema_type_name(b->type));
+	return lcfg_status_error;
+}
+
+enum lcfg_status lcfg_bind(struct lcfg *c, const struct lcfg_binding *table, void *object)
+{
+	struct lcfg_mem *m = lcfg_mem_get(c);
+	struct lcfg_bind_index h;
+	struct lcfg_iter it;
+	struct lcfg_entry e;
+	unsigned char *seen;
+	size_t count, capacity, slot, i;
+	enum lcfg_status status;
+
+	for( count = 0; table[count].key != NULL; count++ );
+
+	for( capacity = 8; capacity < count * 2; capacity *= 2 );
+	h.slots = lcfg_mem_alloc(m, capacity * sizeof(size_t));
+	memset(h.slots, 0, capacity * sizeof(size_t));
+	h.mask = capacity - 1;
+	seen = lcfg_mem_alloc(m, count + 1);
+	memset(seen, 0, count + 1);
+
+	status = lcfg_status_ok;
+
+	for( i = 0; status == lcfg_status_ok && i < count; i++ )
+	{
+		for( slot = lcfg_hash(table[i].key) & h.mask; h.slots[slot] != 0; slot = (slot + 1) & h.mask )
+		{
+			if( !strcmp(table[h.slots[slot] - 1].key, table[i].key) )
+			{
+				lcfg_error_set(c, "`%s' is bound more than once", table[i].key);
+				status = lcfg_status_error;
+				break;
+			}
+		}
+		if( status == lcfg_status_ok )
+		{
+			h.slots[slot] = i + 1;
+		}
+	}
+
+	if( status == lcfg_status_ok )
+	{
+		status = lcfg_iter_begin(c, &it);
+	}
+
+	while( status == lcfg_status_ok && lcfg_iter_next(&it, &e) )
+	{
+		/* the first of duplicate keys wins, as with lcfg_value_get() */
+		if( (i = lcfg_bind_find(&h, table, e.key, e.key_len)) != 0 && !seen[i - 1] )
+		{
+			seen[i - 1] = 1;
+			status = lcfg_bind_value(c, &table[i - 1], object, e.value, e.value_len);
+		}
+	}
+
+	for( i = 0; status == lcfg_status_ok && i < count; i++ )
+	{
+		if( !seen[i] && table[i].fallback != NULL )
+		{
+			status = lcfg_bind_value(c, &table[i], object, table[i].fallback, strlen(table[i].fallback));
+		}
+	}
+
+	lcfg_mem_free(m, seen, count + 1);
+	lcfg_mem_free(m, h.slots, capacity * sizeof(size_t));
+
+	return status;
+}
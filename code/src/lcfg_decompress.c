@@ -0,0 +1,341 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#include "lcfg/lcfg_decompress.h"
+#include "lcfg/lcfg_mem.h"
+
+/* the indented includes stay conditional in the output of mksinglefile.sh,
+ * which hoists every "#include <" line */
+#ifdef LCFG_ZLIB
+# include <zlib.h>
+#endif
+#ifdef LCFG_ZSTD
+# define ZSTD_STATIC_LINKING_ONLY  /* ZSTD_createDStream_advanced() */
+# include <zstd.h>
+#endif
+
+struct lcfg_decompress
+{
+	struct lcfg *lcfg;
+	struct lcfg_mem *mem;
+	enum lcfg_compression type;
+
+	lcfg_reader_function reader;
+	void *reader_ctx;
+	char *in;            /* compressed input */
+	size_t in_size;
+	size_t in_offset;
+	size_t in_length;
+	int in_eof;
+	int done;            /* the last stream or frame is complete */
+
+#ifdef LCFG_ZLIB
+	z_stream z;
+#endif
+#ifdef LCFG_ZSTD
+	ZSTD_DStream *zstd;
+#endif
+};
+
+#if defined(LCFG_ZLIB) || defined(LCFG_ZSTD)
+/* zlib and zstd free without a size, so every block they allocate
+ * through lcfg_mem starts with it */
+union lcfg_decompress_block
+{
+	size_t size;
+	long double align_ld;
+	long long align_ll;
+	void *align_p;
+};
+
+static void *lcfg_decompress_alloc(void *opaque, size_t size)
+{
+	union lcfg_decompress_block *b = lcfg_mem_try_alloc(opaque, sizeof(union lcfg_decompress_block) + size);
+
+	if( b == NULL )
+	{
+		return NULL;
+	}
+
+	b->size = size;
+	return b + 1;
+}
+
+static void lcfg_decompress_free(void *opaque, void *ptr)
+{
+	union lcfg_decompress_block *b = ptr;
+
+	if( b != NULL )
+	{
+		b--;
+		lcfg_mem_free(opaque, b, sizeof(union lcfg_decompress_block) + b->size);
+	}
+}
+#endif
+
+#ifdef LCFG_ZLIB
+static voidpf lcfg_decompress_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	if( size != 0 && items > (size_t)-1 / size )
+	{
+		return Z_NULL;
+	}
+
+	return lcfg_decompress_alloc(opaque, (size_t)items * size);
+}
+
+static void lcfg_decompress_zfree(voidpf opaque, voidpf address)
+{
+	lcfg_decompress_free(opaque, address);
+}
+#endif
+
+enum lcfg_compression lcfg_decompress_detect(const char *buf, size_t len)
+{
+	const unsigned char *b = (const unsigned char *)buf;
+
+	/* neither byte sequence can start a valid config */
+	if( len >= 2 && b[0] == 0x1f && b[1] == 0x8b )
+	{
+		return lcfg_compression_gzip;
+	}
+	else if( len >= 4 && b[0] == 0x28 && b[1] == 0xb5 && b[2] == 0x2f && b[3] == 0xfd )
+	{
+		return lcfg_compression_zstd;
+	}
+
+	return lcfg_compression_none;
+}
+
+struct lcfg_decompress *lcfg_decompress_new(struct lcfg *c, enum lcfg_compression type, lcfg_reader_function reader, void *ctx, size_t buffer_size, const char *pending, size_t pending_len)
+{
+	struct lcfg_mem *m = lcfg_mem_get(c);
+	struct lcfg_decompress *d;
+
+	switch( type )
+	{
+#ifdef LCFG_ZLIB
+		case lcfg_compression_gzip:
+			break;
+#endif
+#ifdef LCFG_ZSTD
+		case lcfg_compression_zstd:
+			break;
+#endif
+		default:
+			lcfg_error_set(c, "%s compressed input, but liblcfg was built without --enable-%s",
+				type == lcfg_compression_gzip ? "gzip" : "zstd", type == lcfg_compression_gzip ? "zlib" : "zstd");
+			return NULL;
+	}
+
+	d = lcfg_mem_alloc(m, sizeof(struct lcfg_decompress));
+	memset(d, 0, sizeof(struct lcfg_decompress));
+
+	d->lcfg = c;
+	d->mem = m;
+	d->type = type;
+	d->reader = reader;
+	d->reader_ctx = ctx;
+
+	d->in_size = buffer_size > pending_len ? buffer_size : pending_len;
+	d->in = lcfg_mem_alloc(m, d->in_size);
+	memcpy(d->in, pending, pending_len);
+	d->in_length = pending_len;
+
+#ifdef LCFG_ZLIB
+	if( type == lcfg_compression_gzip )
+	{
+		d->z.zalloc = lcfg_decompress_zalloc;
+		d->z.zfree = lcfg_decompress_zfree;
+		d->z.opaque = m;
+
+		/* 32: expect a gzip or zlib header */
+		if( inflateInit2(&d->z, 15 + 32) != Z_OK )
+		{
+			lcfg_error_set(c, "%s", "inflateInit2() failed");
+			lcfg_mem_free(m, d->in, d->in_size);
+			lcfg_mem_free(m, d, sizeof(struct lcfg_decompress));
+			return NULL;
+		}
+	}
+#endif
+#ifdef LCFG_ZSTD
+	if( type == lcfg_compression_zstd )
+	{
+		ZSTD_customMem zmem = { lcfg_decompress_alloc, lcfg_decompress_free, m };
+
+		d->zstd = ZSTD_createDStream_advanced(zmem);
+		if( d->zstd == NULL || ZSTD_isError(ZSTD_initDStream(d->zstd)) )
+		{
+			lcfg_error_set(c, "%s", "ZSTD_initDStream() failed");
+			ZSTD_freeDStream(d->zstd);
+			lcfg_mem_free(m, d->in, d->in_size);
+			lcfg_mem_free(m, d, sizeof(struct lcfg_decompress));
+			return NULL;
+		}
+	}
+#endif
+
+	return d;
+}
+
+/* decode from the pending input into buf, storing the output size */
+static enum lcfg_status lcfg_decompress_step(struct lcfg_decompress *d, void *buf, size_t len, size_t *produced)
+{
+	size_t available = d->in_length - d->in_offset;
+
+	/* input behind a finished stream starts another one */
+	if( available > 0 )
+	{
+		d->done = 0;
+	}
+
+#ifdef LCFG_ZLIB
+	if( d->type == lcfg_compression_gzip )
+	{
+		int ret;
+
+		d->z.next_in = (unsigned char *)d->in + d->in_offset;
+		d->z.avail_in = available;
+		d->z.next_out = buf;
+		d->z.avail_out = len;
+
+		ret = inflate(&d->z, Z_NO_FLUSH);
+
+		d->in_offset += available - d->z.avail_in;
+		*produced = len - d->z.avail_out;
+
+		if( ret == Z_STREAM_END )
+		{
+			d->done = !0;
+			inflateReset(&d->z);
+		}
+		else if( ret != Z_OK && ret != Z_BUF_ERROR )
+		{
+			lcfg_error_set(d->lcfg, "inflate(): %s", d->z.msg != NULL ? d->z.msg : "invalid gzip data");
+			return lcfg_status_error;
+		}
+	}
+#endif
+#ifdef LCFG_ZSTD
+	if( d->type == lcfg_compression_zstd )
+	{
+		ZSTD_inBuffer in = { d->in, d->in_length, d->in_offset };
+		ZSTD_outBuffer out = { buf, len, 0 };
+		size_t ret = ZSTD_decompressStream(d->zstd, &out, &in);
+
+		if( ZSTD_isError(ret) )
+		{
+			lcfg_error_set(d->lcfg, "ZSTD_decompressStream(): %s", ZSTD_getErrorName(ret));
+			return lcfg_status_error;
+		}
+
+		d->in_offset = in.pos;
+		*produced = out.pos;
+
+		if( ret == 0 )
+		{
+			d->done = !0;
+		}
+	}
+#endif
+
+	return lcfg_status_ok;
+}
+
+ssize_t lcfg_decompress_read(void *ctx, void *buf, size_t len)
+{
+	struct lcfg_decompress *d = ctx;
+	size_t produced;
+	ssize_t n;
+
+	for( ;; )
+	{
+		if( d->in_offset == d->in_length && !d->in_eof )
+		{
+			n = d->reader(d->reader_ctx, d->in, d->in_size);
+
+			if( n < 0 )
+			{
+				lcfg_error_set(d->lcfg, "read(): %s", strerror(errno));
+				return -1;
+			}
+
+			d->in_offset = 0;
+			d->in_length = n;
+			d->in_eof = n == 0;
+		}
+
+		/* runs without input too, the decoder may hold back output */
+		produced = 0;
+		if( lcfg_decompress_step(d, buf, len, &produced) != lcfg_status_ok )
+		{
+			return -1;
+		}
+
+		if( produced > 0 )
+		{
+			return produced;
+		}
+
+		if( d->in_offset == d->in_length && d->in_eof )
+		{
+			if( !d->done )
+			{
+				lcfg_error_set(d->lcfg, "%s", "premature end of compressed input");
+				return -1;
+			}
+
+			return 0;
+		}
+	}
+}
+
+void lcfg_decompress_delete(struct lcfg_decompress *d)
+{
+#ifdef LCFG_ZLIB
+	if( d->type == lcfg_compression_gzip )
+	{
+		inflateEnd(&d->z);
+	}
+#endif
+#ifdef LCFG_ZSTD
+	if( d->type == lcfg_compression_zstd )
+	{
+		ZSTD_freeDStream(d->zstd);
+	}
+#endif
+
+	lcfg_mem_free(d->mem, d->in, d->in_size);
+	lcfg_mem_free(d->mem, d, sizeof(struct lcfg_decompress));
+}
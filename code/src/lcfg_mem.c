@@ -0,0 +1,138 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "lcfg/lcfg_mem.h"
+
+static void *lcfg_mem_default_alloc(void *ctx, size_t size)
+{
+	(void)ctx;
+
+	return malloc(size);
+}
+
+static void *lcfg_mem_default_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+	(void)ctx;
+	(void)old_size;
+
+	return realloc(ptr, new_size);
+}
+
+static void lcfg_mem_default_free(void *ctx, void *ptr, size_t size)
+{
+	(void)ctx;
+	(void)size;
+
+	free(ptr);
+}
+
+static const struct lcfg_allocator lcfg_mem_default_allocator =
+{
+	lcfg_mem_default_alloc,
+	lcfg_mem_default_realloc,
+	lcfg_mem_default_free,
+	NULL
+};
+
+void lcfg_mem_init(struct lcfg_mem *m, const struct lcfg_allocator *a)
+{
+	m->allocator = a != NULL ? *a : lcfg_mem_default_allocator;
+	m->stats = NULL;
+}
+
+void *lcfg_mem_try_alloc(struct lcfg_mem *m, size_t size)
+{
+	void *ptr = m->allocator.alloc(m->allocator.ctx, size);
+
+	if( ptr != NULL && m->stats != NULL )
+	{
+		m->stats->allocations++;
+		m->stats->bytes_allocated += size;
+	}
+
+	return ptr;
+}
+
+void *lcfg_mem_alloc(struct lcfg_mem *m, size_t size)
+{
+	void *ptr = lcfg_mem_try_alloc(m, size);
+	assert(ptr);
+
+	return ptr;
+}
+
+void *lcfg_mem_try_realloc(struct lcfg_mem *m, void *ptr, size_t old_size, size_t new_size)
+{
+	ptr = m->allocator.realloc(m->allocator.ctx, ptr, old_size, new_size);
+
+	if( ptr != NULL && m->stats != NULL )
+	{
+		m->stats->allocations++;
+		if( new_size > old_size )
+		{
+			m->stats->bytes_allocated += new_size - old_size;
+		}
+	}
+
+	return ptr;
+}
+
+void *lcfg_mem_realloc(struct lcfg_mem *m, void *ptr, size_t old_size, size_t new_size)
+{
+	ptr = lcfg_mem_try_realloc(m, ptr, old_size, new_size);
+	assert(ptr);
+
+	return ptr;
+}
+
+void lcfg_mem_free(struct lcfg_mem *m, void *ptr, size_t size)
+{
+	m->allocator.free(m->allocator.ctx, ptr, size);
+}
+
+char *lcfg_mem_strdup(struct lcfg_mem *m, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *dup = lcfg_mem_alloc(m, len);
+
+	memcpy(dup, s, len);
+
+	return dup;
+}
+
+double lcfg_stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,352 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <string.h>
+#include <ctype.h>
+
+#include "lcfg/lcfg.h"
+#include "lcfg/lcfg_mem.h"
+#include "lcfg/lcfg_hash.h"
+
+enum lcfg_overlay_type { lcfg_overlay_none = 0, lcfg_overlay_leaf, lcfg_overlay_map, lcfg_overlay_list };
+
+/* a key or a prefix of keys in a layer, pointing into the layer */
+struct lcfg_overlay_node
+{
+	const char *key;
+	size_t len;
+	enum lcfg_overlay_type type;
+};
+
+/* open addressing table of the nodes of one layer */
+struct lcfg_overlay_index
+{
+	struct lcfg_overlay_node *nodes;
+	size_t capacity;
+	size_t count;
+};
+
+struct lcfg_overlay
+{
+	struct lcfg_mem mem;
+	struct lcfg **layers;  /* bottom to top */
+	struct lcfg_overlay_index *indexes;
+	size_t count;
+	size_t capacity;
+};
+
+/* visits the values of one layer that are neither replaced by a higher
+ * layer nor visited with a lower one, with the value of the topmost layer
+ * that has the key */
+struct lcfg_overlay_visit
+{
+	struct lcfg_overlay *o;
+	size_t layer;
+	lcfg_visitor_function fn;
+	void *user_data;
+};
+
+static struct lcfg_overlay_node *lcfg_overlay_slot(struct lcfg_overlay_node *nodes, size_t capacity, const char *key, size_t len)
+{
+	size_t slot;
+
+	for( slot = lcfg_hash_buf(key, len) & (capacity - 1); nodes[slot].key != NULL; slot = (slot + 1) & (capacity - 1) )
+	{
+		if( nodes[slot].len == len && !memcmp(nodes[slot].key, key, len) )
+		{
+			break;
+		}
+	}
+
+	return &nodes[slot];
+}
+
+static enum lcfg_overlay_type lcfg_overlay_lookup(const struct lcfg_overlay_index *idx, const char *key, size_t len)
+{
+	if( idx->count == 0 )
+	{
+		return lcfg_overlay_none;
+	}
+
+	return lcfg_overlay_slot(idx->nodes, idx->capacity, key, len)->type;
+}
+
+/* the first statement of a key decides its type, as with lookups */
+static void lcfg_overlay_insert(struct lcfg_overlay *o, struct lcfg_overlay_index *idx, const char *key, size_t len, enum lcfg_overlay_type type)
+{
+	struct lcfg_overlay_node *n, *nodes;
+	size_t capacity, i;
+
+	if( (idx->count + 1) * 2 > idx->capacity )
+	{
+		capacity = idx->capacity == 0 ? 64 : idx->capacity * 2;
+		nodes = lcfg_mem_alloc(&o->mem, sizeof(struct lcfg_overlay_node) * capacity);
+		memset(nodes, 0, sizeof(struct lcfg_overlay_node) * capacity);
+
+		for( i = 0; i < idx->capacity; i++ )
+		{
+			if( idx->nodes[i].key != NULL )
+			{
+				*lcfg_overlay_slot(nodes, capacity, idx->nodes[i].key, idx->nodes[i].len) = idx->nodes[i];
+			}
+		}
+
+		if( idx->nodes != NULL )
+		{
+			lcfg_mem_free(&o->mem, idx->nodes, sizeof(struct lcfg_overlay_node) * idx->capacity);
+		}
+		idx->nodes = nodes;
+		idx->capacity = capacity;
+	}
+
+	n = lcfg_overlay_slot(idx->nodes, idx->capacity, key, len);
+	if( n->key == NULL )
+	{
+		n->key = key;
+		n->len = len;
+		n->type = type;
+		idx->count++;
+	}
+}
+
+static void lcfg_overlay_index_free(struct lcfg_overlay *o, struct lcfg_overlay_index *idx)
+{
+	if( idx->nodes != NULL )
+	{
+		lcfg_mem_free(&o->mem, idx->nodes, sizeof(struct lcfg_overlay_node) * idx->capacity);
+	}
+	memset(idx, 0, sizeof(struct lcfg_overlay_index));
+}
+
+/* every key of the layer and every prefix of one: list indexes are the
+ * only path components that start with a digit */
+static void lcfg_overlay_index_build(struct lcfg_overlay *o, size_t layer)
+{
+	struct lcfg_overlay_index *idx = &o->indexes[layer];
+	struct lcfg_iter it;
+	struct lcfg_entry e;
+	size_t i;
+
+	lcfg_overlay_index_free(o, idx);
+
+	if( lcfg_iter_begin(o->layers[layer], &it) != lcfg_status_ok )
+	{
+		return;
+	}
+
+	while( lcfg_iter_next(&it, &e) )
+	{
+		for( i = 0; i < e.key_len; i++ )
+		{
+			if( e.key[i] == '.' )
+			{
+				lcfg_overlay_insert(o, idx, e.key, i, isdigit((unsigned char)e.key[i + 1]) ? lcfg_overlay_list : lcfg_overlay_map);
+			}
+		}
+		lcfg_overlay_insert(o, idx, e.key, e.key_len, lcfg_overlay_leaf);
+	}
+}
+
+struct lcfg_overlay *lcfg_overlay_new(void)
+{
+	struct lcfg_mem m;
+	struct lcfg_overlay *o;
+
+	lcfg_mem_init(&m, NULL);
+
+	o = lcfg_mem_alloc(&m, sizeof(struct lcfg_overlay));
+	memset(o, 0, sizeof(struct lcfg_overlay));
+	o->mem = m;
+
+	return o;
+}
+
+size_t lcfg_overlay_add(struct lcfg_overlay *o, struct lcfg *c)
+{
+	if( o->count == o->capacity )
+	{
+		size_t capacity = o->capacity == 0 ? 4 : o->capacity * 2;
+
+		o->layers = lcfg_mem_realloc(&o->mem, o->layers, sizeof(struct lcfg *) * o->capacity, sizeof(struct lcfg *) * capacity);
+		o->indexes = lcfg_mem_realloc(&o->mem, o->indexes, sizeof(struct lcfg_overlay_index) * o->capacity, sizeof(struct lcfg_overlay_index) * capacity);
+		o->capacity = capacity;
+	}
+
+	o->layers[o->count] = c;
+	memset(&o->indexes[o->count], 0, sizeof(struct lcfg_overlay_index));
+	lcfg_overlay_index_build(o, o->count);
+
+	return o->count++;
+}
+
+void lcfg_overlay_set(struct lcfg_overlay *o, size_t layer, struct lcfg *c)
+{
+	if( layer < o->count )
+	{
+		o->layers[layer] = c;
+		lcfg_overlay_index_build(o, layer);
+	}
+}
+
+/* layer replaces the values of key in the layers below it: it has a
+ * scalar or a list at or above key, or a different type of container. a
+ * map only replaces the keys it has itself. */
+static int lcfg_overlay_cuts(struct lcfg_overlay *o, size_t layer, const char *key, size_t len)
+{
+	const struct lcfg_overlay_index *idx = &o->indexes[layer];
+	enum lcfg_overlay_type type = lcfg_overlay_lookup(idx, key, len), prefix, expected;
+	size_t i;
+
+	if( type != lcfg_overlay_none && type != lcfg_overlay_leaf )
+	{
+		return 1;
+	}
+
+	for( i = 0; i < len; i++ )
+	{
+		if( key[i] != '.' )
+		{
+			continue;
+		}
+
+		prefix = lcfg_overlay_lookup(idx, key, i);
+		expected = isdigit((unsigned char)key[i + 1]) ? lcfg_overlay_list : lcfg_overlay_map;
+
+		if( prefix == lcfg_overlay_none )
+		{
+			return 0;
+		}
+		else if( prefix != expected || (prefix == lcfg_overlay_list && type != lcfg_overlay_leaf) )
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+enum lcfg_status lcfg_overlay_value_get(struct lcfg_overlay *o, const char *key, void **data, size_t *len)
+{
+	size_t key_len = strlen(key);
+	size_t i;
+
+	for( i = o->count; i > 0; i-- )
+	{
+		if( lcfg_overlay_lookup(&o->indexes[i - 1], key, key_len) == lcfg_overlay_leaf )
+		{
+			return lcfg_value_get(o->layers[i - 1], key, data, len);
+		}
+		else if( lcfg_overlay_cuts(o, i - 1, key, key_len) )
+		{
+			break;
+		}
+	}
+
+	return lcfg_status_error;
+}
+
+static enum lcfg_status lcfg_overlay_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct lcfg_overlay_visit *v = user_data;
+	struct lcfg_overlay *o = v->o;
+	size_t key_len = strlen(key);
+	size_t i, j;
+
+	/* replaced, visited with a higher layer if at all */
+	for( i = v->layer + 1; i < o->count; i++ )
+	{
+		if( lcfg_overlay_cuts(o, i, key, key_len) )
+		{
+			return lcfg_status_ok;
+		}
+	}
+
+	/* already visited with a lower layer */
+	for( i = 0; i < v->layer; i++ )
+	{
+		if( lcfg_overlay_lookup(&o->indexes[i], key, key_len) == lcfg_overlay_leaf )
+		{
+			for( j = i + 1; j <= v->layer && !lcfg_overlay_cuts(o, j, key, key_len); j++ );
+			if( j > v->layer )
+			{
+				return lcfg_status_ok;
+			}
+		}
+	}
+
+	for( i = o->count - 1; i > v->layer; i-- )
+	{
+		if( lcfg_overlay_lookup(&o->indexes[i], key, key_len) == lcfg_overlay_leaf )
+		{
+			lcfg_value_get(o->layers[i], key, &data, &len);
+			break;
+		}
+	}
+
+	return v->fn(key, data, len, v->user_data);
+}
+
+enum lcfg_status lcfg_overlay_accept_subtree(struct lcfg_overlay *o, const char *key, lcfg_visitor_function fn, void *user_data)
+{
+	struct lcfg_overlay_visit v;
+
+	v.o = o;
+	v.fn = fn;
+	v.user_data = user_data;
+
+	for( v.layer = 0; v.layer < o->count; v.layer++ )
+	{
+		if( lcfg_accept_subtree(o->layers[v.layer], key, lcfg_overlay_visitor, &v) != lcfg_status_ok )
+		{
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+enum lcfg_status lcfg_overlay_accept(struct lcfg_overlay *o, lcfg_visitor_function fn, void *user_data)
+{
+	return lcfg_overlay_accept_subtree(o, "", fn, user_data);
+}
+
+void lcfg_overlay_delete(struct lcfg_overlay *o)
+{
+	struct lcfg_mem m = o->mem;
+	size_t i;
+
+	for( i = 0; i < o->count; i++ )
+	{
+		lcfg_overlay_index_free(o, &o->indexes[i]);
+	}
+
+	if( o->layers != NULL )
+	{
+		lcfg_mem_free(&m, o->layers, sizeof(struct lcfg *) * o->capacity);
+		lcfg_mem_free(&m, o->indexes, sizeof(struct lcfg_overlay_index) * o->capacity);
+	}
+	lcfg_mem_free(&m, o, sizeof(struct lcfg_overlay));
+}
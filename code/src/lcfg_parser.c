@@ -32,10 +32,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
 
 #include "lcfg/lcfg_token.h"
 #include "lcfg/lcfg_scanner.h"
 #include "lcfg/lcfg_parser.h"
+#include "lcfg/lcfg_mem.h"
+#include "lcfg/lcfg_hash.h"
+#include "lcfg/lcfg_schema.h"
+#include "lcfg/lcfg_decompress.h"
 
 #ifndef strdup
 char *strdup(const char *s)
@@ -54,306 +61,2467 @@ char *strdup(const char *s)
 }
 #endif
 
-struct lcfg_parser_value_pair
+/* position of a value in the input, for messages */
+struct lcfg_parser_position
 {
-	char *key;
-	struct lcfg_string *value;
+	uint64_t line;
+	uint64_t col;
+};
+
+/* keys and values are packed into chunks, which are merged into a single
+ * exactly sized one holding all keys and then all values after a complete
+ * parse */
+struct lcfg_parser_chunk
+{
+	struct lcfg_parser_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
 };
 
+#define LCFG_PARSER_CHUNK_MIN 0x400
+#define LCFG_PARSER_CHUNK_MAX 0x10000
+
+
+/* a top-level statement recorded by lcfg_parser_run_lazy() */
+struct lcfg_parser_span
+{
+	char *key;
+	uint64_t start;      /* input offset of the identifier */
+	uint64_t end;        /* input offset behind the value */
+	uint64_t line;
+	uint64_t col;
+	int loaded;
+	size_t first_value;  /* values of this statement, once loaded */
+	size_t value_count;
+};
 
 struct lcfg_parser
 {
 	struct lcfg *lcfg;
+	struct lcfg_mem *mem;
 	char *filename;
-	struct lcfg_scanner *scanner;
 
-	struct lcfg_parser_value_pair *values;
-	unsigned int value_length;
-	unsigned int value_capacity;
+	/* input from a callback instead of filename */
+	lcfg_reader_function reader;
+	void *reader_ctx;
+	size_t buffer_size;
+
+	/* the values in parse order as struct-of-arrays, so that a visit
+	 * reads each array front to back. keys and values are NUL-terminated,
+	 * values may contain NULs. */
+	char **keys;
+	size_t *key_lens;
+	char **values;
+	size_t *value_lens;
+	struct lcfg_parser_position *positions;
+	size_t value_length;
+	size_t value_capacity;
+
+	struct lcfg_parser_chunk *chunks;  /* the first one has room left */
+	size_t chunk_bytes;                /* data bytes of all chunks */
+	size_t key_bytes;                  /* in use by the stored values */
+	size_t value_bytes;
+
+	/* open addressing table of value index + 1 by value, equal values
+	 * point to the storage of the first one */
+	int intern;
+	size_t *intern_table;
+	size_t intern_capacity;
+	size_t intern_count;
+
+	/* NULL-terminated key prefixes to parse, NULL for everything */
+	const char **filter;
+
+	/* lazy mode: the file stays open and statements are parsed on demand */
+	int lazy;
+	int fd;
+	pthread_mutex_t lock;
+	struct lcfg_parser_span *spans;
+	size_t span_length;
+	size_t span_capacity;
+
+	/* open addressing table of value index + 1 by key, 0 marks a free
+	 * slot. built after a complete parse, lookups fall back to a scan. */
+	size_t *hash;
+	size_t hash_capacity;
+
+	/* push mode: input arrives through lcfg_parser_feed() */
+	struct lcfg_parser_context *push;
+	int push_closed;
+
+	/* validate-only mode: nothing is stored, errors are reported to
+	 * error_fn and parsing resumes at the next statement */
+	int validate;
+	size_t error_count;
+	lcfg_error_function error_fn;
+	void *error_data;
+
+	/* rules checked during eager parses, NULL for none */
+	struct lcfg_schema *schema;
+
+	/* resolve ${key} references after a complete parse */
+	enum lcfg_interpolation interpolation;
+
+	/* files being included around this parse, NULL for the outermost */
+	const struct lcfg_parser_include *include;
+
+	/* files included by an included file, for its cache entry */
+	struct lcfg_parser_file *files;
+	size_t file_count;
+	size_t file_capacity;
 };
 
-static int lcfg_parser_add_value(struct lcfg_parser *p, const char *key, struct lcfg_string *value)
+/* a link in the chain of files that include each other */
+struct lcfg_parser_include
 {
-	if( p->value_length == p->value_capacity )
-	{
-		p->value_capacity *= 2;
-		p->values = realloc(p->values, sizeof(struct lcfg_parser_value_pair) * p->value_capacity);
-		assert(p->values);
-	}
+	dev_t dev;
+	ino_t ino;
+	const struct lcfg_parser_include *parent;
+};
 
-	p->values[p->value_length].key = strdup(key);
-	p->values[p->value_length].value = lcfg_string_new_copy(value);
+/* a file as it was when its values were read */
+struct lcfg_parser_file
+{
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	off_t size;
+};
 
-	return ++p->value_length;
-}
+/* the values of an included file, shared by all parsers of the process.
+ * one block from the allocator of the parser that read it, which has to
+ * stay usable until the fragment is replaced or flushed. */
+struct lcfg_parser_fragment
+{
+	struct lcfg_mem mem;
+	size_t block_size;
+	struct lcfg_parser_file *files;  /* the file itself, then all it includes */
+	size_t file_count;
+	size_t count;
+	char **keys;
+	char **values;
+	size_t *value_lens;
+	struct lcfg_parser_fragment *next;
+};
 
-struct lcfg_parser *lcfg_parser_new(struct lcfg *c, const char *filename)
+static struct lcfg_parser_fragment *lcfg_parser_fragments = NULL;
+static pthread_mutex_t lcfg_parser_fragments_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *lcfg_parser_chunk_alloc(struct lcfg_parser *p, size_t len)
 {
-	struct lcfg_parser *p = malloc(sizeof(struct lcfg_parser));
-	assert(p);
+	struct lcfg_parser_chunk *c = p->chunks;
+	size_t size;
+	char *data;
 
-	memset(p, 0, sizeof(struct lcfg_parser));
+	if( c == NULL || c->size - c->used < len )
+	{
+		size = c == NULL || c->size < LCFG_PARSER_CHUNK_MIN ? LCFG_PARSER_CHUNK_MIN : c->size * 2;
+		if( size > LCFG_PARSER_CHUNK_MAX )
+		{
+			size = LCFG_PARSER_CHUNK_MAX;
+		}
+		if( size < len )
+		{
+			size = len;
+		}
 
-	p->filename = strdup(filename);
-	p->lcfg = c;
+		c = lcfg_mem_alloc(p->mem, sizeof(struct lcfg_parser_chunk) + size);
+		c->size = size;
+		c->used = 0;
+		c->next = p->chunks;
+		p->chunks = c;
+		p->chunk_bytes += size;
+	}
 
-	p->value_length = 0;
-	p->value_capacity = 8;
-	p->values = malloc(sizeof(struct lcfg_parser_value_pair) * p->value_capacity);
-	assert(p->values);
+	data = c->data + c->used;
+	c->used += len;
 
-	return p;
+	return data;
 }
 
-/* this is a basic push down automata */
-static enum lcfg_status lcfg_parser_parse(struct lcfg_parser *p)
+static void lcfg_parser_chunks_free(struct lcfg_parser *p)
 {
-	enum state { top_level = 0, exp_equals, exp_value, in_list, in_map, invalid };
-	/*const char *state_map[] = { "top_level", "exp_equals", "exp_value", "in_list", "in_map", "invalid" };*/
+	struct lcfg_parser_chunk *c, *next;
 
-	struct state_element
+	for( c = p->chunks; c != NULL; c = next )
 	{
-		enum state s;
-		int list_counter;
-	};
-
-	/* start of ugly preproc stuff */
-#define STATE_STACK_PUSH(t) \
-	if( ssi + 1 == state_stack_size ) \
-	{ \
-		state_stack_size *= 2; \
-		state_stack = realloc(state_stack, state_stack_size * sizeof(struct state_element)); \
-	} \
-	state_stack[++ssi].s = t; \
-	state_stack[ssi].list_counter = 0
-#define STATE_STACK_POP() ssi--
-#define PATH_PUSH_STR(s) \
-	if( lcfg_string_len(current_path) != 0 ) \
-	{ \
-		lcfg_string_cat_char(current_path, '.'); \
-	} \
-	lcfg_string_cat_cstr(current_path, s);
-#define PATH_PUSH_INT(i) \
-	if( lcfg_string_len(current_path) != 0 ) \
-	{ \
-		lcfg_string_cat_char(current_path, '.'); \
-	} \
-	lcfg_string_cat_uint(current_path, i);
-#define PATH_POP() \
-	if( lcfg_string_rfind(current_path, '.') != -1 ) \
-	{ \
-		lcfg_string_trunc(current_path, lcfg_string_rfind(current_path, '.')); \
-	} \
-	else \
-	{ \
-		lcfg_string_trunc(current_path, 0); \
+		next = c->next;
+		lcfg_mem_free(p->mem, c, sizeof(struct lcfg_parser_chunk) + c->size);
 	}
-	/* end of ugly preproc stuff */
 
-	if( lcfg_scanner_init(p->scanner) != lcfg_status_ok )
+	p->chunks = NULL;
+	p->chunk_bytes = 0;
+}
+
+/* index of the first value equal to value, -1 if there is none */
+static ssize_t lcfg_parser_intern_find(struct lcfg_parser *p, const char *value, size_t len)
+{
+	size_t i, j;
+
+	if( p->intern_table == NULL )
 	{
-		return lcfg_status_error;
+		return -1;
 	}
 
-	int state_stack_size = 8;
-	int ssi = 0; /* ssi = state stack index */
-	struct state_element *state_stack = malloc(sizeof(struct state_element) * state_stack_size);
+	for( i = lcfg_hash_buf(value, len) & (p->intern_capacity - 1); p->intern_table[i] != 0; i = (i + 1) & (p->intern_capacity - 1) )
+	{
+		j = p->intern_table[i] - 1;
+		if( p->value_lens[j] == len && !memcmp(p->values[j], value, len) )
+		{
+			return j;
+		}
+	}
 
-	state_stack[ssi].s = top_level;
-	state_stack[ssi].list_counter = 0;
+	return -1;
+}
 
-	struct lcfg_token t;
-	struct lcfg_string *current_path = lcfg_string_new();
+static void lcfg_parser_intern_insert(struct lcfg_parser *p, size_t index)
+{
+	size_t *old = p->intern_table;
+	size_t old_capacity = p->intern_capacity;
+	size_t i, j;
 
-	while( lcfg_scanner_has_next(p->scanner) && state_stack[ssi].s != invalid )
+	/* at most half full */
+	if( old == NULL || (p->intern_count + 1) * 2 > old_capacity )
 	{
-		if( lcfg_scanner_next_token(p->scanner, &t) != lcfg_status_ok )
+		p->intern_capacity = old == NULL ? 64 : old_capacity * 2;
+		p->intern_table = lcfg_mem_alloc(p->mem, sizeof(size_t) * p->intern_capacity);
+		memset(p->intern_table, 0, sizeof(size_t) * p->intern_capacity);
+		p->intern_count = 0;
+
+		for( j = 0; old != NULL && j < old_capacity; j++ )
 		{
-			free(state_stack);
-			lcfg_string_delete(t.string);
-			lcfg_string_delete(current_path);
-			return lcfg_status_error;
+			if( old[j] != 0 )
+			{
+				lcfg_parser_intern_insert(p, old[j] - 1);
+			}
 		}
 
-		switch( state_stack[ssi].s )
+		if( old != NULL )
 		{
-			case top_level:
-			case in_map:
-				if( t.type == lcfg_identifier )
-				{
-					PATH_PUSH_STR(lcfg_string_cstr(t.string));
-					STATE_STACK_PUSH(exp_equals);
-				}
-				else if( state_stack[ssi].s == in_map && t.type == lcfg_brace_close )
-				{
-					STATE_STACK_POP();
-					PATH_POP();
-				}
-				else
-				{
-					lcfg_error_set(p->lcfg, "invalid token (%s) near line %d column %d: expected identifier%s", lcfg_token_map[t.type], t.line, t.col, state_stack[ssi].s == in_map ? " or `}'" : "");
-					state_stack[ssi].s = invalid;
-				}
-				break;
-			case exp_equals:
-				if( t.type == lcfg_equals )
-					state_stack[ssi].s = exp_value;
-				else
-				{
-					lcfg_error_set(p->lcfg, "invalid token (%s) near line %d column %d: expected `='", lcfg_token_map[t.type], t.line, t.col);
-					state_stack[ssi].s = invalid;
-				}
-				break;
-			case exp_value:
-				if( t.type == lcfg_string )
-				{
-					lcfg_parser_add_value(p, lcfg_string_cstr(current_path), t.string);
-					/*printf("adding string value for single statement\n");*/
-					STATE_STACK_POP();
-					PATH_POP();
-				}
-				else if( t.type == lcfg_sbracket_open )
-				{
-					state_stack[ssi].s = in_list;
-				}
-				else if( t.type == lcfg_brace_open )
-				{
-					state_stack[ssi].s = in_map;
-				}
-				else
-				{
-					lcfg_error_set(p->lcfg, "invalid token (%s) near line %d column %d: expected string, `[' or `{'", lcfg_token_map[t.type], t.line, t.col);
-					state_stack[ssi].s = invalid;
-				}
-				break;
-			case in_list:
-				if( t.type == lcfg_comma ); /* ignore comma */
-				else if( t.type == lcfg_string )
-				{
-					PATH_PUSH_INT(state_stack[ssi].list_counter);
-					lcfg_parser_add_value(p, lcfg_string_cstr(current_path), t.string);
-					PATH_POP();
-					/*printf("adding string to list pos %d\n", state_stack[ssi].list_counter);*/
-					state_stack[ssi].list_counter++;
-				}
-				else if( t.type == lcfg_sbracket_open )
-				{
-					PATH_PUSH_INT(state_stack[ssi].list_counter);
-					/*printf("adding list to list pos %d\n", state_stack[ssi].list_counter);*/
-					state_stack[ssi].list_counter++;
-					STATE_STACK_PUSH(in_list);
-				}
-				else if( t.type == lcfg_brace_open )
-				{
-					PATH_PUSH_INT(state_stack[ssi].list_counter);
-					/*printf("adding map to list pos %d\n", state_stack[ssi].list_counter);*/
-					state_stack[ssi].list_counter++;
-					STATE_STACK_PUSH(in_map);
-				}
-				else if( t.type == lcfg_sbracket_close )
-				{
-					PATH_POP();
-					STATE_STACK_POP();
-				}
-				else
-				{
-					lcfg_error_set(p->lcfg, "invalid token (%s) near line %d column %d: expected string, `[', `{', `,' or `]'", lcfg_token_map[t.type], t.line, t.col);
-					state_stack[ssi].s = invalid;
-				}
-				break;
-			case invalid: /* unreachable */
-				assert(0);
-				break;
+			lcfg_mem_free(p->mem, old, sizeof(size_t) * old_capacity);
 		}
+	}
 
-		lcfg_string_delete(t.string);
-
-		/*printf(" *** pda: read %s, state is now %s\n", lcfg_token_map[t.type], state_map[state_stack[ssi].s]);*/
+	i = lcfg_hash_buf(p->values[index], p->value_lens[index]) & (p->intern_capacity - 1);
+	while( p->intern_table[i] != 0 )
+	{
+		i = (i + 1) & (p->intern_capacity - 1);
 	}
 
-	lcfg_string_delete(current_path);
+	p->intern_table[i] = index + 1;
+	p->intern_count++;
+}
+
+/* index the current values again, e.g. after some were dropped or
+ * replaced, and recount the bytes of distinct values */
+static void lcfg_parser_intern_rebuild(struct lcfg_parser *p)
+{
+	size_t i;
 
-	if( state_stack[ssi].s == top_level && ssi == 0 )
+	if( p->intern_table != NULL )
 	{
-		free(state_stack);
-		return lcfg_status_ok;
+		lcfg_mem_free(p->mem, p->intern_table, sizeof(size_t) * p->intern_capacity);
+		p->intern_table = NULL;
+		p->intern_capacity = 0;
+		p->intern_count = 0;
 	}
-	else
+
+	p->value_bytes = 0;
+	for( i = 0; i < p->value_length; i++ )
 	{
-		free(state_stack);
-		lcfg_error_set(p->lcfg, "%s", "unexpected end of file: unterminated list/map?");
-		return lcfg_status_error;
+		if( lcfg_parser_intern_find(p, p->values[i], p->value_lens[i]) < 0 )
+		{
+			lcfg_parser_intern_insert(p, i);
+			p->value_bytes += p->value_lens[i] + 1;
+		}
 	}
 }
 
-enum lcfg_status lcfg_parser_run(struct lcfg_parser *p)
+static void *lcfg_parser_array_resize(struct lcfg_parser *p, void *array, size_t element_size, size_t capacity)
 {
-	int fd = open(p->filename, 0);
-	enum lcfg_status status;
+	return lcfg_mem_realloc(p->mem, array, element_size * p->value_capacity, element_size * capacity);
+}
+
+static void lcfg_parser_values_resize(struct lcfg_parser *p, size_t capacity)
+{
+	p->keys = lcfg_parser_array_resize(p, p->keys, sizeof(char *), capacity);
+	p->key_lens = lcfg_parser_array_resize(p, p->key_lens, sizeof(size_t), capacity);
+	p->values = lcfg_parser_array_resize(p, p->values, sizeof(char *), capacity);
+	p->value_lens = lcfg_parser_array_resize(p, p->value_lens, sizeof(size_t), capacity);
+	p->positions = lcfg_parser_array_resize(p, p->positions, sizeof(struct lcfg_parser_position), capacity);
+	p->value_capacity = capacity;
+}
+
+/* move all keys and then all values into one chunk without slack, in
+ * parse order, dropping values that have been replaced, and fit the
+ * value arrays */
+static void lcfg_parser_pack(struct lcfg_parser *p)
+{
+	struct lcfg_parser_chunk *c;
+	size_t size;
+	size_t i;
+	ssize_t j;
+	char *data;
 
-	if( fd < 0 )
+	/* interpolation may have replaced shared values */
+	if( p->intern )
 	{
-		lcfg_error_set(p->lcfg, "open(): %s", strerror(errno));
-		return lcfg_status_error;
+		lcfg_parser_intern_rebuild(p);
+	}
+	size = p->key_bytes + p->value_bytes;
+
+	if( p->value_length != 0 && p->value_length != p->value_capacity )
+	{
+		lcfg_parser_values_resize(p, p->value_length);
 	}
 
-	p->scanner = lcfg_scanner_new(p->lcfg, fd);
+	if( p->chunks == NULL )
+	{
+		return;
+	}
 
-	status = lcfg_parser_parse(p);
+	if( size == 0 )
+	{
+		lcfg_parser_chunks_free(p);
+		return;
+	}
 
-	close(fd);
+	c = lcfg_mem_alloc(p->mem, sizeof(struct lcfg_parser_chunk) + size);
+	c->size = c->used = size;
+	c->next = NULL;
+	data = c->data;
 
-	return status;
-}
-enum lcfg_status lcfg_parser_accept(struct lcfg_parser *p, lcfg_visitor_function fn, void *user_data)
-{
-	int i;
+	for( i = 0; i < p->value_length; i++ )
+	{
+		memcpy(data, p->keys[i], p->key_lens[i] + 1);
+		p->keys[i] = data;
+		data += p->key_lens[i] + 1;
+	}
 
 	for( i = 0; i < p->value_length; i++ )
 	{
-		if( fn(p->values[i].key, (void *)lcfg_string_cstr(p->values[i].value), lcfg_string_len(p->values[i].value), user_data) != lcfg_status_ok )
+		/* the first of equal values has been moved already */
+		if( p->intern && (j = lcfg_parser_intern_find(p, p->values[i], p->value_lens[i])) >= 0 && (size_t)j < i )
 		{
-			lcfg_error_set(p->lcfg, "%s", "configuration value traversal aborted upon user request");
-			return lcfg_status_error;
+			p->values[i] = p->values[j];
+			continue;
 		}
+
+		memcpy(data, p->values[i], p->value_lens[i] + 1);
+		p->values[i] = data;
+		data += p->value_lens[i] + 1;
 	}
 
-	return lcfg_status_ok;
+	lcfg_parser_chunks_free(p);
+	p->chunks = c;
+	p->chunk_bytes = size;
 }
 
-enum lcfg_status lcfg_parser_get(struct lcfg_parser *p, const char *key, void **data, size_t *len)
+static size_t lcfg_parser_add_value(struct lcfg_parser *p, const char *key, struct lcfg_string *value, struct lcfg_token *t)
 {
-	int i;
+	ssize_t interned = -1;
+	size_t i = p->value_length;
+	size_t key_len = strlen(key);
+	size_t value_len = lcfg_string_len(value);
 
-	for( i = 0; i < p->value_length; i++ )
+	if( p->validate )
+	{
+		return p->value_length;
+	}
+
+	if( p->value_length == p->value_capacity )
+	{
+		lcfg_parser_values_resize(p, p->value_capacity * 2);
+	}
+
+	if( p->intern )
+	{
+		interned = lcfg_parser_intern_find(p, lcfg_string_cstr(value), value_len);
+	}
+
+	p->key_lens[i] = key_len;
+	p->value_lens[i] = value_len;
+	p->positions[i].line = t->line;
+	p->positions[i].col = t->col;
+
+	if( interned >= 0 )
 	{
-		if( !strcmp(p->values[i].key, key) )
+		p->keys[i] = lcfg_parser_chunk_alloc(p, key_len + 1);
+		memcpy(p->keys[i], key, key_len + 1);
+		p->values[i] = p->values[interned];
+
+		if( p->mem->stats != NULL )
 		{
-			*data = (void *)lcfg_string_cstr(p->values[i].value);
-			*len = lcfg_string_len(p->values[i].value);
-			return lcfg_status_ok;
+			p->mem->stats->values_interned++;
+			p->mem->stats->bytes_interned += value_len + 1;
 		}
 	}
+	else
+	{
+		p->keys[i] = lcfg_parser_chunk_alloc(p, key_len + 1 + value_len + 1);
+		memcpy(p->keys[i], key, key_len + 1);
+		p->values[i] = p->keys[i] + key_len + 1;
+		memcpy(p->values[i], lcfg_string_cstr(value), value_len + 1);
+		p->value_bytes += value_len + 1;
 
-	return lcfg_status_error;
+		if( p->intern )
+		{
+			lcfg_parser_intern_insert(p, i);
+		}
+	}
+
+	p->key_bytes += key_len + 1;
+
+	/* an included file's values are counted once they are spliced */
+	if( p->mem->stats != NULL && p->include == NULL )
+	{
+		p->mem->stats->values++;
+	}
+
+	return ++p->value_length;
 }
 
+struct lcfg_parser *lcfg_parser_new(struct lcfg *c, const char *filename)
+{
+	struct lcfg_mem *m = lcfg_mem_get(c);
+	struct lcfg_parser *p = lcfg_mem_alloc(m, sizeof(struct lcfg_parser));
 
-void lcfg_parser_delete(struct lcfg_parser *p)
+	memset(p, 0, sizeof(struct lcfg_parser));
+
+	p->mem = m;
+	p->filename = filename == NULL ? NULL : lcfg_mem_strdup(m, filename);
+	p->lcfg = c;
+
+	p->value_length = 0;
+	p->value_capacity = 8;
+	p->keys = lcfg_mem_alloc(m, sizeof(char *) * p->value_capacity);
+	p->key_lens = lcfg_mem_alloc(m, sizeof(size_t) * p->value_capacity);
+	p->values = lcfg_mem_alloc(m, sizeof(char *) * p->value_capacity);
+	p->value_lens = lcfg_mem_alloc(m, sizeof(size_t) * p->value_capacity);
+	p->positions = lcfg_mem_alloc(m, sizeof(struct lcfg_parser_position) * p->value_capacity);
+
+	p->fd = -1;
+	p->buffer_size = LCFG_SCANNER_BUFFER_SIZE;
+
+	return p;
+}
+
+/* drop the values from index first on, their chunk space is only
+ * reclaimed by the next pack */
+static void lcfg_parser_truncate_values(struct lcfg_parser *p, size_t first)
+{
+	while( p->value_length > first )
+	{
+		p->value_length--;
+		p->key_bytes -= p->key_lens[p->value_length] + 1;
+		p->value_bytes -= p->value_lens[p->value_length] + 1;
+	}
+
+	/* the table may point to dropped values, shared ones were not counted */
+	if( p->intern )
+	{
+		lcfg_parser_intern_rebuild(p);
+	}
+}
+
+static void lcfg_parser_hash_build(struct lcfg_parser *p)
 {
-	if( p->scanner != NULL )
+	size_t capacity = 16;
+	size_t i, j;
+	struct lcfg_stats *stats = p->mem->stats;
+	double start = 0.0;
+
+	if( stats != NULL )
+	{
+		start = lcfg_stats_clock();
+	}
+
+	if( p->hash != NULL )
+	{
+		lcfg_mem_free(p->mem, p->hash, sizeof(size_t) * p->hash_capacity);
+	}
+
+	/* at most half full */
+	while( capacity < p->value_length * 2 )
 	{
-		lcfg_scanner_delete(p->scanner);
+		capacity *= 2;
 	}
 
-	int i;
+	p->hash_capacity = capacity;
+	p->hash = lcfg_mem_alloc(p->mem, sizeof(size_t) * capacity);
+	memset(p->hash, 0, sizeof(size_t) * capacity);
 
 	for( i = 0; i < p->value_length; i++ )
 	{
-		free(p->values[i].key);
-		lcfg_string_delete(p->values[i].value);
+		for( j = lcfg_hash_buf(p->keys[i], p->key_lens[i]) & (capacity - 1); p->hash[j] != 0; j = (j + 1) & (capacity - 1) )
+		{
+			/* the first of duplicate keys wins, as with a scan */
+			if( p->key_lens[p->hash[j] - 1] == p->key_lens[i] && !memcmp(p->keys[p->hash[j] - 1], p->keys[i], p->key_lens[i]) )
+			{
+				break;
+			}
+		}
+
+		if( p->hash[j] == 0 )
+		{
+			p->hash[j] = i + 1;
+		}
+	}
+
+	if( stats != NULL )
+	{
+		stats->build_time += lcfg_stats_clock() - start;
+	}
+}
+
+/* value index by key through the hash table, -1 if there is none */
+static ssize_t lcfg_parser_hash_find(struct lcfg_parser *p, const char *key, size_t len)
+{
+	size_t i;
+
+	for( i = lcfg_hash_buf(key, len) & (p->hash_capacity - 1); p->hash[i] != 0; i = (i + 1) & (p->hash_capacity - 1) )
+	{
+		size_t j = p->hash[i] - 1;
+
+		if( p->key_lens[j] == len && !memcmp(p->keys[j], key, len) )
+		{
+			return p->hash[i] - 1;
+		}
+	}
+
+	return -1;
+}
+
+enum lcfg_parser_resolve { resolve_pending = 0, resolve_active, resolve_done };
+
+/* a value whose references are being resolved */
+struct lcfg_parser_resolve_frame
+{
+	size_t i;
+	const char *str;               /* where the scan of the value continues */
+	struct lcfg_string *resolved;
+};
+
+/* references are followed on an explicit stack, so long chains of them
+ * do not recurse */
+struct lcfg_parser_resolve_stack
+{
+	struct lcfg_parser_resolve_frame *frames;
+	size_t size;
+	size_t capacity;
+};
+
+/* start resolving value i on top of the stack, a value without references
+ * is done right away */
+static enum lcfg_status lcfg_parser_resolve_push(struct lcfg_parser *p, struct lcfg_parser_resolve_stack *stack, size_t i, unsigned char *state)
+{
+	struct lcfg_parser_resolve_frame *f;
+
+	if( state[i] == resolve_done )
+	{
+		return lcfg_status_ok;
+	}
+	else if( state[i] == resolve_active )
+	{
+		lcfg_error_set(p->lcfg, "reference cycle through `%s' near line %" PRIu64 " column %" PRIu64, p->keys[i], p->positions[i].line, p->positions[i].col);
+		return lcfg_status_error;
+	}
+
+	if( memchr(p->values[i], '$', p->value_lens[i]) == NULL )
+	{
+		state[i] = resolve_done;
+		return lcfg_status_ok;
+	}
+
+	if( stack->size == stack->capacity )
+	{
+		size_t capacity = stack->capacity > 0 ? stack->capacity * 2 : 8;
+
+		if( stack->frames == NULL )
+		{
+			stack->frames = lcfg_mem_alloc(p->mem, sizeof(struct lcfg_parser_resolve_frame) * capacity);
+		}
+		else
+		{
+			stack->frames = lcfg_mem_realloc(p->mem, stack->frames, sizeof(struct lcfg_parser_resolve_frame) * stack->capacity, sizeof(struct lcfg_parser_resolve_frame) * capacity);
+		}
+		stack->capacity = capacity;
+	}
+
+	f = &stack->frames[stack->size++];
+	f->i = i;
+	f->str = p->values[i];
+	f->resolved = lcfg_string_new(p->mem);
+	state[i] = resolve_active;
+
+	return lcfg_status_ok;
+}
+
+/* replace the ${key} references in value i by the referenced values,
+ * resolving those first. every value is resolved once, state tracks the
+ * progress to detect cycles. */
+static enum lcfg_status lcfg_parser_resolve(struct lcfg_parser *p, size_t i, unsigned char *state, struct lcfg_parser_resolve_stack *stack)
+{
+	struct lcfg_parser_resolve_frame *f;
+	struct lcfg_parser_position *pos;
+	const char *end, *ref, *close;
+	enum lcfg_status status;
+	ssize_t j, next;
+
+	status = lcfg_parser_resolve_push(p, stack, i, state);
+
+	while( status == lcfg_status_ok && stack->size > 0 )
+	{
+		f = &stack->frames[stack->size - 1];
+		pos = &p->positions[f->i];
+		end = p->values[f->i] + p->value_lens[f->i];
+		next = -1;
+
+		while( (ref = memchr(f->str, '$', end - f->str)) != NULL )
+		{
+			lcfg_string_cat_buf(f->resolved, f->str, ref - f->str);
+			f->str = ref;
+
+			/* $${ is a literal ${ */
+			if( end - ref >= 3 && ref[1] == '$' && ref[2] == '{' )
+			{
+				lcfg_string_cat_buf(f->resolved, "${", 2);
+				f->str = ref + 3;
+				continue;
+			}
+
+			if( end - ref < 2 || ref[1] != '{' || (close = memchr(ref + 2, '}', end - ref - 2)) == NULL )
+			{
+				lcfg_string_cat_char(f->resolved, '$');
+				f->str = ref + 1;
+				continue;
+			}
+
+			j = lcfg_parser_hash_find(p, ref + 2, close - ref - 2);
+
+			if( j < 0 && p->interpolation == lcfg_interpolation_keep )
+			{
+				lcfg_string_cat_buf(f->resolved, ref, close + 1 - ref);
+			}
+			else if( j < 0 )
+			{
+				lcfg_error_set(p->lcfg, "unresolved reference `%.*s' near line %" PRIu64 " column %" PRIu64, (int)(close + 1 - ref), ref, pos->line, pos->col);
+				status = lcfg_status_error;
+				break;
+			}
+			else if( state[j] != resolve_done )
+			{
+				/* the reference is scanned again once j is resolved */
+				next = j;
+				break;
+			}
+			else
+			{
+				lcfg_string_cat_buf(f->resolved, p->values[j], p->value_lens[j]);
+			}
+
+			f->str = close + 1;
+		}
+
+		if( status != lcfg_status_ok )
+		{
+			break;
+		}
+		else if( next >= 0 )
+		{
+			status = lcfg_parser_resolve_push(p, stack, next, state);
+			continue;
+		}
+
+		lcfg_string_cat_buf(f->resolved, f->str, end - f->str);
+
+		/* the old value stays in its chunk until the pack */
+		p->value_bytes += lcfg_string_len(f->resolved) - p->value_lens[f->i];
+		p->value_lens[f->i] = lcfg_string_len(f->resolved);
+		p->values[f->i] = lcfg_parser_chunk_alloc(p, p->value_lens[f->i] + 1);
+		memcpy(p->values[f->i], lcfg_string_cstr(f->resolved), p->value_lens[f->i] + 1);
+		lcfg_string_delete(f->resolved);
+		state[f->i] = resolve_done;
+		stack->size--;
+	}
+
+	for( ; stack->size > 0; stack->size-- )
+	{
+		lcfg_string_delete(stack->frames[stack->size - 1].resolved);
+	}
+
+	return status;
+}
+
+/* with interpolation, values are checked against the schema once their
+ * references are resolved. validation does not resolve, it skips values
+ * with references. */
+static int lcfg_parser_check_deferred(struct lcfg_parser *p, const char *value, size_t len)
+{
+	if( p->interpolation == lcfg_interpolation_off )
+	{
+		return 0;
+	}
+
+	return !p->validate || memmem(value, len, "${", 2) != NULL;
+}
+
+/* the deferred schema checks of all values, with their positions */
+static enum lcfg_status lcfg_parser_check_resolved(struct lcfg_parser *p)
+{
+	const struct lcfg_schema_node *n;
+	struct lcfg_token t;
+	const char *key, *end;
+	size_t i, len;
+
+	memset(&t, 0, sizeof(struct lcfg_token));
+
+	for( i = 0; i < p->value_length; i++ )
+	{
+		n = lcfg_schema_root(p->schema);
+		key = p->keys[i];
+
+		do
+		{
+			end = strchr(key, '.');
+			len = end == NULL ? strlen(key) : (size_t)(end - key);
+			n = lcfg_schema_child(n, key, len);
+			if( end != NULL )
+			{
+				key = end + 1;
+			}
+		}
+		while( n != NULL && end != NULL );
+
+		t.line = p->positions[i].line;
+		t.col = p->positions[i].col;
+		if( n != NULL && lcfg_schema_check_value(p->lcfg, n, p->keys[i], p->values[i], p->value_lens[i], &t) != lcfg_status_ok )
+		{
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+/* a parse ran through: index the values, resolve references and run the
+ * schema checks that waited for them */
+static enum lcfg_status lcfg_parser_complete(struct lcfg_parser *p)
+{
+	enum lcfg_status status = lcfg_status_ok;
+	struct lcfg_parser_resolve_stack stack = { NULL, 0, 0 };
+	unsigned char *state;
+	size_t i;
+
+	lcfg_parser_hash_build(p);
+
+	if( p->interpolation != lcfg_interpolation_off && p->value_length != 0 )
+	{
+		state = lcfg_mem_alloc(p->mem, p->value_length);
+		memset(state, resolve_pending, p->value_length);
+
+		for( i = 0; i < p->value_length && status == lcfg_status_ok; i++ )
+		{
+			status = lcfg_parser_resolve(p, i, state, &stack);
+		}
+
+		if( stack.frames != NULL )
+		{
+			lcfg_mem_free(p->mem, stack.frames, sizeof(struct lcfg_parser_resolve_frame) * stack.capacity);
+		}
+		lcfg_mem_free(p->mem, state, p->value_length);
+
+		if( status == lcfg_status_ok && p->schema != NULL )
+		{
+			status = lcfg_parser_check_resolved(p);
+		}
+	}
+
+	lcfg_parser_pack(p);
+
+	return status;
+}
+
+enum lcfg_parser_filter_match { filter_skip, filter_partial, filter_include };
+
+/* does key lie at or below prefix? an empty prefix matches everything */
+static int lcfg_parser_key_match(const char *key, const char *prefix, size_t len)
+{
+	return len == 0 || (!strncmp(key, prefix, len) && (key[len] == '\0' || key[len] == '.'));
+}
+
+/* relate the key current_path.name to the filter prefixes: at or below
+ * a prefix (include), above one (partial) or unrelated (skip) */
+static enum lcfg_parser_filter_match lcfg_parser_filter(struct lcfg_parser *p, struct lcfg_string *current_path, const char *name)
+{
+	const char *path = lcfg_string_cstr(current_path);
+	size_t path_len = lcfg_string_len(current_path);
+	size_t name_len = strlen(name);
+	enum lcfg_parser_filter_match match = filter_skip;
+	const char **prefix;
+
+	for( prefix = p->filter; *prefix != NULL; prefix++ )
+	{
+		const char *q = *prefix;
+
+		if( path_len != 0 )
+		{
+			if( strncmp(q, path, path_len) != 0 || q[path_len] != '.' )
+			{
+				continue;
+			}
+			q += path_len + 1;
+		}
+
+		if( strncmp(q, name, name_len) != 0 )
+		{
+			continue;
+		}
+
+		if( q[name_len] == '\0' )
+		{
+			return filter_include;
+		}
+		else if( q[name_len] == '.' )
+		{
+			match = filter_partial;
+		}
+	}
+
+	return match;
+}
+
+/* fetch the next token, accounting scan time and token types */
+static enum lcfg_status lcfg_parser_next_token(struct lcfg_parser *p, struct lcfg_scanner *s, struct lcfg_token *t)
+{
+	struct lcfg_stats *stats = p->mem->stats;
+	enum lcfg_status status;
+	double start;
+
+	if( stats == NULL )
+	{
+		return lcfg_scanner_next_token(s, t);
+	}
+
+	start = lcfg_stats_clock();
+	status = lcfg_scanner_next_token(s, t);
+	stats->scan_time += lcfg_stats_clock() - start;
+
+	if( status == lcfg_status_ok && t->type != lcfg_null_token )
+	{
+		stats->tokens[t->type]++;
+	}
+
+	return status;
+}
+
+static void lcfg_parser_fragment_free(struct lcfg_parser_fragment *f)
+{
+	struct lcfg_mem m = f->mem;
+
+	lcfg_mem_free(&m, f, f->block_size);
+}
+
+void lcfg_include_cache_flush(void)
+{
+	struct lcfg_parser_fragment *f;
+
+	pthread_mutex_lock(&lcfg_parser_fragments_lock);
+
+	while( (f = lcfg_parser_fragments) != NULL )
+	{
+		lcfg_parser_fragments = f->next;
+		lcfg_parser_fragment_free(f);
+	}
+
+	pthread_mutex_unlock(&lcfg_parser_fragments_lock);
+}
+
+static void lcfg_parser_file_set(struct lcfg_parser_file *d, char *path, const struct stat *st)
+{
+	d->path = path;
+	d->dev = st->st_dev;
+	d->ino = st->st_ino;
+	d->mtime = st->st_mtim;
+	d->size = st->st_size;
+}
+
+static int lcfg_parser_file_unchanged(const struct lcfg_parser_file *d, const struct stat *st)
+{
+	return d->dev == st->st_dev && d->ino == st->st_ino && d->size == st->st_size &&
+		d->mtime.tv_sec == st->st_mtim.tv_sec && d->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* f is the cached version of the file st, and neither it nor anything it
+ * includes has changed since */
+static int lcfg_parser_fragment_fresh(const struct lcfg_parser_fragment *f, const struct stat *st)
+{
+	struct stat dst;
+	size_t i;
+
+	if( !lcfg_parser_file_unchanged(&f->files[0], st) )
+	{
+		return 0;
+	}
+
+	for( i = 1; i < f->file_count; i++ )
+	{
+		if( stat(f->files[i].path, &dst) != 0 || !lcfg_parser_file_unchanged(&f->files[i], &dst) )
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* remember that p depends on files, if p parses an included file */
+static void lcfg_parser_depend(struct lcfg_parser *p, const struct lcfg_parser_file *files, size_t count)
+{
+	size_t capacity = p->file_capacity;
+	size_t i;
+
+	if( p->include == NULL )
+	{
+		return;
+	}
+
+	while( p->file_count + count > capacity )
+	{
+		capacity = capacity == 0 ? 4 : capacity * 2;
+	}
+	if( capacity != p->file_capacity )
+	{
+		p->files = lcfg_mem_realloc(p->mem, p->files, sizeof(struct lcfg_parser_file) * p->file_capacity, sizeof(struct lcfg_parser_file) * capacity);
+		p->file_capacity = capacity;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		p->files[p->file_count] = files[i];
+		p->files[p->file_count++].path = lcfg_mem_strdup(p->mem, files[i].path);
+	}
+}
+
+/* copy the values of a parsed file into the cache, replacing an outdated
+ * version. must be called with the cache lock held. NULL if there is not
+ * enough memory, the file is then just not cached. */
+static struct lcfg_parser_fragment *lcfg_parser_fragment_add(struct lcfg_parser *p, struct lcfg_parser *fp, const struct lcfg_parser_file *self)
+{
+	struct lcfg_parser_fragment **prev, *f;
+	size_t size, i;
+	char *data;
+
+	for( prev = &lcfg_parser_fragments; *prev != NULL; prev = &(*prev)->next )
+	{
+		if( (*prev)->files[0].dev == self->dev && (*prev)->files[0].ino == self->ino )
+		{
+			f = *prev;
+			*prev = f->next;
+			lcfg_parser_fragment_free(f);
+			break;
+		}
+	}
+
+	/* everything in one block, the strings last */
+	size = sizeof(struct lcfg_parser_fragment) + sizeof(struct lcfg_parser_file) * (fp->file_count + 1);
+	size += (sizeof(char *) * 2 + sizeof(size_t)) * fp->value_length;
+	size += strlen(self->path) + 1;
+	for( i = 0; i < fp->file_count; i++ )
+	{
+		size += strlen(fp->files[i].path) + 1;
+	}
+	for( i = 0; i < fp->value_length; i++ )
+	{
+		size += fp->key_lens[i] + fp->value_lens[i] + 2;
+	}
+
+	if( (f = lcfg_mem_try_alloc(p->mem, size)) == NULL )
+	{
+		return NULL;
+	}
+
+	lcfg_mem_init(&f->mem, &p->mem->allocator);
+	f->block_size = size;
+	f->file_count = fp->file_count + 1;
+	f->files = (struct lcfg_parser_file *)(f + 1);
+	f->count = fp->value_length;
+	f->keys = (char **)(f->files + f->file_count);
+	f->values = f->keys + f->count;
+	f->value_lens = (size_t *)(f->values + f->count);
+	data = (char *)(f->value_lens + f->count);
+
+	for( i = 0; i < f->file_count; i++ )
+	{
+		f->files[i] = i == 0 ? *self : fp->files[i - 1];
+		f->files[i].path = strcpy(data, f->files[i].path);
+		data += strlen(data) + 1;
+	}
+
+	for( i = 0; i < f->count; i++ )
+	{
+		f->keys[i] = memcpy(data, fp->keys[i], fp->key_lens[i] + 1);
+		data += fp->key_lens[i] + 1;
+		f->value_lens[i] = fp->value_lens[i];
+		f->values[i] = memcpy(data, fp->values[i], fp->value_lens[i] + 1);
+		data += fp->value_lens[i] + 1;
+	}
+
+	f->next = lcfg_parser_fragments;
+	lcfg_parser_fragments = f;
+
+	return f;
+}
+
+/* add the values of f below path, as far as the filter lets them */
+static void lcfg_parser_fragment_splice(struct lcfg_parser *p, struct lcfg_parser_fragment *f, struct lcfg_string *path, enum lcfg_parser_filter_match filter, struct lcfg_token *t)
+{
+	struct lcfg_string *key = lcfg_string_new(p->mem);
+	struct lcfg_string *value = lcfg_string_new(p->mem);
+	size_t path_len = lcfg_string_len(path);
+	const char **prefix;
+	size_t i;
+
+	lcfg_string_cat_buf(key, lcfg_string_cstr(path), path_len);
+	if( path_len != 0 )
+	{
+		lcfg_string_cat_char(key, '.');
+		path_len++;
+	}
+
+	for( i = 0; i < f->count; i++ )
+	{
+		lcfg_string_trunc(key, path_len);
+		lcfg_string_cat_cstr(key, f->keys[i]);
+
+		if( filter != filter_include )
+		{
+			for( prefix = p->filter; *prefix != NULL; prefix++ )
+			{
+				if( lcfg_parser_key_match(lcfg_string_cstr(key), *prefix, strlen(*prefix)) )
+				{
+					break;
+				}
+			}
+
+			if( *prefix == NULL )
+			{
+				continue;
+			}
+		}
+
+		lcfg_string_trunc(value, 0);
+		lcfg_string_cat_buf(value, f->values[i], f->value_lens[i]);
+		lcfg_parser_add_value(p, lcfg_string_cstr(key), value, t);
+	}
+
+	lcfg_string_delete(value);
+	lcfg_string_delete(key);
+}
+
+/* handle `include "name"' found at token t with current_path as prefix */
+static enum lcfg_status lcfg_parser_include(struct lcfg_parser *p, struct lcfg_string *current_path, enum lcfg_parser_filter_match filter, struct lcfg_token *t)
+{
+	const char *name = lcfg_string_cstr(t->string);
+	const struct lcfg_parser_include *chain = p->include, *l;
+	struct lcfg_parser_include root, link;
+	struct lcfg_parser_fragment *f, uncached;
+	struct lcfg_parser_file self;
+	struct lcfg_parser *fp;
+	struct stat st;
+	char error[0xff];
+	char *path;
+	size_t path_len, dir_len = 0;
+
+	/* relative to the directory of the including file */
+	if( name[0] != '/' && p->filename != NULL && strrchr(p->filename, '/') != NULL )
+	{
+		dir_len = strrchr(p->filename, '/') - p->filename + 1;
+	}
+
+	path_len = dir_len + strlen(name) + 1;
+	path = lcfg_mem_alloc(p->mem, path_len);
+	if( dir_len != 0 )
+	{
+		memcpy(path, p->filename, dir_len);
+	}
+	strcpy(path + dir_len, name);
+
+	if( stat(path, &st) != 0 )
+	{
+		lcfg_error_set(p->lcfg, "include \"%s\" near line %" PRIu64 " column %" PRIu64 ": %s", path, t->line, t->col, strerror(errno));
+		lcfg_mem_free(p->mem, path, path_len);
+		return lcfg_status_error;
+	}
+
+	if( chain == NULL && p->filename != NULL )
+	{
+		struct stat root_st;
+
+		if( stat(p->filename, &root_st) == 0 )
+		{
+			root.dev = root_st.st_dev;
+			root.ino = root_st.st_ino;
+			root.parent = NULL;
+			chain = &root;
+		}
+	}
+
+	for( l = chain; l != NULL; l = l->parent )
+	{
+		if( l->dev == st.st_dev && l->ino == st.st_ino )
+		{
+			lcfg_error_set(p->lcfg, "include \"%s\" near line %" PRIu64 " column %" PRIu64 ": include cycle", path, t->line, t->col);
+			lcfg_mem_free(p->mem, path, path_len);
+			return lcfg_status_error;
+		}
+	}
+
+	pthread_mutex_lock(&lcfg_parser_fragments_lock);
+
+	for( f = lcfg_parser_fragments; f != NULL; f = f->next )
+	{
+		if( lcfg_parser_fragment_fresh(f, &st) )
+		{
+			lcfg_parser_depend(p, f->files, f->file_count);
+			lcfg_parser_fragment_splice(p, f, current_path, filter, t);
+			pthread_mutex_unlock(&lcfg_parser_fragments_lock);
+			lcfg_mem_free(p->mem, path, path_len);
+			return lcfg_status_ok;
+		}
+	}
+
+	/* not cached: parse without the lock, nested includes take it again */
+	pthread_mutex_unlock(&lcfg_parser_fragments_lock);
+
+	link.dev = st.st_dev;
+	link.ino = st.st_ino;
+	link.parent = chain;
+
+	fp = lcfg_parser_new(p->lcfg, path);
+	fp->include = &link;
+	fp->buffer_size = p->buffer_size;
+
+	if( lcfg_parser_run(fp) != lcfg_status_ok )
+	{
+		snprintf(error, sizeof(error), "%s", lcfg_error_get(p->lcfg));
+		lcfg_error_set(p->lcfg, "include \"%s\" near line %" PRIu64 " column %" PRIu64 ": %s", path, t->line, t->col, error);
+		lcfg_parser_delete(fp);
+		lcfg_mem_free(p->mem, path, path_len);
+		return lcfg_status_error;
+	}
+
+	lcfg_parser_file_set(&self, path, &st);
+	lcfg_parser_depend(p, &self, 1);
+	lcfg_parser_depend(p, fp->files, fp->file_count);
+
+	pthread_mutex_lock(&lcfg_parser_fragments_lock);
+	if( (f = lcfg_parser_fragment_add(p, fp, &self)) == NULL )
+	{
+		/* splice straight from the parser */
+		f = &uncached;
+		f->count = fp->value_length;
+		f->keys = fp->keys;
+		f->values = fp->values;
+		f->value_lens = fp->value_lens;
+	}
+	lcfg_parser_fragment_splice(p, f, current_path, filter, t);
+	pthread_mutex_unlock(&lcfg_parser_fragments_lock);
+
+	lcfg_parser_delete(fp);
+	lcfg_mem_free(p->mem, path, path_len);
+
+	return lcfg_status_ok;
+}
+
+enum state { top_level = 0, exp_equals, exp_include, exp_value, in_list, in_map, invalid };
+/*const char *state_map[] = { "top_level", "exp_equals", "exp_include", "exp_value", "in_list", "in_map", "invalid" };*/
+
+struct state_element
+{
+	enum state s;
+	size_t list_counter;
+	enum lcfg_parser_filter_match filter;
+	const struct lcfg_schema_node *schema;  /* rule node, NULL if unchecked */
+	size_t stamp;                           /* identifies a map in the seen array */
+};
+
+/* everything the automaton needs to continue where it stopped, so push
+ * mode can run it on every chunk of input */
+struct lcfg_parser_context
+{
+	struct lcfg_scanner *scanner;
+	struct state_element *state_stack;
+	size_t state_stack_size;
+	size_t ssi; /* ssi = state stack index */
+	struct lcfg_string *current_path;
+	struct lcfg_token token;
+
+	/* seen[node->index] is the stamp of the last map a rule node was found
+	 * in, so required keys are checked without clearing anything */
+	size_t *seen;
+	size_t seen_size;
+	size_t stamp;
+
+	/* validate-only mode after an error: skip tokens up to an identifier
+	 * outside of resync_depth containers, a likely next statement */
+	int resync;
+	size_t resync_depth;
+};
+
+static void lcfg_parser_context_init(struct lcfg_parser *p, struct lcfg_parser_context *ctx, struct lcfg_scanner *scanner)
+{
+	ctx->scanner = scanner;
+	ctx->state_stack_size = 8;
+	ctx->ssi = 0;
+	ctx->state_stack = lcfg_mem_alloc(p->mem, sizeof(struct state_element) * ctx->state_stack_size);
+
+	ctx->state_stack[0].s = top_level;
+	ctx->state_stack[0].list_counter = 0;
+	ctx->state_stack[0].filter = p->filter == NULL ? filter_include : filter_partial;
+	ctx->state_stack[0].schema = NULL;
+	ctx->state_stack[0].stamp = 1;
+
+	ctx->stamp = 1;
+	ctx->seen = NULL;
+	ctx->seen_size = 0;
+
+	ctx->resync = 0;
+	ctx->resync_depth = 0;
+
+	/* statements of a lazy parse are parsed one by one, out of context */
+	if( p->schema != NULL && !p->lazy )
+	{
+		ctx->state_stack[0].schema = lcfg_schema_root(p->schema);
+		ctx->seen_size = lcfg_schema_node_count(p->schema);
+		ctx->seen = lcfg_mem_alloc(p->mem, sizeof(size_t) * ctx->seen_size);
+		memset(ctx->seen, 0, sizeof(size_t) * ctx->seen_size);
+	}
+
+	ctx->current_path = lcfg_string_new(p->mem);
+
+	/* the scanner fills this buffer in place for every token */
+	ctx->token.string = lcfg_string_new(p->mem);
+	ctx->token.type = lcfg_null_token;
+}
+
+/* check the values an include added from index first on against the rules
+ * for their keys, relative to node at prefix_len */
+static enum lcfg_status lcfg_parser_schema_splice(struct lcfg_parser *p, struct lcfg_parser_context *ctx, const struct lcfg_schema_node *node, size_t stamp, size_t prefix_len, size_t first, struct lcfg_token *t)
+{
+	const struct lcfg_schema_node *n;
+	const char *key, *end;
+	size_t i, len, depth;
+
+	if( prefix_len != 0 )
+	{
+		prefix_len++;
+	}
+
+	for( i = first; i < p->value_length; i++ )
+	{
+		key = p->keys[i] + prefix_len;
+		n = node;
+		depth = 0;
+
+		do
+		{
+			end = strchr(key, '.');
+			len = end == NULL ? strlen(key) : (size_t)(end - key);
+
+			if( (n = lcfg_schema_child(n, key, len)) != NULL && depth++ == 0 )
+			{
+				ctx->seen[n->index] = stamp;
+			}
+
+			if( end != NULL )
+			{
+				key = end + 1;
+			}
+		}
+		while( n != NULL && end != NULL );
+
+		if( n != NULL && !lcfg_parser_check_deferred(p, p->values[i], p->value_lens[i]) &&
+			lcfg_schema_check_value(p->lcfg, n, p->keys[i], p->values[i], p->value_lens[i], t) != lcfg_status_ok )
+		{
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+static void lcfg_parser_report(struct lcfg_parser *p)
+{
+	p->error_count++;
+
+	if( p->error_fn != NULL )
+	{
+		p->error_fn(lcfg_error_get(p->lcfg), p->error_data);
+	}
+}
+
+static void lcfg_parser_context_free(struct lcfg_parser *p, struct lcfg_parser_context *ctx)
+{
+	lcfg_mem_free(p->mem, ctx->state_stack, sizeof(struct state_element) * ctx->state_stack_size);
+	if( ctx->seen != NULL )
+	{
+		lcfg_mem_free(p->mem, ctx->seen, sizeof(size_t) * ctx->seen_size);
+	}
+	lcfg_string_delete(ctx->token.string);
+	lcfg_string_delete(ctx->current_path);
+}
+
+/* this is a basic push down automata. it runs until the scanner has no
+ * more tokens, which in push mode only means the current chunk is used up. */
+static enum lcfg_status lcfg_parser_step(struct lcfg_parser *p, struct lcfg_parser_context *ctx)
+{
+	/* start of ugly preproc stuff */
+#define STATE_STACK_PUSH(t, f, n) \
+	if( ssi + 1 == state_stack_size ) \
+	{ \
+		state_stack = lcfg_mem_realloc(p->mem, state_stack, state_stack_size * sizeof(struct state_element), state_stack_size * 2 * sizeof(struct state_element)); \
+		state_stack_size *= 2; \
+	} \
+	state_stack[++ssi].s = t; \
+	state_stack[ssi].list_counter = 0; \
+	state_stack[ssi].filter = f; \
+	state_stack[ssi].schema = n
+#define STATE_STACK_POP() ssi--
+#define SCHEMA_CHILD(name, len) \
+	node = NULL; \
+	if( state_stack[ssi].schema != NULL && (node = lcfg_schema_child(state_stack[ssi].schema, name, len)) != NULL ) \
+	{ \
+		ctx->seen[node->index] = state_stack[ssi].stamp; \
+	}
+#define SCHEMA_CHECK(n, check) \
+	if( (n) != NULL && (check) != lcfg_status_ok ) \
+	{ \
+		state_stack[ssi].s = invalid; \
+		break; \
+	}
+#define SCHEMA_VALUE(n) \
+	(lcfg_parser_check_deferred(p, lcfg_string_cstr(t->string), lcfg_string_len(t->string)) ? NULL : (n))
+#define STATS_CONTAINER_OPEN() \
+	if( stats != NULL && ssi > stats->max_depth ) \
+	{ \
+		stats->max_depth = ssi; \
+	}
+#define PATH_PUSH_STR(s) \
+	if( lcfg_string_len(current_path) != 0 ) \
+	{ \
+		lcfg_string_cat_char(current_path, '.'); \
+	} \
+	lcfg_string_cat_cstr(current_path, s);
+#define PATH_PUSH_INT(i) \
+	if( lcfg_string_len(current_path) != 0 ) \
+	{ \
+		lcfg_string_cat_char(current_path, '.'); \
+	} \
+	lcfg_string_cat_uint(current_path, i);
+#define PATH_POP() \
+	if( lcfg_string_rfind(current_path, '.') != -1 ) \
+	{ \
+		lcfg_string_trunc(current_path, lcfg_string_rfind(current_path, '.')); \
+	} \
+	else \
+	{ \
+		lcfg_string_trunc(current_path, 0); \
+	}
+	/* end of ugly preproc stuff */
+
+	struct lcfg_stats *stats = p->mem->stats;
+	double parse_start = 0.0;
+	double scan_time = 0.0;
+
+	if( stats != NULL )
+	{
+		parse_start = lcfg_stats_clock();
+		scan_time = stats->scan_time;
+	}
+
+	struct lcfg_scanner *scanner = ctx->scanner;
+	size_t state_stack_size = ctx->state_stack_size;
+	size_t ssi = ctx->ssi;
+	struct state_element *state_stack = ctx->state_stack;
+	struct lcfg_string *current_path = ctx->current_path;
+	enum lcfg_status status = lcfg_status_ok;
+
+	enum lcfg_parser_filter_match filter;
+	const struct lcfg_schema_node *node;
+	enum state prev;
+	size_t first, i;
+	char index[24];
+
+	struct lcfg_token *t = &ctx->token;
+
+	while( state_stack[ssi].s != invalid )
+	{
+		if( lcfg_parser_next_token(p, scanner, t) != lcfg_status_ok )
+		{
+			if( p->validate && lcfg_scanner_recover(scanner) == lcfg_status_ok )
+			{
+				lcfg_parser_report(p);
+				continue;
+			}
+
+			status = lcfg_status_error;
+			break;
+		}
+
+		if( t->type == lcfg_null_token )
+		{
+			break;
+		}
+
+		if( ctx->resync )
+		{
+			if( t->type == lcfg_sbracket_open || t->type == lcfg_brace_open )
+			{
+				ctx->resync_depth++;
+			}
+			else if( (t->type == lcfg_sbracket_close || t->type == lcfg_brace_close) && ctx->resync_depth > 0 )
+			{
+				ctx->resync_depth--;
+			}
+
+			if( t->type != lcfg_identifier || ctx->resync_depth != 0 )
+			{
+				continue;
+			}
+
+			ctx->resync = 0;
+		}
+
+		prev = state_stack[ssi].s;
+
+		switch( state_stack[ssi].s )
+		{
+			case top_level:
+			case in_map:
+				if( t->type == lcfg_identifier && !strcmp(lcfg_string_cstr(t->string), "include") )
+				{
+					/* either a directive or a key named include, the next token tells */
+					filter = state_stack[ssi].filter;
+					STATE_STACK_PUSH(exp_include, filter, NULL);
+				}
+				else if( t->type == lcfg_identifier )
+				{
+					filter = state_stack[ssi].filter;
+					if( filter != filter_include )
+					{
+						filter = lcfg_parser_filter(p, current_path, lcfg_string_cstr(t->string));
+					}
+
+					/* a skipped statement does not touch the path */
+					if( filter != filter_skip )
+					{
+						PATH_PUSH_STR(lcfg_string_cstr(t->string));
+					}
+					SCHEMA_CHILD(lcfg_string_cstr(t->string), lcfg_string_len(t->string));
+					STATE_STACK_PUSH(exp_equals, filter, node);
+				}
+				else if( state_stack[ssi].s == in_map && t->type == lcfg_brace_close )
+				{
+					if( state_stack[ssi].filter == filter_include )
+					{
+						SCHEMA_CHECK(state_stack[ssi].schema, lcfg_schema_check_required(p->lcfg, state_stack[ssi].schema, lcfg_string_cstr(current_path), ctx->seen, state_stack[ssi].stamp, t));
+					}
+					STATE_STACK_POP();
+					PATH_POP();
+				}
+				else
+				{
+					lcfg_error_set(p->lcfg, "invalid token (%s) near line %" PRIu64 " column %" PRIu64 ": expected identifier%s", lcfg_token_map[t->type], t->line, t->col, state_stack[ssi].s == in_map ? " or `}'" : "");
+					state_stack[ssi].s = invalid;
+				}
+				break;
+			case exp_equals:
+				if( t->type == lcfg_equals && state_stack[ssi].filter == filter_skip )
+				{
+					if( lcfg_scanner_skip(scanner, 0) == lcfg_status_ok )
+					{
+						STATE_STACK_POP();
+					}
+					else
+					{
+						state_stack[ssi].s = invalid;
+					}
+				}
+				else if( t->type == lcfg_equals )
+					state_stack[ssi].s = exp_value;
+				else
+				{
+					lcfg_error_set(p->lcfg, "invalid token (%s) near line %" PRIu64 " column %" PRIu64 ": expected `='", lcfg_token_map[t->type], t->line, t->col);
+					state_stack[ssi].s = invalid;
+				}
+				break;
+			case exp_include:
+				filter = state_stack[ssi].filter;
+				if( t->type == lcfg_string )
+				{
+					first = p->value_length;
+					if( filter != filter_skip && lcfg_parser_include(p, current_path, filter, t) != lcfg_status_ok )
+					{
+						state_stack[ssi].s = invalid;
+					}
+					else
+					{
+						STATE_STACK_POP();
+						SCHEMA_CHECK(state_stack[ssi].schema, lcfg_parser_schema_splice(p, ctx, state_stack[ssi].schema, state_stack[ssi].stamp, lcfg_string_len(current_path), first, t));
+					}
+				}
+				else if( t->type == lcfg_equals )
+				{
+					if( filter != filter_include )
+					{
+						filter = lcfg_parser_filter(p, current_path, "include");
+					}
+
+					if( filter == filter_skip )
+					{
+						if( lcfg_scanner_skip(scanner, 0) == lcfg_status_ok )
+						{
+							STATE_STACK_POP();
+						}
+						else
+						{
+							state_stack[ssi].s = invalid;
+						}
+					}
+					else
+					{
+						PATH_PUSH_STR("include");
+						STATE_STACK_POP();
+						SCHEMA_CHILD("include", 7);
+						STATE_STACK_PUSH(exp_value, filter, node);
+					}
+				}
+				else
+				{
+					lcfg_error_set(p->lcfg, "invalid token (%s) near line %" PRIu64 " column %" PRIu64 ": expected string or `='", lcfg_token_map[t->type], t->line, t->col);
+					state_stack[ssi].s = invalid;
+				}
+				break;
+			case exp_value:
+				if( t->type == lcfg_string )
+				{
+					/* a partial match that ends in a string lies above every prefix */
+					if( state_stack[ssi].filter == filter_include )
+					{
+						SCHEMA_CHECK(SCHEMA_VALUE(state_stack[ssi].schema), lcfg_schema_check_value(p->lcfg, state_stack[ssi].schema, lcfg_string_cstr(current_path), lcfg_string_cstr(t->string), lcfg_string_len(t->string), t));
+						lcfg_parser_add_value(p, lcfg_string_cstr(current_path), t->string, t);
+					}
+					/*printf("adding string value for single statement\n");*/
+					STATE_STACK_POP();
+					PATH_POP();
+				}
+				else if( t->type == lcfg_sbracket_open )
+				{
+					SCHEMA_CHECK(state_stack[ssi].schema, lcfg_schema_check_container(p->lcfg, state_stack[ssi].schema, lcfg_string_cstr(current_path), lcfg_schema_list, t));
+					state_stack[ssi].s = in_list;
+					STATS_CONTAINER_OPEN();
+				}
+				else if( t->type == lcfg_brace_open )
+				{
+					SCHEMA_CHECK(state_stack[ssi].schema, lcfg_schema_check_container(p->lcfg, state_stack[ssi].schema, lcfg_string_cstr(current_path), lcfg_schema_map, t));
+					state_stack[ssi].s = in_map;
+					state_stack[ssi].stamp = ++ctx->stamp;
+					STATS_CONTAINER_OPEN();
+				}
+				else
+				{
+					lcfg_error_set(p->lcfg, "invalid token (%s) near line %" PRIu64 " column %" PRIu64 ": expected string, `[' or `{'", lcfg_token_map[t->type], t->line, t->col);
+					state_stack[ssi].s = invalid;
+				}
+				break;
+			case in_list:
+				filter = state_stack[ssi].filter;
+				node = NULL;
+				if( (filter != filter_include || state_stack[ssi].schema != NULL) && t->type != lcfg_comma && t->type != lcfg_sbracket_close )
+				{
+					snprintf(index, sizeof(index), "%zu", state_stack[ssi].list_counter);
+					if( filter != filter_include )
+					{
+						filter = lcfg_parser_filter(p, current_path, index);
+					}
+					if( state_stack[ssi].schema != NULL )
+					{
+						node = lcfg_schema_child(state_stack[ssi].schema, index, strlen(index));
+					}
+				}
+
+				if( t->type == lcfg_comma ); /* ignore comma */
+				else if( filter != filter_include && t->type == lcfg_string )
+				{
+					state_stack[ssi].list_counter++;
+				}
+				else if( filter == filter_skip && (t->type == lcfg_sbracket_open || t->type == lcfg_brace_open) )
+				{
+					if( lcfg_scanner_skip(scanner, t->type == lcfg_sbracket_open ? '[' : '{') == lcfg_status_ok )
+					{
+						state_stack[ssi].list_counter++;
+					}
+					else
+					{
+						state_stack[ssi].s = invalid;
+					}
+				}
+				else if( t->type == lcfg_string )
+				{
+					PATH_PUSH_INT(state_stack[ssi].list_counter);
+					SCHEMA_CHECK(SCHEMA_VALUE(node), lcfg_schema_check_value(p->lcfg, node, lcfg_string_cstr(current_path), lcfg_string_cstr(t->string), lcfg_string_len(t->string), t));
+					lcfg_parser_add_value(p, lcfg_string_cstr(current_path), t->string, t);
+					PATH_POP();
+					/*printf("adding string to list pos %d\n", state_stack[ssi].list_counter);*/
+					state_stack[ssi].list_counter++;
+				}
+				else if( t->type == lcfg_sbracket_open )
+				{
+					PATH_PUSH_INT(state_stack[ssi].list_counter);
+					SCHEMA_CHECK(node, lcfg_schema_check_container(p->lcfg, node, lcfg_string_cstr(current_path), lcfg_schema_list, t));
+					/*printf("adding list to list pos %d\n", state_stack[ssi].list_counter);*/
+					state_stack[ssi].list_counter++;
+					STATE_STACK_PUSH(in_list, filter, node);
+					STATS_CONTAINER_OPEN();
+				}
+				else if( t->type == lcfg_brace_open )
+				{
+					PATH_PUSH_INT(state_stack[ssi].list_counter);
+					SCHEMA_CHECK(node, lcfg_schema_check_container(p->lcfg, node, lcfg_string_cstr(current_path), lcfg_schema_map, t));
+					/*printf("adding map to list pos %d\n", state_stack[ssi].list_counter);*/
+					state_stack[ssi].list_counter++;
+					STATE_STACK_PUSH(in_map, filter, node);
+					state_stack[ssi].stamp = ++ctx->stamp;
+					STATS_CONTAINER_OPEN();
+				}
+				else if( t->type == lcfg_sbracket_close )
+				{
+					SCHEMA_CHECK(state_stack[ssi].schema, lcfg_schema_check_length(p->lcfg, state_stack[ssi].schema, lcfg_string_cstr(current_path), state_stack[ssi].list_counter, t));
+					PATH_POP();
+					STATE_STACK_POP();
+				}
+				else
+				{
+					lcfg_error_set(p->lcfg, "invalid token (%s) near line %" PRIu64 " column %" PRIu64 ": expected string, `[', `{', `,' or `]'", lcfg_token_map[t->type], t->line, t->col);
+					state_stack[ssi].s = invalid;
+				}
+				break;
+			case invalid: /* unreachable */
+				assert(0);
+				break;
+		}
+
+		/*printf(" *** pda: read %s, state is now %s\n", lcfg_token_map[t->type], state_map[state_stack[ssi].s]);*/
+
+		if( state_stack[ssi].s == invalid && p->validate )
+		{
+			lcfg_parser_report(p);
+
+			/* count the containers that are still open */
+			ctx->resync = !0;
+			ctx->resync_depth = prev == in_list || prev == in_map;
+			for( i = 1; i < ssi; i++ )
+			{
+				ctx->resync_depth += state_stack[i].s == in_list || state_stack[i].s == in_map;
+			}
+			if( t->type == lcfg_sbracket_open || t->type == lcfg_brace_open )
+			{
+				ctx->resync_depth++;
+			}
+			else if( (t->type == lcfg_sbracket_close || t->type == lcfg_brace_close) && ctx->resync_depth > 0 )
+			{
+				ctx->resync_depth--;
+			}
+
+			ssi = 0;
+			state_stack[0].s = top_level;
+			lcfg_string_trunc(current_path, 0);
+		}
+	}
+
+	ctx->state_stack = state_stack;
+	ctx->state_stack_size = state_stack_size;
+	ctx->ssi = ssi;
+
+	if( stats != NULL )
+	{
+		stats->parse_time += lcfg_stats_clock() - parse_start - (stats->scan_time - scan_time);
+	}
+
+	if( state_stack[ssi].s == invalid )
+	{
+		status = lcfg_status_error;
+	}
+
+	return status;
+}
+
+/* end of input: everything opened must have been closed */
+static enum lcfg_status lcfg_parser_finish(struct lcfg_parser *p, struct lcfg_parser_context *ctx)
+{
+	if( ctx->state_stack[ctx->ssi].s == top_level && ctx->ssi == 0 )
+	{
+		if( ctx->state_stack[0].schema != NULL && ctx->state_stack[0].filter == filter_include )
+		{
+			return lcfg_schema_check_required(p->lcfg, ctx->state_stack[0].schema, "", ctx->seen, ctx->state_stack[0].stamp, &ctx->token);
+		}
+
+		return lcfg_status_ok;
+	}
+
+	/* keep the message of a syntax error, it is more precise */
+	if( ctx->state_stack[ctx->ssi].s != invalid )
+	{
+		lcfg_error_set(p->lcfg, "%s", "unexpected end of file: unterminated list/map?");
+	}
+
+	return lcfg_status_error;
+}
+
+static enum lcfg_status lcfg_parser_parse(struct lcfg_parser *p, struct lcfg_scanner *scanner)
+{
+	struct lcfg_parser_context ctx;
+	enum lcfg_status status;
+
+	lcfg_parser_context_init(p, &ctx, scanner);
+
+	status = lcfg_parser_step(p, &ctx);
+	if( status == lcfg_status_ok )
+	{
+		status = lcfg_parser_finish(p, &ctx);
+	}
+
+	lcfg_parser_context_free(p, &ctx);
+
+	return status;
+}
+
+void lcfg_parser_intern_enable(struct lcfg_parser *p)
+{
+	p->intern = !0;
+}
+
+void lcfg_parser_interpolation_set(struct lcfg_parser *p, enum lcfg_interpolation interpolation)
+{
+	p->interpolation = interpolation;
+}
+
+enum lcfg_status lcfg_parser_schema_set(struct lcfg_parser *p, const struct lcfg_schema_rule *rules)
+{
+	if( p->schema != NULL )
+	{
+		lcfg_schema_delete(p->schema);
+		p->schema = NULL;
+	}
+
+	if( rules != NULL && (p->schema = lcfg_schema_new(p->lcfg, rules)) == NULL )
+	{
+		return lcfg_status_error;
+	}
+
+	return lcfg_status_ok;
+}
+
+void lcfg_parser_reader_set(struct lcfg_parser *p, lcfg_reader_function reader, void *ctx, size_t buffer_size)
+{
+	p->reader = reader;
+	p->reader_ctx = ctx;
+	if( buffer_size > 0 )
+	{
+		p->buffer_size = buffer_size;
+	}
+}
+
+/* a scanner over the file or the reader, *fd is -1 for a reader */
+static struct lcfg_scanner *lcfg_parser_scanner_open(struct lcfg_parser *p, int *fd)
+{
+	*fd = -1;
+
+	if( p->reader != NULL )
+	{
+		return lcfg_scanner_new_reader(p->lcfg, p->reader, p->reader_ctx, p->buffer_size);
+	}
+
+	if( p->filename == NULL )
+	{
+		lcfg_error_set(p->lcfg, "%s", "no file name given, use lcfg_feed()");
+		return NULL;
+	}
+
+	if( (*fd = open(p->filename, 0)) < 0 )
+	{
+		lcfg_error_set(p->lcfg, "open(): %s", strerror(errno));
+		return NULL;
+	}
+
+	return lcfg_scanner_new(p->lcfg, *fd, p->buffer_size);
+}
+
+static void lcfg_parser_scanner_close(struct lcfg_scanner *s, int fd)
+{
+	lcfg_scanner_delete(s);
+
+	if( fd >= 0 )
+	{
+		close(fd);
+	}
+}
+
+enum lcfg_status lcfg_parser_run(struct lcfg_parser *p)
+{
+	struct lcfg_scanner *s;
+	enum lcfg_status status;
+	int fd;
+
+	if( (s = lcfg_parser_scanner_open(p, &fd)) == NULL )
+	{
+		return lcfg_status_error;
+	}
+
+	status = lcfg_parser_parse(p, s);
+	lcfg_parser_scanner_close(s, fd);
+
+	if( status == lcfg_status_ok )
+	{
+		status = lcfg_parser_complete(p);
+	}
+
+	return status;
+}
+
+enum lcfg_status lcfg_parser_run_scan(struct lcfg_parser *p, lcfg_token_function fn, void *user_data)
+{
+	struct lcfg_scanner *s;
+	struct lcfg_token t;
+	enum lcfg_status status;
+	int fd;
+
+	if( (s = lcfg_parser_scanner_open(p, &fd)) == NULL )
+	{
+		return lcfg_status_error;
+	}
+
+	t.string = lcfg_string_new(p->mem);
+
+	while( (status = lcfg_parser_next_token(p, s, &t)) == lcfg_status_ok && t.type != lcfg_null_token )
+	{
+		/* lcfg_scan_token lists the token types in order */
+		if( t.type == lcfg_identifier || t.type == lcfg_string )
+		{
+			status = fn(t.type - lcfg_identifier, lcfg_string_cstr(t.string), lcfg_string_len(t.string), t.line, t.col, user_data);
+		}
+		else
+		{
+			status = fn(t.type - lcfg_identifier, NULL, 0, t.line, t.col, user_data);
+		}
+
+		if( status != lcfg_status_ok )
+		{
+			break;
+		}
+	}
+
+	lcfg_string_delete(t.string);
+	lcfg_parser_scanner_close(s, fd);
+
+	return status;
+}
+
+static void lcfg_parser_push_close(struct lcfg_parser *p)
+{
+	lcfg_scanner_delete(p->push->scanner);
+	lcfg_parser_context_free(p, p->push);
+	lcfg_mem_free(p->mem, p->push, sizeof(struct lcfg_parser_context));
+	p->push = NULL;
+	p->push_closed = !0;
+}
+
+int lcfg_parser_is_pushing(struct lcfg_parser *p)
+{
+	return p->push != NULL || p->push_closed;
+}
+
+enum lcfg_status lcfg_parser_feed(struct lcfg_parser *p, const char *buf, size_t len)
+{
+	if( p->push_closed )
+	{
+		lcfg_error_set(p->lcfg, "%s", "input already ended");
+		return lcfg_status_error;
+	}
+
+	if( p->push == NULL )
+	{
+		p->push = lcfg_mem_alloc(p->mem, sizeof(struct lcfg_parser_context));
+		lcfg_parser_context_init(p, p->push, lcfg_scanner_new_push(p->lcfg));
+	}
+
+	lcfg_scanner_feed(p->push->scanner, buf, len);
+
+	if( lcfg_parser_step(p, p->push) != lcfg_status_ok )
+	{
+		lcfg_parser_push_close(p);
+		return lcfg_status_error;
+	}
+
+	return lcfg_status_ok;
+}
+
+enum lcfg_status lcfg_parser_feed_end(struct lcfg_parser *p)
+{
+	enum lcfg_status status;
+
+	if( p->push_closed )
+	{
+		lcfg_error_set(p->lcfg, "%s", "input already ended");
+		return lcfg_status_error;
+	}
+
+	if( p->push == NULL )
+	{
+		p->push = lcfg_mem_alloc(p->mem, sizeof(struct lcfg_parser_context));
+		lcfg_parser_context_init(p, p->push, lcfg_scanner_new_push(p->lcfg));
+	}
+
+	lcfg_scanner_feed(p->push->scanner, NULL, 0);
+	lcfg_scanner_feed_end(p->push->scanner);
+
+	status = lcfg_parser_step(p, p->push);
+	if( status == lcfg_status_ok )
+	{
+		status = lcfg_parser_finish(p, p->push);
+	}
+
+	if( status == lcfg_status_ok )
+	{
+		status = lcfg_parser_complete(p);
+	}
+
+	lcfg_parser_push_close(p);
+
+	return status;
+}
+
+enum lcfg_status lcfg_parser_run_validate(struct lcfg_parser *p, lcfg_error_function fn, void *user_data)
+{
+	enum lcfg_status status;
+
+	p->validate = !0;
+	p->error_count = 0;
+	p->error_fn = fn;
+	p->error_data = user_data;
+
+	/* errors the automaton could not recover from end the run */
+	if( lcfg_parser_run(p) != lcfg_status_ok )
+	{
+		lcfg_parser_report(p);
+	}
+
+	status = p->error_count == 0 ? lcfg_status_ok : lcfg_status_error;
+
+	p->validate = 0;
+	p->error_fn = NULL;
+	p->error_data = NULL;
+
+	return status;
+}
+
+enum lcfg_status lcfg_parser_run_filtered(struct lcfg_parser *p, const char **prefixes)
+{
+	enum lcfg_status status;
+
+	p->filter = prefixes;
+	status = lcfg_parser_run(p);
+	p->filter = NULL;
+
+	return status;
+}
+
+static void lcfg_parser_add_span(struct lcfg_parser *p, struct lcfg_token *t)
+{
+	struct lcfg_parser_span *span;
+
+	if( p->span_length == p->span_capacity )
+	{
+		size_t capacity = p->span_capacity == 0 ? 8 : p->span_capacity * 2;
+
+		p->spans = lcfg_mem_realloc(p->mem, p->spans,
+			sizeof(struct lcfg_parser_span) * p->span_capacity,
+			sizeof(struct lcfg_parser_span) * capacity);
+		p->span_capacity = capacity;
+	}
+
+	span = &p->spans[p->span_length++];
+	memset(span, 0, sizeof(struct lcfg_parser_span));
+	span->key = lcfg_mem_strdup(p->mem, lcfg_string_cstr(t->string));
+	span->start = t->offset;
+	span->line = t->line;
+	span->col = t->col;
+}
+
+/* structural pass: record the extent of every top-level statement,
+ * skipping over the values without decoding them */
+static enum lcfg_status lcfg_parser_index(struct lcfg_parser *p, struct lcfg_scanner *s)
+{
+	struct lcfg_token t;
+	enum lcfg_status status = lcfg_status_ok;
+
+	t.string = lcfg_string_new(p->mem);
+
+	for( ;; )
+	{
+		if( (status = lcfg_parser_next_token(p, s, &t)) != lcfg_status_ok || t.type == lcfg_null_token )
+		{
+			break;
+		}
+
+		if( t.type != lcfg_identifier )
+		{
+			lcfg_error_set(p->lcfg, "invalid token (%s) near line %" PRIu64 " column %" PRIu64 ": expected identifier", lcfg_token_map[t.type], t.line, t.col);
+			status = lcfg_status_error;
+			break;
+		}
+
+		lcfg_parser_add_span(p, &t);
+
+		if( (status = lcfg_parser_next_token(p, s, &t)) != lcfg_status_ok )
+		{
+			break;
+		}
+
+		if( t.type == lcfg_string && !strcmp(p->spans[p->span_length - 1].key, "include") )
+		{
+			lcfg_error_set(p->lcfg, "include near line %" PRIu64 " column %" PRIu64 ": not supported by lazy parsing", t.line, t.col);
+			status = lcfg_status_error;
+			break;
+		}
+		else if( t.type != lcfg_equals )
+		{
+			lcfg_error_set(p->lcfg, "invalid token (%s) near line %" PRIu64 " column %" PRIu64 ": expected `='", lcfg_token_map[t.type], t.line, t.col);
+			status = lcfg_status_error;
+			break;
+		}
+
+		if( (status = lcfg_scanner_skip(s, 0)) != lcfg_status_ok )
+		{
+			break;
+		}
+
+		p->spans[p->span_length - 1].end = lcfg_scanner_position(s);
+	}
+
+	lcfg_string_delete(t.string);
+
+	return status;
+}
+
+enum lcfg_status lcfg_parser_run_lazy(struct lcfg_parser *p)
+{
+	struct lcfg_scanner *s;
+	pthread_mutexattr_t attr;
+	enum lcfg_status status;
+	char magic[LCFG_DECOMPRESS_MAGIC_SIZE];
+	ssize_t n;
+	double start = 0.0;
+
+	if( p->lazy )
+	{
+		lcfg_error_set(p->lcfg, "%s", "configuration is already indexed");
+		return lcfg_status_error;
+	}
+
+	if( p->filename == NULL )
+	{
+		lcfg_error_set(p->lcfg, "%s", "lazy parsing needs a file");
+		return lcfg_status_error;
+	}
+
+	p->fd = open(p->filename, 0);
+
+	if( p->fd < 0 )
+	{
+		lcfg_error_set(p->lcfg, "open(): %s", strerror(errno));
+		return lcfg_status_error;
+	}
+
+	/* statements are loaded with pread() at uncompressed offsets, reject
+	 * compressed files before indexing them */
+	n = pread(p->fd, magic, sizeof(magic), 0);
+	if( n > 0 && lcfg_decompress_detect(magic, n) != lcfg_compression_none )
+	{
+		lcfg_error_set(p->lcfg, "%s", "lazy parsing needs an uncompressed file");
+		close(p->fd);
+		p->fd = -1;
+		return lcfg_status_error;
+	}
+
+	/* recursive, visitors may look up values while lcfg_accept() holds the lock */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&p->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	p->lazy = !0;
+
+	if( p->mem->stats != NULL )
+	{
+		start = lcfg_stats_clock();
+	}
+
+	s = lcfg_scanner_new(p->lcfg, p->fd, p->buffer_size);
+	status = lcfg_parser_index(p, s);
+	lcfg_scanner_delete(s);
+
+	if( p->mem->stats != NULL )
+	{
+		p->mem->stats->build_time += lcfg_stats_clock() - start - p->mem->stats->scan_time;
+	}
+
+	return status;
+}
+
+/* parse a recorded statement, must be called with the lock held */
+static enum lcfg_status lcfg_parser_load_span(struct lcfg_parser *p, struct lcfg_parser_span *span)
+{
+	struct lcfg_scanner *s;
+	enum lcfg_status status;
+
+	if( span->loaded )
+	{
+		return lcfg_status_ok;
+	}
+
+	s = lcfg_scanner_new_range(p->lcfg, p->fd, p->buffer_size, span->start, span->end, span->line, span->col);
+
+	span->first_value = p->value_length;
+	status = lcfg_parser_parse(p, s);
+	lcfg_scanner_delete(s);
+
+	if( status != lcfg_status_ok )
+	{
+		/* drop partial results, the next access reports the error again */
+		lcfg_parser_truncate_values(p, span->first_value);
+		return status;
+	}
+
+	span->value_count = p->value_length - span->first_value;
+	span->loaded = !0;
+
+	return lcfg_status_ok;
+}
+
+/* does key lie at or below the top-level identifier of a span? */
+static int lcfg_parser_span_match(struct lcfg_parser_span *span, const char *key)
+{
+	size_t len = strlen(span->key);
+
+	return !strncmp(span->key, key, len) && (key[len] == '\0' || key[len] == '.');
+}
+
+static enum lcfg_status lcfg_parser_visit(struct lcfg_parser *p, size_t first, size_t count, const char *prefix, lcfg_visitor_function fn, void *user_data)
+{
+	size_t prefix_len = strlen(prefix);
+	size_t i;
+
+	for( i = first; i < first + count; i++ )
+	{
+		if( !lcfg_parser_key_match(p->keys[i], prefix, prefix_len) )
+		{
+			continue;
+		}
+
+		if( fn(p->keys[i], p->values[i], p->value_lens[i], user_data) != lcfg_status_ok )
+		{
+			lcfg_error_set(p->lcfg, "%s", "configuration value traversal aborted upon user request");
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+enum lcfg_status lcfg_parser_accept_subtree(struct lcfg_parser *p, const char *key, lcfg_visitor_function fn, void *user_data)
+{
+	enum lcfg_status status = lcfg_status_ok;
+	size_t i;
+
+	if( !p->lazy )
+	{
+		return lcfg_parser_visit(p, 0, p->value_length, key, fn, user_data);
+	}
+
+	pthread_mutex_lock(&p->lock);
+
+	/* load first so that a syntax error does not leave a partial traversal */
+	for( i = 0; i < p->span_length && status == lcfg_status_ok; i++ )
+	{
+		if( key[0] == '\0' || lcfg_parser_span_match(&p->spans[i], key) )
+		{
+			status = lcfg_parser_load_span(p, &p->spans[i]);
+		}
+	}
+
+	for( i = 0; i < p->span_length && status == lcfg_status_ok; i++ )
+	{
+		if( key[0] == '\0' || lcfg_parser_span_match(&p->spans[i], key) )
+		{
+			status = lcfg_parser_visit(p, p->spans[i].first_value, p->spans[i].value_count, key, fn, user_data);
+		}
+	}
+
+	pthread_mutex_unlock(&p->lock);
+
+	return status;
+}
+
+enum lcfg_status lcfg_parser_accept(struct lcfg_parser *p, lcfg_visitor_function fn, void *user_data)
+{
+	return lcfg_parser_accept_subtree(p, "", fn, user_data);
+}
+
+/* parse all statements of a lazy parse, afterwards the values no longer
+ * change and can be read without the lock */
+enum lcfg_status lcfg_parser_load_all(struct lcfg_parser *p)
+{
+	enum lcfg_status status = lcfg_status_ok;
+	size_t i;
+
+	if( !p->lazy )
+	{
+		return lcfg_status_ok;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	for( i = 0; i < p->span_length && status == lcfg_status_ok; i++ )
+	{
+		status = lcfg_parser_load_span(p, &p->spans[i]);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return status;
+}
+
+/* point b at up to max consecutive values from position *run, *index on
+ * and advance the position. a run are all values or, for a lazy parse, the
+ * values of one statement; a batch does not cross runs. */
+size_t lcfg_parser_batch(struct lcfg_parser *p, size_t *run, size_t *index, size_t max, struct lcfg_batch *b)
+{
+	size_t first, count;
+
+	for( ;; )
+	{
+		if( !p->lazy && *run == 0 )
+		{
+			first = 0;
+			count = p->value_length;
+		}
+		else if( p->lazy && *run < p->span_length )
+		{
+			first = p->spans[*run].first_value;
+			count = p->spans[*run].loaded ? p->spans[*run].value_count : 0;
+		}
+		else
+		{
+			b->count = 0;
+			return 0;
+		}
+
+		if( *index < count )
+		{
+			break;
+		}
+
+		(*run)++;
+		*index = 0;
+	}
+
+	b->count = count - *index < max ? count - *index : max;
+	b->keys = (const char *const *)p->keys + first + *index;
+	b->key_lens = p->key_lens + first + *index;
+	b->values = (const char *const *)p->values + first + *index;
+	b->value_lens = p->value_lens + first + *index;
+	*index += b->count;
+
+	return b->count;
+}
+
+enum lcfg_status lcfg_parser_accept_batched(struct lcfg_parser *p, size_t batch_size, lcfg_batch_visitor_function fn, void *user_data)
+{
+	enum lcfg_status status = lcfg_parser_load_all(p);
+	struct lcfg_batch b;
+	size_t run = 0, index = 0;
+
+	while( status == lcfg_status_ok && lcfg_parser_batch(p, &run, &index, batch_size, &b) != 0 )
+	{
+		if( fn(&b, user_data) != lcfg_status_ok )
+		{
+			lcfg_error_set(p->lcfg, "%s", "configuration value traversal aborted upon user request");
+			status = lcfg_status_error;
+		}
+	}
+
+	return status;
+}
+
+static enum lcfg_status lcfg_parser_find(struct lcfg_parser *p, size_t first, size_t count, const char *key, void **data, size_t *len)
+{
+	size_t i;
+
+	for( i = first; i < first + count; i++ )
+	{
+		if( !strcmp(p->keys[i], key) )
+		{
+			*data = p->values[i];
+			*len = p->value_lens[i];
+			return lcfg_status_ok;
+		}
+	}
+
+	return lcfg_status_error;
+}
+
+enum lcfg_status lcfg_parser_get(struct lcfg_parser *p, const char *key, void **data, size_t *len)
+{
+	enum lcfg_status status = lcfg_status_error;
+	size_t i;
+
+	if( !p->lazy && p->hash != NULL )
+	{
+		ssize_t j = lcfg_parser_hash_find(p, key, strlen(key));
+
+		if( j < 0 )
+		{
+			return lcfg_status_error;
+		}
+
+		*data = p->values[j];
+		*len = p->value_lens[j];
+		return lcfg_status_ok;
+	}
+	else if( !p->lazy )
+	{
+		return lcfg_parser_find(p, 0, p->value_length, key, data, len);
+	}
+
+	pthread_mutex_lock(&p->lock);
+
+	for( i = 0; i < p->span_length; i++ )
+	{
+		if( !lcfg_parser_span_match(&p->spans[i], key) )
+		{
+			continue;
+		}
+
+		if( lcfg_parser_load_span(p, &p->spans[i]) != lcfg_status_ok )
+		{
+			break;
+		}
+
+		if( (status = lcfg_parser_find(p, p->spans[i].first_value, p->spans[i].value_count, key, data, len)) == lcfg_status_ok )
+		{
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&p->lock);
+
+	return status;
+}
+
+void lcfg_parser_memory_usage(struct lcfg_parser *p, struct lcfg_memory_usage *u)
+{
+	struct lcfg_parser_chunk *c;
+	size_t i;
+
+	u->keys += p->key_bytes;
+	u->values += p->value_bytes;
+
+	u->indexes += sizeof(size_t) * (p->hash_capacity + p->intern_capacity) + sizeof(struct lcfg_parser_span) * p->span_capacity;
+	for( i = 0; i < p->span_length; i++ )
+	{
+		u->indexes += strlen(p->spans[i].key) + 1;
+	}
+
+	u->overhead += sizeof(struct lcfg_parser) + (sizeof(char *) * 2 + sizeof(size_t) * 2 + sizeof(struct lcfg_parser_position)) * p->value_capacity;
+	u->overhead += p->chunk_bytes - p->key_bytes - p->value_bytes;
+	for( c = p->chunks; c != NULL; c = c->next )
+	{
+		u->overhead += sizeof(struct lcfg_parser_chunk);
+	}
+	if( p->filename != NULL )
+	{
+		u->overhead += strlen(p->filename) + 1;
+	}
+}
+
+int lcfg_parser_is_lazy(struct lcfg_parser *p)
+{
+	return p->lazy;
+}
+
+void lcfg_parser_delete(struct lcfg_parser *p)
+{
+	size_t i;
+
+	lcfg_mem_free(p->mem, p->keys, sizeof(char *) * p->value_capacity);
+	lcfg_mem_free(p->mem, p->key_lens, sizeof(size_t) * p->value_capacity);
+	lcfg_mem_free(p->mem, p->values, sizeof(char *) * p->value_capacity);
+	lcfg_mem_free(p->mem, p->value_lens, sizeof(size_t) * p->value_capacity);
+	lcfg_mem_free(p->mem, p->positions, sizeof(struct lcfg_parser_position) * p->value_capacity);
+	lcfg_parser_chunks_free(p);
+
+	for( i = 0; i < p->span_length; i++ )
+	{
+		lcfg_mem_free(p->mem, p->spans[i].key, strlen(p->spans[i].key) + 1);
+	}
+	if( p->spans != NULL )
+	{
+		lcfg_mem_free(p->mem, p->spans, sizeof(struct lcfg_parser_span) * p->span_capacity);
+	}
+
+	if( p->lazy )
+	{
+		pthread_mutex_destroy(&p->lock);
+	}
+	if( p->fd >= 0 )
+	{
+		close(p->fd);
+	}
+
+	if( p->push != NULL )
+	{
+		lcfg_parser_push_close(p);
+	}
+
+	if( p->hash != NULL )
+	{
+		lcfg_mem_free(p->mem, p->hash, sizeof(size_t) * p->hash_capacity);
+	}
+
+	for( i = 0; i < p->file_count; i++ )
+	{
+		lcfg_mem_free(p->mem, p->files[i].path, strlen(p->files[i].path) + 1);
+	}
+	if( p->files != NULL )
+	{
+		lcfg_mem_free(p->mem, p->files, sizeof(struct lcfg_parser_file) * p->file_capacity);
+	}
+
+	if( p->schema != NULL )
+	{
+		lcfg_schema_delete(p->schema);
+	}
+
+	if( p->intern_table != NULL )
+	{
+		lcfg_mem_free(p->mem, p->intern_table, sizeof(size_t) * p->intern_capacity);
+	}
+
+	if( p->filename != NULL )
+	{
+		lcfg_mem_free(p->mem, p->filename, strlen(p->filename) + 1);
 	}
-	free(p->values);
-	free(p->filename);
-	free(p);
+	lcfg_mem_free(p->mem, p, sizeof(struct lcfg_parser));
 }
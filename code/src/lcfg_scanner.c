@@ -30,68 +30,155 @@
 #include <unistd.h>
 #include <errno.h>
 #include <ctype.h>
+#include <inttypes.h>
 
 #include "lcfg/lcfg_scanner.h"
 #include "lcfg/lcfg_token.h"
+#include "lcfg/lcfg_mem.h"
+#include "lcfg/lcfg_decompress.h"
 
-#define BUFFER_SIZE 0xff
+enum scanner_state { start = 0, comm_start, in_oneline, in_multiline, multiline_end, in_identifier, in_str, in_esc, esc_hex_exp_first, esc_hex_exp_second, scan_invalid };
+enum skip_state { skip_normal = 0, skip_comm_start, skip_in_oneline, skip_in_multiline, skip_multiline_end, skip_in_str, skip_in_esc };
 
 struct lcfg_scanner
 {
 	struct lcfg *lcfg;
+	struct lcfg_mem *mem;
 
 	int fd;
-	char buffer[BUFFER_SIZE];
-	int offset;
-	int size;
+	lcfg_reader_function reader;
+	void *reader_ctx;
+	struct lcfg_decompress *decompress;
+	int detected;             /* the input was checked for compression */
+	char head[LCFG_DECOMPRESS_MAGIC_SIZE];
+	int ranged;               /* read [buffer_position, limit) with pread() */
+	int push;                 /* input is passed in by lcfg_scanner_feed() */
+	uint64_t limit;
+	uint64_t buffer_position; /* input offset of data[0] */
+	char *buffer;
+	size_t buffer_size;
+	const char *data;         /* buffer, or the chunk passed to lcfg_scanner_feed() */
+	size_t offset;
+	size_t size;
 	int eof;
+	int read_error;
 
-	short line;
-	short col;
+	uint64_t line;
+	uint64_t col;
 
-	struct lcfg_token prepared_token;
-	int token_eof;
+	/* fsm state, kept across calls when input runs out in push mode */
+	enum scanner_state state;
+	enum scanner_state resume;  /* where lcfg_scanner_recover() continues after scan_invalid */
+	char hex[3];
+	int skipping;
+	enum skip_state skip_state;
+	char *skip_stack;          /* closing brackets expected by the skipped containers */
+	size_t skip_depth;
+	size_t skip_stack_size;
 };
 
 
-static enum lcfg_status lcfg_scanner_buffer_fill(struct lcfg_scanner *s)
+/* the first bytes of input decide whether it is compressed. they are read
+ * into head, so any buffer size works, and scanned from there if not. */
+static ssize_t lcfg_scanner_detect(struct lcfg_scanner *s)
 {
-	if( (s->size = read(s->fd, s->buffer, BUFFER_SIZE)) < 0 )
+	enum lcfg_compression type;
+	ssize_t n;
+	size_t len = 0;
+
+	s->detected = !0;
+
+	do
 	{
-		lcfg_error_set(s->lcfg, "read(): %s", strerror(errno));
-		return lcfg_status_error;
+		if( (n = s->reader(s->reader_ctx, s->head + len, sizeof(s->head) - len)) < 0 )
+		{
+			return n;
+		}
+		len += n;
 	}
-	else if( s->size == 0 )
+	while( n > 0 && len < sizeof(s->head) );
+
+	if( (type = lcfg_decompress_detect(s->head, len)) == lcfg_compression_none )
 	{
-		s->eof = !0;
+		s->data = s->head;
+		return len;
 	}
-	else
+
+	s->decompress = lcfg_decompress_new(s->lcfg, type, s->reader, s->reader_ctx, s->buffer_size, s->head, len);
+	if( s->decompress == NULL )
 	{
-		s->offset = 0;
+		s->eof = s->read_error = !0;
+		return -1;
 	}
 
-	return lcfg_status_ok;
+	s->reader = lcfg_decompress_read;
+	s->reader_ctx = s->decompress;
+
+	return s->reader(s->reader_ctx, s->buffer, s->buffer_size);
 }
 
-static inline int lcfg_scanner_char_eof(struct lcfg_scanner *s)
+static enum lcfg_status lcfg_scanner_buffer_fill(struct lcfg_scanner *s)
 {
-	if( s->eof )
+	ssize_t n;
+
+	s->buffer_position += s->size;
+	s->offset = s->size = 0;
+	s->data = s->buffer;
+
+	if( s->ranged )
+	{
+		size_t len = s->buffer_size;
+
+		if( s->limit - s->buffer_position < len )
+		{
+			len = s->limit - s->buffer_position;
+		}
+
+		n = len > 0 ? pread(s->fd, s->buffer, len, s->buffer_position) : 0;
+	}
+	else if( !s->detected )
 	{
-		return !0;
+		n = lcfg_scanner_detect(s);
 	}
 	else
 	{
-		if( s->size == 0 || s->offset == BUFFER_SIZE )
-		{
-			lcfg_scanner_buffer_fill(s);
-		}
-		if( s->size < BUFFER_SIZE && s->offset == s->size )
+		n = s->reader(s->reader_ctx, s->buffer, s->buffer_size);
+	}
+
+	if( n < 0 )
+	{
+		/* the decompressor sets more specific errors */
+		if( s->decompress == NULL && !s->read_error )
 		{
-			s->eof = !0;
+			lcfg_error_set(s->lcfg, "read(): %s", strerror(errno));
 		}
+		s->eof = s->read_error = !0;
+		return lcfg_status_error;
+	}
+	else if( n == 0 )
+	{
+		s->eof = !0;
+	}
+
+	s->size = n;
 
-		return s->eof;
+	if( s->mem->stats != NULL )
+	{
+		s->mem->stats->read_calls++;
+		s->mem->stats->bytes_read += n;
 	}
+
+	return lcfg_status_ok;
+}
+
+static inline int lcfg_scanner_char_eof(struct lcfg_scanner *s)
+{
+	if( s->offset == s->size && !s->eof && !s->push )
+	{
+		lcfg_scanner_buffer_fill(s);
+	}
+
+	return s->offset == s->size;
 }
 
 static enum lcfg_status lcfg_scanner_char_read(struct lcfg_scanner *s, char *c)
@@ -102,7 +189,7 @@ static enum lcfg_status lcfg_scanner_char_read(struct lcfg_scanner *s, char *c)
 		return lcfg_status_error;
 	}
 
-	*c = s->buffer[s->offset++];
+	*c = s->data[s->offset++];
 
 	return lcfg_status_ok;
 }
@@ -115,20 +202,28 @@ static enum lcfg_status lcfg_scanner_char_peek(struct lcfg_scanner *s, char *c)
 		return lcfg_status_error;
 	}
 
-	*c = s->buffer[s->offset];
+	*c = s->data[s->offset];
 
 	return lcfg_status_ok;
 }
 
+static enum lcfg_status lcfg_scanner_skip_run(struct lcfg_scanner *s);
+static void lcfg_scanner_skip_push(struct lcfg_scanner *s, char open);
+
 /* the beautiful lowlevel fsm */
-static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
+static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s, struct lcfg_token *t)
 {
-	enum scanner_state { start = 0, comm_start, in_oneline, in_multiline, multiline_end, in_identifier, in_str, in_esc, esc_hex_exp_first, esc_hex_exp_second, invalid };
-	enum scanner_state state = start;
+	enum scanner_state state = s->state;
 	char c = '\0';
-	char hex[3];
+	char *hex = s->hex;
 
-	s->prepared_token.type = lcfg_null_token;
+	t->type = lcfg_null_token;
+
+	/* finish a skip that ran out of input */
+	if( s->skipping && (lcfg_scanner_skip_run(s) != lcfg_status_ok || s->skipping) )
+	{
+		return s->skipping && !s->eof ? lcfg_status_ok : lcfg_status_error;
+	}
 
 	while( !lcfg_scanner_char_eof(s) )
 	{
@@ -138,6 +233,10 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 		switch( state )
 		{
 			case start:
+				t->offset = s->buffer_position + s->offset;
+				t->line = s->line;
+				t->col = s->col;
+
 				switch( c )
 				{
 					case ' ':
@@ -146,41 +245,42 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 					case '\n':
 						break;
 					case '=':
-						s->prepared_token.type = lcfg_equals;
+						t->type = lcfg_equals;
 						break;
 					case '[':
-						s->prepared_token.type = lcfg_sbracket_open;
+						t->type = lcfg_sbracket_open;
 						break;
 					case ']':
-						s->prepared_token.type = lcfg_sbracket_close;
+						t->type = lcfg_sbracket_close;
 						break;
 					case '{':
-						s->prepared_token.type = lcfg_brace_open;
+						t->type = lcfg_brace_open;
 						break;
 					case '}':
-						s->prepared_token.type = lcfg_brace_close;
+						t->type = lcfg_brace_close;
 						break;
 					case ',':
-						s->prepared_token.type = lcfg_comma;
+						t->type = lcfg_comma;
 						break;
 					case '/':
 						state = comm_start;
 						break;
 					case '"':
 						state = in_str;
-						lcfg_string_trunc(s->prepared_token.string, 0);
+						lcfg_string_trunc(t->string, 0);
 						break;
 					default:
 						if( isalpha(c) )
 						{
-							lcfg_string_trunc(s->prepared_token.string, 0);
-							lcfg_string_cat_char(s->prepared_token.string, c);
+							lcfg_string_trunc(t->string, 0);
+							lcfg_string_cat_char(t->string, c);
 							state = in_identifier;
 						}
 						else
 						{
-							lcfg_error_set(s->lcfg, "parse error: invalid input character `%c' (0x%02x) near line %d, col %d", isprint(c) ? c : '.', c, s->line, s->col);
-							state = invalid;
+							lcfg_error_set(s->lcfg, "parse error: invalid input character `%c' (0x%02x) near line %" PRIu64 ", col %" PRIu64, isprint(c) ? c : '.', c, s->line, s->col);
+							state = scan_invalid;
+							s->resume = start;
 						}
 				}
 				break;
@@ -195,8 +295,9 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 				}
 				else
 				{
-					lcfg_error_set(s->lcfg, "parse error: invalid input character `%c' (0x%02x) near line %d, col %d", isprint(c) ? c : '.', c, s->line, s->col);
-					state = invalid;
+					lcfg_error_set(s->lcfg, "parse error: invalid input character `%c' (0x%02x) near line %" PRIu64 ", col %" PRIu64, isprint(c) ? c : '.', c, s->line, s->col);
+					state = scan_invalid;
+					s->resume = start;
 				}
 				break;
 			case in_oneline:
@@ -224,11 +325,11 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 			case in_identifier:
 				if( isalnum(c) || c == '-' || c == '_' )
 				{
-					lcfg_string_cat_char(s->prepared_token.string, c);
+					lcfg_string_cat_char(t->string, c);
 				}
 				else
 				{
-					s->prepared_token.type = lcfg_identifier;
+					t->type = lcfg_identifier;
 					consume = 0;
 					state = start;
 				}
@@ -236,7 +337,7 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 			case in_str:
 				if( c == '"' )
 				{
-					s->prepared_token.type = lcfg_string;
+					t->type = lcfg_string;
 					state = start;
 				}
 				else if( c == '\\' )
@@ -245,7 +346,7 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 				}
 				else
 				{
-					lcfg_string_cat_char(s->prepared_token.string, c);
+					lcfg_string_cat_char(t->string, c);
 				}
 				break;
 			case in_esc:
@@ -253,36 +354,39 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 				switch( c )
 				{
 					case '"':
-						lcfg_string_cat_char(s->prepared_token.string, '"');
+						lcfg_string_cat_char(t->string, '"');
 						break;
 					case 'n':
-						lcfg_string_cat_char(s->prepared_token.string, '\n');
+						lcfg_string_cat_char(t->string, '\n');
 						break;
 					case 't':
-						lcfg_string_cat_char(s->prepared_token.string, '\t');
+						lcfg_string_cat_char(t->string, '\t');
 						break;
 					case 'r':
-						lcfg_string_cat_char(s->prepared_token.string, '\r');
+						lcfg_string_cat_char(t->string, '\r');
 						break;
 					case '0':
-						lcfg_string_cat_char(s->prepared_token.string, '\0');
+						lcfg_string_cat_char(t->string, '\0');
 						break;
 					case '\\':
-						lcfg_string_cat_char(s->prepared_token.string, '\\');
+						lcfg_string_cat_char(t->string, '\\');
 						break;
 					case 'x':
 						state = esc_hex_exp_first;
 						break;
 					default:
-						lcfg_error_set(s->lcfg, "invalid string escape sequence `%c' near line %d, col %d", c, s->line, s->col);
-						state = invalid;
+						lcfg_error_set(s->lcfg, "invalid string escape sequence `%c' near line %" PRIu64 ", col %" PRIu64, c, s->line, s->col);
+						state = scan_invalid;
+						s->resume = in_str;
 				}
 				break;
 			case esc_hex_exp_first:
 				if( !isxdigit(c) )
 				{
-					lcfg_error_set(s->lcfg, "invalid hex escape sequence `%c' on line %d column %d", c, s->line, s->col);
-					state = invalid;
+					lcfg_error_set(s->lcfg, "invalid hex escape sequence `%c' on line %" PRIu64 " column %" PRIu64, c, s->line, s->col);
+					state = scan_invalid;
+					s->resume = in_str;
+					break;
 				}
 				hex[0] = c;
 				state = esc_hex_exp_second;
@@ -290,24 +394,22 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 			case esc_hex_exp_second:
 				if( !isxdigit(c) )
 				{
-					lcfg_error_set(s->lcfg, "invalid hex escape sequence `%c' on line %d column %d", c, s->line, s->col);
-					state = invalid;
+					lcfg_error_set(s->lcfg, "invalid hex escape sequence `%c' on line %" PRIu64 " column %" PRIu64, c, s->line, s->col);
+					state = scan_invalid;
+					s->resume = in_str;
+					break;
 				}
 				hex[1] = c;
 				hex[2] = '\0';
-				lcfg_string_cat_char(s->prepared_token.string, strtoul(hex, NULL, 16));
+				lcfg_string_cat_char(t->string, strtoul(hex, NULL, 16));
 				state = in_str;
 				break;
-			case invalid:
+			case scan_invalid:
 				break;
 		}
 		/*#include <stdio.h>
 		printf("read %c at line %d column %d, new state is %d\n", isprint(c) ? c : '.', s->line, s->col, state);*/
 
-		/* this is technically not optimal (token position identified by last char), but it will suffice for now */
-		s->prepared_token.line = s->line;
-		s->prepared_token.col = s->col;
-
 		if( consume )
 		{
 			lcfg_scanner_char_read(s, &c);
@@ -322,71 +424,353 @@ static enum lcfg_status lcfg_scanner_token_read(struct lcfg_scanner *s)
 			}
 		}
 
-		if( s->prepared_token.type != lcfg_null_token || state == invalid )
+		if( t->type != lcfg_null_token || state == scan_invalid )
 		{
 			break;
 		}
 	}
 
-	if( state != start )
+	if( s->read_error )
 	{
-		if( state != invalid )
-		{
-			lcfg_error_set(s->lcfg, "parse error: premature end of file near line %d, col %d", s->line, s->col);
-		}
+		return lcfg_status_error;
+	}
+
+	if( state == scan_invalid )
+	{
+		s->state = scan_invalid;
+		return lcfg_status_error;
+	}
+
+	if( t->type == lcfg_null_token && !s->eof )
+	{
+		/* push mode and out of input, resume here with the next chunk */
+		s->state = state;
+		return lcfg_status_ok;
+	}
+
+	s->state = start;
 
+	if( state != start )
+	{
+		lcfg_error_set(s->lcfg, "parse error: premature end of file near line %" PRIu64 ", col %" PRIu64, s->line, s->col);
 		return lcfg_status_error;
 	}
 
 	return lcfg_status_ok;
 }
 
-enum lcfg_status lcfg_scanner_init(struct lcfg_scanner *s)
+/* scan the next token into t. t->string is owned by the caller and reused
+ * for every token, so steady state scanning does not allocate. a token type
+ * of lcfg_null_token signals the end of input. */
+enum lcfg_status lcfg_scanner_next_token(struct lcfg_scanner *s, struct lcfg_token *t)
 {
-	/* prepare the first token */
-	return lcfg_scanner_token_read(s);
+	return lcfg_scanner_token_read(s, t);
 }
 
-int lcfg_scanner_has_next(struct lcfg_scanner *s)
+/* skip input without building tokens: strings and comments are respected,
+ * escapes are not decoded and apart from matching brackets the structure
+ * inside lists and maps is not checked. with open 0 one value (string,
+ * list or map) is skipped, else the rest of the list or map whose opening
+ * bracket open has just been scanned. in push mode the skip is completed
+ * by the next lcfg_scanner_next_token() calls when input runs out. */
+enum lcfg_status lcfg_scanner_skip(struct lcfg_scanner *s, char open)
 {
-	return s->prepared_token.type != lcfg_null_token;
+	s->skipping = !0;
+	s->skip_state = skip_normal;
+	s->skip_depth = 0;
+
+	if( open != 0 )
+	{
+		lcfg_scanner_skip_push(s, open);
+	}
+
+	return lcfg_scanner_skip_run(s);
 }
 
-enum lcfg_status lcfg_scanner_next_token(struct lcfg_scanner *s, struct lcfg_token *t)
+static enum lcfg_status lcfg_scanner_skip_run(struct lcfg_scanner *s)
 {
-	if( !lcfg_scanner_has_next(s) )
+	enum skip_state state = s->skip_state;
+	char c;
+
+	while( !lcfg_scanner_char_eof(s) )
 	{
-		lcfg_error_set(s->lcfg, "%s", "cannot access tokenstream beyond eof");
-		return lcfg_status_error;
+		c = s->data[s->offset++];
+
+		if( c == '\n' )
+		{
+			s->line++;
+			s->col = 1;
+		}
+		else
+		{
+			s->col++;
+		}
+
+		switch( state )
+		{
+			case skip_normal:
+				switch( c )
+				{
+					case ' ':
+					case '\t':
+					case '\r':
+					case '\n':
+						break;
+					case '"':
+						state = skip_in_str;
+						break;
+					case '[':
+					case '{':
+						lcfg_scanner_skip_push(s, c);
+						break;
+					case ']':
+					case '}':
+						if( s->skip_depth == 0 )
+						{
+							lcfg_error_set(s->lcfg, "invalid token (`%c') near line %" PRIu64 ", col %" PRIu64 ": expected string, `[' or `{'", c, s->line, s->col - 1);
+							return lcfg_status_error;
+						}
+						if( c != s->skip_stack[s->skip_depth - 1] )
+						{
+							lcfg_error_set(s->lcfg, "invalid token (`%c') near line %" PRIu64 ", col %" PRIu64 ": expected `%c'", c, s->line, s->col - 1, s->skip_stack[s->skip_depth - 1]);
+							return lcfg_status_error;
+						}
+						if( --s->skip_depth == 0 )
+						{
+							s->skipping = 0;
+							return lcfg_status_ok;
+						}
+						break;
+					case '/':
+						state = skip_comm_start;
+						break;
+					default:
+						if( s->skip_depth == 0 )
+						{
+							lcfg_error_set(s->lcfg, "parse error: invalid input character `%c' (0x%02x) near line %" PRIu64 ", col %" PRIu64 ": expected string, `[' or `{'", isprint(c) ? c : '.', c, s->line, s->col - 1);
+							return lcfg_status_error;
+						}
+				}
+				break;
+			case skip_comm_start:
+				if( c == '/' )
+				{
+					state = skip_in_oneline;
+				}
+				else if( c == '*' )
+				{
+					state = skip_in_multiline;
+				}
+				else
+				{
+					lcfg_error_set(s->lcfg, "parse error: invalid input character `%c' (0x%02x) near line %" PRIu64 ", col %" PRIu64, isprint(c) ? c : '.', c, s->line, s->col - 1);
+					return lcfg_status_error;
+				}
+				break;
+			case skip_in_oneline:
+				if( c == '\n' )
+				{
+					state = skip_normal;
+				}
+				break;
+			case skip_in_multiline:
+				if( c == '*' )
+				{
+					state = skip_multiline_end;
+				}
+				break;
+			case skip_multiline_end:
+				if( c == '/' )
+				{
+					state = skip_normal;
+				}
+				else if( c != '*' )
+				{
+					state = skip_in_multiline;
+				}
+				break;
+			case skip_in_str:
+				if( c == '"' )
+				{
+					state = skip_normal;
+					if( s->skip_depth == 0 )
+					{
+						s->skipping = 0;
+						return lcfg_status_ok;
+					}
+				}
+				else if( c == '\\' )
+				{
+					state = skip_in_esc;
+				}
+				break;
+			case skip_in_esc:
+				state = skip_in_str;
+				break;
+		}
 	}
 
-	memcpy(t, &s->prepared_token, sizeof(struct lcfg_token));
-	t->string = lcfg_string_new_copy(s->prepared_token.string);
+	if( !s->eof )
+	{
+		/* push mode and out of input */
+		s->skip_state = state;
+		return lcfg_status_ok;
+	}
+
+	if( !s->read_error )
+	{
+		lcfg_error_set(s->lcfg, "parse error: premature end of file near line %" PRIu64 ", col %" PRIu64, s->line, s->col);
+	}
+
+	return lcfg_status_error;
+}
+
+static void lcfg_scanner_skip_push(struct lcfg_scanner *s, char open)
+{
+	if( s->skip_depth == s->skip_stack_size )
+	{
+		size_t size = s->skip_stack_size > 0 ? s->skip_stack_size * 2 : 16;
+
+		if( s->skip_stack == NULL )
+		{
+			s->skip_stack = lcfg_mem_alloc(s->mem, size);
+		}
+		else
+		{
+			s->skip_stack = lcfg_mem_realloc(s->mem, s->skip_stack, s->skip_stack_size, size);
+		}
+		s->skip_stack_size = size;
+	}
+
+	s->skip_stack[s->skip_depth++] = open == '[' ? ']' : '}';
+}
+
+uint64_t lcfg_scanner_position(struct lcfg_scanner *s)
+{
+	return s->buffer_position + s->offset;
+}
 
-	/* prepare the next token */
-	return lcfg_scanner_token_read(s);
+static ssize_t lcfg_scanner_fd_read(void *ctx, void *buf, size_t len)
+{
+	return read(*(int *)ctx, buf, len);
 }
 
-struct lcfg_scanner *lcfg_scanner_new(struct lcfg *c, int fd)
+static struct lcfg_scanner *lcfg_scanner_alloc(struct lcfg *c, size_t buffer_size)
 {
-	struct lcfg_scanner *s = malloc(sizeof(struct lcfg_scanner));
-	assert(s);
+	struct lcfg_mem *m = lcfg_mem_get(c);
+	struct lcfg_scanner *s = lcfg_mem_alloc(m, sizeof(struct lcfg_scanner));
 
 	memset(s, 0, sizeof(struct lcfg_scanner));
 
 	s->lcfg = c;
-	s->fd = fd;
+	s->mem = m;
+	s->fd = -1;
+
+	s->buffer_size = buffer_size;
+	if( buffer_size > 0 )
+	{
+		s->buffer = lcfg_mem_alloc(m, buffer_size);
+	}
 
 	s->line = s->col = 1;
+	s->data = s->buffer;
+
+	return s;
+}
+
+struct lcfg_scanner *lcfg_scanner_new(struct lcfg *c, int fd, size_t buffer_size)
+{
+	struct lcfg_scanner *s = lcfg_scanner_alloc(c, buffer_size);
+
+	s->fd = fd;
+	s->reader = lcfg_scanner_fd_read;
+	s->reader_ctx = &s->fd;
+
+	return s;
+}
+
+struct lcfg_scanner *lcfg_scanner_new_reader(struct lcfg *c, lcfg_reader_function reader, void *ctx, size_t buffer_size)
+{
+	struct lcfg_scanner *s = lcfg_scanner_alloc(c, buffer_size);
+
+	s->reader = reader;
+	s->reader_ctx = ctx;
+
+	return s;
+}
+
+/* the buffer is never larger than the range */
+struct lcfg_scanner *lcfg_scanner_new_range(struct lcfg *c, int fd, size_t buffer_size, uint64_t start, uint64_t end, uint64_t line, uint64_t col)
+{
+	struct lcfg_scanner *s = lcfg_scanner_alloc(c, end - start < buffer_size ? end - start + 1 : buffer_size);
 
-	s->prepared_token.string = lcfg_string_new();
+	s->fd = fd;
+	s->ranged = !0;
+	s->buffer_position = start;
+	s->limit = end;
+	s->line = line;
+	s->col = col;
 
 	return s;
 }
 
+struct lcfg_scanner *lcfg_scanner_new_push(struct lcfg *c)
+{
+	struct lcfg_scanner *s = lcfg_scanner_alloc(c, 0);
+
+	s->push = !0;
+
+	return s;
+}
+
+/* scan from buf until the next call, buf is not referenced afterwards
+ * as long as the caller consumes all tokens before feeding again */
+void lcfg_scanner_feed(struct lcfg_scanner *s, const char *buf, size_t len)
+{
+	s->buffer_position += s->size;
+	s->data = buf;
+	s->offset = 0;
+	s->size = len;
+
+	if( s->mem->stats != NULL )
+	{
+		s->mem->stats->read_calls++;
+		s->mem->stats->bytes_read += len;
+	}
+}
+
+void lcfg_scanner_feed_end(struct lcfg_scanner *s)
+{
+	s->eof = !0;
+}
+
+enum lcfg_status lcfg_scanner_recover(struct lcfg_scanner *s)
+{
+	if( s->state != scan_invalid || s->read_error )
+	{
+		return lcfg_status_error;
+	}
+
+	/* the offending character is consumed, a broken string goes on */
+	s->state = s->resume;
+
+	return lcfg_status_ok;
+}
+
 void lcfg_scanner_delete(struct lcfg_scanner *s)
 {
-	lcfg_string_delete(s->prepared_token.string);
-	free(s);
+	if( s->decompress != NULL )
+	{
+		lcfg_decompress_delete(s->decompress);
+	}
+	if( s->buffer != NULL )
+	{
+		lcfg_mem_free(s->mem, s->buffer, s->buffer_size);
+	}
+	if( s->skip_stack != NULL )
+	{
+		lcfg_mem_free(s->mem, s->skip_stack, s->skip_stack_size);
+	}
+	lcfg_mem_free(s->mem, s, sizeof(struct lcfg_scanner));
 }
 
@@ -0,0 +1,327 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "lcfg/lcfg_schema.h"
+#include "lcfg/lcfg_mem.h"
+
+struct lcfg_schema
+{
+	struct lcfg_mem *mem;
+	struct lcfg_schema_node root;
+	size_t node_count;
+};
+
+static const char *lcfg_schema_type_names[] =
+{
+	"anything", "a string", "an integer", "a boolean (true, false, yes, no, on or off)", "a list", "a map"
+};
+
+static const char *lcfg_schema_booleans[] = { "true", "false", "yes", "no", "on", "off", NULL };
+
+const char *lcfg_schema_type_name(enum lcfg_schema_type type)
+{
+	return lcfg_schema_type_names[type];
+}
+
+int lcfg_schema_integer_value(const char *value, size_t len, long long *i)
+{
+	char *end;
+
+	errno = 0;
+	*i = strtoll(value, &end, 10);
+
+	return len > 0 && end == value + len && errno == 0;
+}
+
+int lcfg_schema_boolean_value(const char *value, int *b)
+{
+	const char **v;
+
+	/* true and false words alternate */
+	for( v = lcfg_schema_booleans; *v != NULL && strcmp(*v, value) != 0; v++ );
+	*b = (v - lcfg_schema_booleans) % 2 == 0;
+
+	return *v != NULL;
+}
+
+const struct lcfg_schema_node *lcfg_schema_child(const struct lcfg_schema_node *n, const char *name, size_t len)
+{
+	const struct lcfg_schema_node *child, *any = NULL;
+
+	for( child = n->children; child != NULL; child = child->next )
+	{
+		if( !strncmp(child->name, name, len) && child->name[len] == '\0' )
+		{
+			return child;
+		}
+		else if( !strcmp(child->name, "*") )
+		{
+			any = child;
+		}
+	}
+
+	return any;
+}
+
+/* scalar rules cannot have rules below them */
+static enum lcfg_status lcfg_schema_verify(struct lcfg *c, const struct lcfg_schema_node *n)
+{
+	const struct lcfg_schema_node *child;
+
+	if( n->children != NULL && n->rule != NULL && n->rule->type != lcfg_schema_any && n->rule->type != lcfg_schema_list && n->rule->type != lcfg_schema_map )
+	{
+		lcfg_error_set(c, "schema rule for `%s' must be a list or map, there are rules below it", n->rule->key);
+		return lcfg_status_error;
+	}
+
+	for( child = n->children; child != NULL; child = child->next )
+	{
+		if( lcfg_schema_verify(c, child) != lcfg_status_ok )
+		{
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+struct lcfg_schema *lcfg_schema_new(struct lcfg *c, const struct lcfg_schema_rule *rules)
+{
+	struct lcfg_mem *m = lcfg_mem_get(c);
+	struct lcfg_schema *s = lcfg_mem_alloc(m, sizeof(struct lcfg_schema));
+	const struct lcfg_schema_rule *r;
+
+	memset(s, 0, sizeof(struct lcfg_schema));
+	s->mem = m;
+	s->node_count = 1;
+
+	for( r = rules; r->key != NULL; r++ )
+	{
+		struct lcfg_schema_node *n = &s->root, *parent = NULL, *child;
+		const char *name = r->key, *end;
+
+		do
+		{
+			size_t len;
+
+			end = strchr(name, '.');
+			len = end == NULL ? strlen(name) : (size_t)(end - name);
+
+			for( child = n->children; child != NULL; child = child->next )
+			{
+				if( !strncmp(child->name, name, len) && child->name[len] == '\0' )
+				{
+					break;
+				}
+			}
+
+			if( child == NULL )
+			{
+				child = lcfg_mem_alloc(m, sizeof(struct lcfg_schema_node));
+				memset(child, 0, sizeof(struct lcfg_schema_node));
+				child->name = lcfg_mem_alloc(m, len + 1);
+				memcpy(child->name, name, len);
+				child->name[len] = '\0';
+				child->index = s->node_count++;
+				child->next = n->children;
+				n->children = child;
+			}
+
+			parent = n;
+			n = child;
+			if( end != NULL )
+			{
+				name = end + 1;
+			}
+		}
+		while( end != NULL );
+
+		if( n->rule != NULL )
+		{
+			lcfg_error_set(c, "duplicate schema rule for `%s'", r->key);
+			lcfg_schema_delete(s);
+			return NULL;
+		}
+
+		n->rule = r;
+		if( r->required )
+		{
+			parent->required++;
+		}
+	}
+
+	if( lcfg_schema_verify(c, &s->root) != lcfg_status_ok )
+	{
+		lcfg_schema_delete(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+const struct lcfg_schema_node *lcfg_schema_root(struct lcfg_schema *s)
+{
+	return &s->root;
+}
+
+size_t lcfg_schema_node_count(struct lcfg_schema *s)
+{
+	return s->node_count;
+}
+
+static int lcfg_schema_bounded(const struct lcfg_schema_rule *r)
+{
+	return r->min != 0 || r->max != 0;
+}
+
+enum lcfg_status lcfg_schema_check_value(struct lcfg *c, const struct lcfg_schema_node *n, const char *key, const char *value, size_t len, struct lcfg_token *t)
+{
+	const struct lcfg_schema_rule *r = n->rule;
+	const char **v;
+	long long i;
+	int b;
+
+	if( r == NULL )
+	{
+		lcfg_error_set(c, "`%s' must be a list or map near line %" PRIu64 " column %" PRIu64, key, t->line, t->col);
+		return lcfg_status_error;
+	}
+
+	switch( r->type )
+	{
+		case lcfg_schema_any:
+		case lcfg_schema_string:
+			break;
+		case lcfg_schema_integer:
+			if( !lcfg_schema_integer_value(value, len, &i) )
+			{
+				lcfg_error_set(c, "`%s' must be %s near line %" PRIu64 " column %" PRIu64, key, lcfg_schema_type_names[r->type], t->line, t->col);
+				return lcfg_status_error;
+			}
+			if( lcfg_schema_bounded(r) && (i < r->min || i > r->max) )
+			{
+				lcfg_error_set(c, "`%s' must be between %lld and %lld near line %" PRIu64 " column %" PRIu64, key, r->min, r->max, t->line, t->col);
+				return lcfg_status_error;
+			}
+			break;
+		case lcfg_schema_boolean:
+			if( !lcfg_schema_boolean_value(value, &b) )
+			{
+				lcfg_error_set(c, "`%s' must be %s near line %" PRIu64 " column %" PRIu64, key, lcfg_schema_type_names[r->type], t->line, t->col);
+				return lcfg_status_error;
+			}
+			break;
+		case lcfg_schema_list:
+		case lcfg_schema_map:
+			lcfg_error_set(c, "`%s' must be %s near line %" PRIu64 " column %" PRIu64, key, lcfg_schema_type_names[r->type], t->line, t->col);
+			return lcfg_status_error;
+	}
+
+	if( r->values != NULL )
+	{
+		for( v = r->values; *v != NULL && strcmp(*v, value) != 0; v++ );
+		if( *v == NULL )
+		{
+			lcfg_error_set(c, "`%s' has a value that is not allowed (\"%s\") near line %" PRIu64 " column %" PRIu64, key, value, t->line, t->col);
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+enum lcfg_status lcfg_schema_check_container(struct lcfg *c, const struct lcfg_schema_node *n, const char *key, enum lcfg_schema_type type, struct lcfg_token *t)
+{
+	const struct lcfg_schema_rule *r = n->rule;
+
+	if( r == NULL || r->type == lcfg_schema_any || r->type == type )
+	{
+		return lcfg_status_ok;
+	}
+
+	lcfg_error_set(c, "`%s' must be %s near line %" PRIu64 " column %" PRIu64, key, lcfg_schema_type_names[r->type], t->line, t->col);
+
+	return lcfg_status_error;
+}
+
+enum lcfg_status lcfg_schema_check_length(struct lcfg *c, const struct lcfg_schema_node *n, const char *key, size_t count, struct lcfg_token *t)
+{
+	const struct lcfg_schema_rule *r = n->rule;
+
+	if( r == NULL || r->type != lcfg_schema_list || !lcfg_schema_bounded(r) || ((long long)count >= r->min && (long long)count <= r->max) )
+	{
+		return lcfg_status_ok;
+	}
+
+	lcfg_error_set(c, "`%s' must have between %lld and %lld elements near line %" PRIu64 " column %" PRIu64, key, r->min, r->max, t->line, t->col);
+
+	return lcfg_status_error;
+}
+
+enum lcfg_status lcfg_schema_check_required(struct lcfg *c, const struct lcfg_schema_node *n, const char *key, const size_t *seen, size_t stamp, struct lcfg_token *t)
+{
+	const struct lcfg_schema_node *child;
+
+	if( n->required == 0 )
+	{
+		return lcfg_status_ok;
+	}
+
+	for( child = n->children; child != NULL; child = child->next )
+	{
+		if( child->rule != NULL && child->rule->required && seen[child->index] != stamp )
+		{
+			lcfg_error_set(c, "missing required key `%s%s%s' near line %" PRIu64 " column %" PRIu64, key, key[0] == '\0' ? "" : ".", child->name, t->line, t->col);
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+static void lcfg_schema_node_free(struct lcfg_mem *m, struct lcfg_schema_node *n)
+{
+	struct lcfg_schema_node *child, *next;
+
+	for( child = n->children; child != NULL; child = next )
+	{
+		next = child->next;
+		lcfg_schema_node_free(m, child);
+		lcfg_mem_free(m, child->name, strlen(child->name) + 1);
+		lcfg_mem_free(m, child, sizeof(struct lcfg_schema_node));
+	}
+}
+
+void lcfg_schema_delete(struct lcfg_schema *s)
+{
+	lcfg_schema_node_free(s->mem, &s->root);
+	lcfg_mem_free(s->mem, s, sizeof(struct lcfg_schema));
+}
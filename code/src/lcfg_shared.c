@@ -0,0 +1,438 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lcfg/lcfg_shared.h"
+#include "lcfg/lcfg_mem.h"
+#include "lcfg/lcfg_hash.h"
+
+/*
+ * a published config consists of two shared memory objects: the control
+ * object <name> holding the current generation, and the image
+ * <name>.<generation>. the image only contains offsets, so it can be
+ * mapped anywhere:
+ *
+ *   header | entries[count] | hash[hash_capacity] | keys and values
+ *
+ * keys and values are NUL-terminated. republishing writes a new image,
+ * bumps the generation and unlinks the old image, which stays valid for
+ * processes that still have it mapped.
+ */
+#define LCFG_SHARED_MAGIC 0x6c636667 /* "lcfg" */
+#define LCFG_SHARED_VERSION 1
+
+struct lcfg_shared_control
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t generation;
+};
+
+struct lcfg_shared_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t generation;
+	uint64_t size;
+	uint64_t count;
+	uint64_t hash_capacity; /* power of two, slots hold entry index + 1 */
+};
+
+struct lcfg_shared_entry
+{
+	uint64_t key;           /* offsets from the start of the image */
+	uint64_t value;
+	uint64_t value_len;
+};
+
+struct lcfg_shared
+{
+	struct lcfg_mem *mem;
+	const struct lcfg_shared_control *control;
+	const char *image;
+	size_t image_size;
+	uint64_t generation;
+};
+
+/* collects the values of a config into an image */
+struct lcfg_shared_builder
+{
+	char *image;
+	uint64_t count;
+	uint64_t blob_size;
+	uint64_t blob;          /* write position */
+};
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+static void lcfg_shared_name(char *buf, size_t size, const char *name, uint64_t generation)
+{
+	snprintf(buf, size, "%s.%llu", name, (unsigned long long)generation);
+}
+
+static enum lcfg_status lcfg_shared_count_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct lcfg_shared_builder *b = user_data;
+
+	b->count++;
+	b->blob_size += strlen(key) + 1 + len + 1;
+
+	return lcfg_status_ok;
+}
+
+static enum lcfg_status lcfg_shared_fill_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct lcfg_shared_builder *b = user_data;
+	struct lcfg_shared_header *h = (struct lcfg_shared_header *)b->image;
+	struct lcfg_shared_entry *entries = (struct lcfg_shared_entry *)(b->image + sizeof(struct lcfg_shared_header));
+	struct lcfg_shared_entry *e = &entries[b->count];
+	uint64_t *hash = (uint64_t *)(entries + h->count);
+	size_t key_len = strlen(key);
+	uint64_t i;
+
+	e->key = b->blob;
+	memcpy(b->image + b->blob, key, key_len + 1);
+	b->blob += key_len + 1;
+
+	e->value = b->blob;
+	e->value_len = len;
+	memcpy(b->image + b->blob, data, len);
+	b->image[b->blob + len] = '\0';
+	b->blob += len + 1;
+
+	/* the first of duplicate keys wins, as in the parser */
+	for( i = lcfg_hash(key) & (h->hash_capacity - 1); hash[i] != 0; i = (i + 1) & (h->hash_capacity - 1) )
+	{
+		if( !strcmp(b->image + entries[hash[i] - 1].key, key) )
+		{
+			break;
+		}
+	}
+	if( hash[i] == 0 )
+	{
+		hash[i] = b->count + 1;
+	}
+
+	b->count++;
+
+	return lcfg_status_ok;
+}
+
+enum lcfg_status lcfg_shared_publish(struct lcfg *c, const char *name)
+{
+	struct lcfg_shared_builder b;
+	struct lcfg_shared_header *h;
+	struct lcfg_shared_control *control;
+	char image_name[256];
+	uint64_t hash_capacity = 16, blob_start, size, generation;
+	int fd;
+
+	memset(&b, 0, sizeof(b));
+	if( lcfg_accept(c, lcfg_shared_count_visitor, &b) != lcfg_status_ok )
+	{
+		return lcfg_status_error;
+	}
+
+	while( hash_capacity < b.count * 2 )
+	{
+		hash_capacity *= 2;
+	}
+
+	blob_start = sizeof(struct lcfg_shared_header) + b.count * sizeof(struct lcfg_shared_entry) + hash_capacity * sizeof(uint64_t);
+	size = ALIGN8(blob_start + b.blob_size);
+
+	/* the control object is created by the first publication */
+	if( (fd = shm_open(name, O_RDWR | O_CREAT, 0644)) < 0 )
+	{
+		lcfg_error_set(c, "shm_open(%s): %s", name, strerror(errno));
+		return lcfg_status_error;
+	}
+	if( ftruncate(fd, sizeof(struct lcfg_shared_control)) != 0 ||
+		(control = mmap(NULL, sizeof(struct lcfg_shared_control), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED )
+	{
+		lcfg_error_set(c, "%s: %s", name, strerror(errno));
+		close(fd);
+		return lcfg_status_error;
+	}
+	close(fd);
+
+	control->magic = LCFG_SHARED_MAGIC;
+	control->version = LCFG_SHARED_VERSION;
+	generation = __atomic_load_n(&control->generation, __ATOMIC_ACQUIRE) + 1;
+
+	lcfg_shared_name(image_name, sizeof(image_name), name, generation);
+	shm_unlink(image_name); /* left over by an interrupted publication */
+
+	if( (fd = shm_open(image_name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0 )
+	{
+		lcfg_error_set(c, "shm_open(%s): %s", image_name, strerror(errno));
+		munmap(control, sizeof(struct lcfg_shared_control));
+		return lcfg_status_error;
+	}
+	if( ftruncate(fd, size) != 0 || (b.image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED )
+	{
+		lcfg_error_set(c, "%s: %s", image_name, strerror(errno));
+		close(fd);
+		shm_unlink(image_name);
+		munmap(control, sizeof(struct lcfg_shared_control));
+		return lcfg_status_error;
+	}
+	close(fd);
+
+	/* ftruncate() zeroed the hash slots */
+	h = (struct lcfg_shared_header *)b.image;
+	h->magic = LCFG_SHARED_MAGIC;
+	h->version = LCFG_SHARED_VERSION;
+	h->generation = generation;
+	h->size = size;
+	h->count = b.count;
+	h->hash_capacity = hash_capacity;
+
+	b.count = 0;
+	b.blob = blob_start;
+	lcfg_accept(c, lcfg_shared_fill_visitor, &b);
+	munmap(b.image, size);
+
+	/* switch readers over, then retire the previous image */
+	__atomic_store_n(&control->generation, generation, __ATOMIC_RELEASE);
+	munmap(control, sizeof(struct lcfg_shared_control));
+
+	if( generation > 1 )
+	{
+		lcfg_shared_name(image_name, sizeof(image_name), name, generation - 1);
+		shm_unlink(image_name);
+	}
+
+	return lcfg_status_ok;
+}
+
+static void *lcfg_shared_map(const char *name, size_t *size)
+{
+	struct stat st;
+	void *p;
+	int fd;
+
+	if( (fd = shm_open(name, O_RDONLY, 0)) < 0 )
+	{
+		return NULL;
+	}
+
+	if( fstat(fd, &st) != 0 || (size_t)st.st_size < *size )
+	{
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	*size = st.st_size;
+	p = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+struct lcfg_shared *lcfg_shared_attach(struct lcfg *c, const char *name)
+{
+	struct lcfg_mem *m = lcfg_mem_get(c);
+	struct lcfg_shared *s = lcfg_mem_alloc(m, sizeof(struct lcfg_shared));
+	const struct lcfg_shared_header *h;
+	char image_name[256];
+	size_t size = sizeof(struct lcfg_shared_control);
+	int tries;
+
+	memset(s, 0, sizeof(struct lcfg_shared));
+	s->mem = m;
+
+	if( (s->control = lcfg_shared_map(name, &size)) == NULL || s->control->magic != LCFG_SHARED_MAGIC || s->control->version != LCFG_SHARED_VERSION )
+	{
+		lcfg_error_set(c, "%s: %s", name, s->control == NULL ? strerror(errno) : "not a published lcfg config");
+		lcfg_shared_detach(s);
+		return NULL;
+	}
+
+	/* the image may be replaced between reading the generation and opening it */
+	for( tries = 0; tries < 100; tries++ )
+	{
+		s->generation = __atomic_load_n(&s->control->generation, __ATOMIC_ACQUIRE);
+		lcfg_shared_name(image_name, sizeof(image_name), name, s->generation);
+
+		s->image_size = sizeof(struct lcfg_shared_header);
+		if( (s->image = lcfg_shared_map(image_name, &s->image_size)) != NULL || errno != ENOENT )
+		{
+			break;
+		}
+	}
+
+	h = (const struct lcfg_shared_header *)s->image;
+	if( h == NULL || h->magic != LCFG_SHARED_MAGIC || h->generation != s->generation || h->size > s->image_size ||
+		sizeof(struct lcfg_shared_header) + h->count * sizeof(struct lcfg_shared_entry) + h->hash_capacity * sizeof(uint64_t) > h->size )
+	{
+		lcfg_error_set(c, "%s: %s", image_name, h == NULL ? strerror(errno) : "invalid image");
+		lcfg_shared_detach(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+#define SHARED_HEADER(s) ((const struct lcfg_shared_header *)(s)->image)
+#define SHARED_ENTRIES(s) ((const struct lcfg_shared_entry *)((s)->image + sizeof(struct lcfg_shared_header)))
+#define SHARED_HASH(s) ((const uint64_t *)(SHARED_ENTRIES(s) + SHARED_HEADER(s)->count))
+
+enum lcfg_status lcfg_shared_get(struct lcfg_shared *s, const char *key, void **data, size_t *len)
+{
+	const struct lcfg_shared_entry *e = SHARED_ENTRIES(s);
+	const uint64_t *hash = SHARED_HASH(s);
+	uint64_t mask = SHARED_HEADER(s)->hash_capacity - 1;
+	uint64_t i;
+
+	for( i = lcfg_hash(key) & mask; hash[i] != 0; i = (i + 1) & mask )
+	{
+		if( !strcmp(s->image + e[hash[i] - 1].key, key) )
+		{
+			*data = (void *)(s->image + e[hash[i] - 1].value);
+			*len = e[hash[i] - 1].value_len;
+			return lcfg_status_ok;
+		}
+	}
+
+	return lcfg_status_error;
+}
+
+enum lcfg_status lcfg_shared_accept_subtree(struct lcfg_shared *s, const char *prefix, lcfg_visitor_function fn, void *user_data)
+{
+	const struct lcfg_shared_entry *e = SHARED_ENTRIES(s);
+	size_t prefix_len = strlen(prefix);
+	const char *key;
+	uint64_t i;
+
+	for( i = 0; i < SHARED_HEADER(s)->count; i++ )
+	{
+		key = s->image + e[i].key;
+
+		if( prefix_len != 0 && (strncmp(key, prefix, prefix_len) != 0 || (key[prefix_len] != '\0' && key[prefix_len] != '.')) )
+		{
+			continue;
+		}
+
+		if( fn(key, (void *)(s->image + e[i].value), e[i].value_len, user_data) != lcfg_status_ok )
+		{
+			return lcfg_status_error;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+/* batches are copied out of the entries */
+enum lcfg_status lcfg_shared_accept_batched(struct lcfg_shared *s, size_t batch_size, lcfg_batch_visitor_function fn, void *user_data)
+{
+	const struct lcfg_shared_entry *e = SHARED_ENTRIES(s);
+	const char *keys[LCFG_BATCH_SIZE];
+	size_t key_lens[LCFG_BATCH_SIZE];
+	const char *values[LCFG_BATCH_SIZE];
+	size_t value_lens[LCFG_BATCH_SIZE];
+	struct lcfg_batch b = { 0, keys, key_lens, values, value_lens };
+	uint64_t i;
+
+	if( batch_size > LCFG_BATCH_SIZE )
+	{
+		batch_size = LCFG_BATCH_SIZE;
+	}
+
+	for( i = 0; i < SHARED_HEADER(s)->count; i++ )
+	{
+		keys[b.count] = s->image + e[i].key;
+		key_lens[b.count] = strlen(keys[b.count]);
+		values[b.count] = s->image + e[i].value;
+		value_lens[b.count] = e[i].value_len;
+
+		if( ++b.count == batch_size || i + 1 == SHARED_HEADER(s)->count )
+		{
+			if( fn(&b, user_data) != lcfg_status_ok )
+			{
+				return lcfg_status_error;
+			}
+			b.count = 0;
+		}
+	}
+
+	return lcfg_status_ok;
+}
+
+/* entry number index, 0 if there is none */
+int lcfg_shared_entry(struct lcfg_shared *s, size_t index, struct lcfg_entry *entry)
+{
+	const struct lcfg_shared_entry *e = SHARED_ENTRIES(s);
+
+	if( index >= SHARED_HEADER(s)->count )
+	{
+		return 0;
+	}
+
+	entry->key = s->image + e[index].key;
+	entry->key_len = strlen(entry->key);
+	entry->value = s->image + e[index].value;
+	entry->value_len = e[index].value_len;
+
+	return 1;
+}
+
+size_t lcfg_shared_image_size(struct lcfg_shared *s)
+{
+	return s->image_size;
+}
+
+uint64_t lcfg_shared_image_generation(struct lcfg_shared *s)
+{
+	return s->generation;
+}
+
+int lcfg_shared_image_stale(struct lcfg_shared *s)
+{
+	return __atomic_load_n(&s->control->generation, __ATOMIC_ACQUIRE) != s->generation;
+}
+
+void lcfg_shared_detach(struct lcfg_shared *s)
+{
+	if( s->image != NULL )
+	{
+		munmap((void *)s->image, s->image_size);
+	}
+	if( s->control != NULL )
+	{
+		munmap((void *)s->control, sizeof(struct lcfg_shared_control));
+	}
+
+	lcfg_mem_free(s->mem, s, sizeof(struct lcfg_shared));
+}
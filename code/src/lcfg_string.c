@@ -29,15 +29,21 @@
 #include <string.h>
 
 #include "lcfg/lcfg_string.h"
+#include "lcfg/lcfg_mem.h"
+
+/* strings up to LCFG_STRING_SMALL - 1 bytes live in the struct itself */
+#define LCFG_STRING_SMALL 24
 
 struct lcfg_string
 {
-	char *str;
-	unsigned int size;
-	unsigned int capacity;
+	struct lcfg_mem *mem;
+	char *str;        /* small or a heap buffer */
+	size_t size;
+	size_t capacity;
+	char small[LCFG_STRING_SMALL];
 };
 
-int lcfg_string_set(struct lcfg_string *s, const char *cstr)
+size_t lcfg_string_set(struct lcfg_string *s, const char *cstr)
 {
 	lcfg_string_trunc(s, 0);
 	return lcfg_string_cat_cstr(s, cstr);
@@ -45,49 +51,69 @@ int lcfg_string_set(struct lcfg_string *s, const char *cstr)
 
 
 /* make sure new_size bytes fit into the string */
-inline static void lcfg_string_grow(struct lcfg_string *s, unsigned int new_size)
+inline static void lcfg_string_grow(struct lcfg_string *s, size_t new_size)
 {
 	/* always allocate one byte more than needed
 	 * to make _cstr() working in any case without realloc. */
-	while( (new_size + 1) > s->capacity )
+	size_t capacity = s->capacity;
+
+	while( (new_size + 1) > capacity )
+	{
+		capacity *= 2;
+	}
+
+	if( capacity != s->capacity && s->str == s->small )
 	{
-		s->capacity *= 2;
-		s->str = realloc(s->str, s->capacity);
+		s->str = lcfg_mem_alloc(s->mem, capacity);
+		memcpy(s->str, s->small, s->size);
+		s->capacity = capacity;
+	}
+	else if( capacity != s->capacity )
+	{
+		s->str = lcfg_mem_realloc(s->mem, s->str, s->capacity, capacity);
+		s->capacity = capacity;
 	}
 }
 
-struct lcfg_string *lcfg_string_new()
+struct lcfg_string *lcfg_string_new(struct lcfg_mem *m)
 {
-	struct lcfg_string *s = malloc(sizeof(struct lcfg_string));
-	assert(s);
+	struct lcfg_string *s = lcfg_mem_alloc(m, sizeof(struct lcfg_string));
 
-	s->capacity = 8;
+	s->mem = m;
+	s->capacity = LCFG_STRING_SMALL;
 	s->size = 0;
-	s->str = malloc(s->capacity);
-
-	assert(s->str);
+	s->str = s->small;
 
 	return s;
 }
 
 struct lcfg_string *lcfg_string_new_copy(struct lcfg_string *s)
 {
-	struct lcfg_string *s_new = malloc(sizeof(struct lcfg_string));
-	assert(s_new);
+	struct lcfg_string *s_new = lcfg_mem_alloc(s->mem, sizeof(struct lcfg_string));
 
-	s_new->capacity = s->capacity;
+	/* exact fit, the copy is usually not appended to */
+	s_new->mem = s->mem;
 	s_new->size = s->size;
-	s_new->str = malloc(s_new->capacity);
+	if( s->size < LCFG_STRING_SMALL )
+	{
+		s_new->capacity = LCFG_STRING_SMALL;
+		s_new->str = s_new->small;
+	}
+	else
+	{
+		s_new->capacity = s->size + 1;
+		s_new->str = lcfg_mem_alloc(s->mem, s_new->capacity);
+	}
 
 	memcpy(s_new->str, s->str, s_new->size);
 
 	return s_new;
 }
 
-int lcfg_string_cat_uint(struct lcfg_string *s, unsigned int i)
+size_t lcfg_string_cat_uint(struct lcfg_string *s, size_t i)
 {
-	unsigned int size_needed = 1;
-	unsigned int ii = i;
+	size_t size_needed = 1;
+	size_t ii = i;
 	char c;
 
 	while( ii >= 10 )
@@ -112,9 +138,9 @@ int lcfg_string_cat_uint(struct lcfg_string *s, unsigned int i)
 	return s->size;
 }
 
-int lcfg_string_find(struct lcfg_string *s, char c)
+ssize_t lcfg_string_find(struct lcfg_string *s, char c)
 {
-	int i;
+	size_t i;
 
 	for( i = 0; i < s->size; i++ )
 	{
@@ -127,11 +153,11 @@ int lcfg_string_find(struct lcfg_string *s, char c)
 	return -1;
 }
 
-int lcfg_string_rfind(struct lcfg_string *s, char c)
+ssize_t lcfg_string_rfind(struct lcfg_string *s, char c)
 {
-	int i;
+	ssize_t i;
 
-	for( i = s->size - 1; i >= 0; i-- )
+	for( i = (ssize_t)s->size - 1; i >= 0; i-- )
 	{
 		if( s->str[i] == c )
 		{
@@ -142,7 +168,7 @@ int lcfg_string_rfind(struct lcfg_string *s, char c)
 	return -1;
 }
 
-void lcfg_string_trunc(struct lcfg_string *s, unsigned int max_size)
+void lcfg_string_trunc(struct lcfg_string *s, size_t max_size)
 {
 	if( max_size < s->size )
 	{
@@ -150,20 +176,23 @@ void lcfg_string_trunc(struct lcfg_string *s, unsigned int max_size)
 	}
 }
 
-int lcfg_string_cat_cstr(struct lcfg_string *s, const char *cstr)
+size_t lcfg_string_cat_buf(struct lcfg_string *s, const char *buf, size_t len)
 {
-	size_t len = strlen(cstr);
-
 	lcfg_string_grow(s, s->size + len);
 
-	memcpy(s->str + s->size, cstr, len);
+	memcpy(s->str + s->size, buf, len);
 
 	s->size += len;
 
 	return s->size;
 }
 
-int lcfg_string_cat_char(struct lcfg_string *s, char c)
+size_t lcfg_string_cat_cstr(struct lcfg_string *s, const char *cstr)
+{
+	return lcfg_string_cat_buf(s, cstr, strlen(cstr));
+}
+
+size_t lcfg_string_cat_char(struct lcfg_string *s, char c)
 {
 	lcfg_string_grow(s, s->size + 1);
 
@@ -178,13 +207,16 @@ const char *lcfg_string_cstr(struct lcfg_string *s)
 	return s->str;
 }
 
-unsigned int lcfg_string_len(struct lcfg_string *s)
+size_t lcfg_string_len(struct lcfg_string *s)
 {
 	return s->size;
 }
 
 void lcfg_string_delete(struct lcfg_string *s)
 {
-	free(s->str);
-	free(s);
+	if( s->str != s->small )
+	{
+		lcfg_mem_free(s->mem, s->str, s->capacity);
+	}
+	lcfg_mem_free(s->mem, s, sizeof(struct lcfg_string));
 }
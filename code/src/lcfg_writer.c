@@ -0,0 +1,442 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "lcfg/lcfg_writer.h"
+
+#define WRITER_BUFFER_SIZE 0x10000
+
+/* escape character for every byte that cannot appear literally inside a
+ * string, 'x' for a hex escape. everything else is copied in runs. */
+static const char lcfg_writer_escapes[256] =
+{
+	'0', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 't', 'n', 'x', 'x', 'r', 'x', 'x',
+	'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x',
+	0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'x',
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char lcfg_writer_tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+void lcfg_writer_init(struct lcfg_writer *w, struct lcfg_mem *m, int fd)
+{
+	memset(w, 0, sizeof(struct lcfg_writer));
+	w->mem = m;
+	w->fd = fd;
+}
+
+static void lcfg_writer_flush(struct lcfg_writer *w, const char *data, size_t len)
+{
+	ssize_t n;
+
+	while( len > 0 && w->error == 0 )
+	{
+		n = write(w->fd, data, len);
+
+		if( n < 0 && errno != EINTR )
+		{
+			w->error = errno;
+		}
+		else if( n > 0 )
+		{
+			data += n;
+			len -= n;
+		}
+	}
+}
+
+/* make room for len more bytes, 0 if the data has to bypass the buffer */
+static int lcfg_writer_reserve(struct lcfg_writer *w, size_t len)
+{
+	size_t capacity = w->capacity == 0 ? WRITER_BUFFER_SIZE : w->capacity;
+	char *buf;
+
+	if( w->fd >= 0 )
+	{
+		lcfg_writer_flush(w, w->buf, w->len);
+		w->len = 0;
+
+		if( len > capacity )
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		while( capacity - w->len < len )
+		{
+			capacity *= 2;
+		}
+	}
+
+	if( capacity != w->capacity )
+	{
+		buf = w->buf == NULL ? lcfg_mem_try_alloc(w->mem, capacity) : lcfg_mem_try_realloc(w->mem, w->buf, w->capacity, capacity);
+		if( buf == NULL )
+		{
+			w->error = ENOMEM;
+			return 0;
+		}
+		w->buf = buf;
+		w->capacity = capacity;
+	}
+
+	return !0;
+}
+
+void lcfg_writer_raw(struct lcfg_writer *w, const void *data, size_t len)
+{
+	if( w->error != 0 )
+	{
+		return;
+	}
+
+	if( w->capacity - w->len < len && !lcfg_writer_reserve(w, len) )
+	{
+		if( w->fd >= 0 )
+		{
+			lcfg_writer_flush(w, data, len);
+		}
+		return;
+	}
+
+	memcpy(w->buf + w->len, data, len);
+	w->len += len;
+}
+
+void lcfg_writer_string(struct lcfg_writer *w, const void *data, size_t len)
+{
+	const unsigned char *s = data;
+	const char hex[] = "0123456789abcdef";
+	char escape[4] = { '\\', 'x', 0, 0 };
+	size_t i = 0, start;
+
+	lcfg_writer_raw(w, "\"", 1);
+
+	while( i < len )
+	{
+		start = i;
+		while( i < len && lcfg_writer_escapes[s[i]] == 0 )
+		{
+			i++;
+		}
+		lcfg_writer_raw(w, s + start, i - start);
+
+		if( i < len )
+		{
+			escape[1] = lcfg_writer_escapes[s[i]];
+			if( escape[1] == 'x' )
+			{
+				escape[2] = hex[s[i] >> 4];
+				escape[3] = hex[s[i] & 0xf];
+				lcfg_writer_raw(w, escape, 4);
+			}
+			else
+			{
+				lcfg_writer_raw(w, escape, 2);
+			}
+			i++;
+		}
+	}
+
+	lcfg_writer_raw(w, "\"", 1);
+}
+
+static void lcfg_writer_indent(struct lcfg_writer *w, size_t depth)
+{
+	size_t n;
+
+	while( depth > 0 )
+	{
+		n = depth < sizeof(lcfg_writer_tabs) - 1 ? depth : sizeof(lcfg_writer_tabs) - 1;
+		lcfg_writer_raw(w, lcfg_writer_tabs, n);
+		depth -= n;
+	}
+}
+
+void lcfg_writer_item(struct lcfg_writer *w, size_t depth, const char *key, int sibling)
+{
+	if( w->line_open )
+	{
+		lcfg_writer_raw(w, sibling ? ",\n" : "\n", sibling ? 2 : 1);
+	}
+
+	lcfg_writer_indent(w, depth);
+
+	if( key != NULL )
+	{
+		lcfg_writer_raw(w, key, strlen(key));
+		lcfg_writer_raw(w, " = ", 3);
+	}
+
+	w->line_open = !0;
+}
+
+void lcfg_writer_close(struct lcfg_writer *w, size_t depth, char bracket)
+{
+	lcfg_writer_raw(w, "\n", 1);
+	lcfg_writer_indent(w, depth);
+	lcfg_writer_raw(w, &bracket, 1);
+}
+
+/* the containers enclosing the last value written by lcfg_writer_config() */
+struct lcfg_writer_level
+{
+	const char *name;   /* points into path */
+	size_t name_len;
+	int list;
+	size_t count;       /* elements written so far */
+};
+
+struct lcfg_writer_state
+{
+	struct lcfg_writer *w;
+	char *path;         /* key of the last value */
+	size_t path_capacity;
+	struct lcfg_writer_level *levels;
+	size_t depth;
+	size_t capacity;
+};
+
+static int lcfg_writer_is_index(const char *name, size_t len)
+{
+	/* identifiers start with a letter, list indices are numbers */
+	return len > 0 && name[0] >= '0' && name[0] <= '9';
+}
+
+static enum lcfg_status lcfg_writer_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct lcfg_writer_state *st = user_data;
+	struct lcfg_writer *w = st->w;
+	size_t key_len = strlen(key);
+	size_t common, i, n;
+	const char *name, *end;
+	struct lcfg_writer_level *level;
+
+	if( key_len + 1 > st->path_capacity )
+	{
+		/* level names point into path, keep them valid */
+		char *path = lcfg_mem_try_alloc(w->mem, key_len + 1);
+
+		if( path == NULL )
+		{
+			w->error = ENOMEM;
+			return lcfg_status_error;
+		}
+		for( i = 0; i < st->depth; i++ )
+		{
+			st->levels[i].name = path + (st->levels[i].name - st->path);
+		}
+		if( st->path != NULL )
+		{
+			memcpy(path, st->path, st->path_capacity);
+			lcfg_mem_free(w->mem, st->path, st->path_capacity);
+		}
+		st->path = path;
+		st->path_capacity = key_len + 1;
+	}
+
+	/* how many enclosing containers are still open */
+	name = key;
+	for( common = 0; common < st->depth; common++ )
+	{
+		end = strchr(name, '.');
+		if( end == NULL || (size_t)(end - name) != st->levels[common].name_len || memcmp(name, st->levels[common].name, end - name) != 0 )
+		{
+			break;
+		}
+		name = end + 1;
+	}
+
+	while( st->depth > common )
+	{
+		st->depth--;
+		lcfg_writer_close(w, st->depth, st->levels[st->depth].list ? ']' : '}');
+	}
+
+	memcpy(st->path, key, key_len + 1);
+	name = st->path + (name - key);
+
+	/* open the containers down to the value */
+	for( ;; )
+	{
+		end = strchr(name, '.');
+		n = end == NULL ? strlen(name) : (size_t)(end - name);
+		level = st->depth > 0 ? &st->levels[st->depth - 1] : NULL;
+
+		if( level != NULL && level->list )
+		{
+			lcfg_writer_item(w, st->depth, NULL, level->count > 0);
+		}
+		else
+		{
+			lcfg_writer_item(w, st->depth, NULL, 0);
+			lcfg_writer_raw(w, name, n);
+			lcfg_writer_raw(w, " = ", 3);
+		}
+		if( level != NULL )
+		{
+			level->count++;
+		}
+
+		if( end == NULL )
+		{
+			break;
+		}
+
+		if( st->depth == st->capacity )
+		{
+			size_t capacity = st->capacity == 0 ? 8 : st->capacity * 2;
+			level = st->levels == NULL ? lcfg_mem_try_alloc(w->mem, capacity * sizeof(struct lcfg_writer_level)) :
+				lcfg_mem_try_realloc(w->mem, st->levels, st->capacity * sizeof(struct lcfg_writer_level), capacity * sizeof(struct lcfg_writer_level));
+
+			if( level == NULL )
+			{
+				w->error = ENOMEM;
+				return lcfg_status_error;
+			}
+			st->levels = level;
+			st->capacity = capacity;
+		}
+
+		level = &st->levels[st->depth++];
+		level->name = name;
+		level->name_len = n;
+		level->list = lcfg_writer_is_index(end + 1, strcspn(end + 1, "."));
+		level->count = 0;
+		lcfg_writer_raw(w, level->list ? "[" : "{", 1);
+
+		name = end + 1;
+	}
+
+	lcfg_writer_string(w, data, len);
+
+	return w->error == 0 ? lcfg_status_ok : lcfg_status_error;
+}
+
+enum lcfg_status lcfg_writer_config(struct lcfg_writer *w, struct lcfg *c)
+{
+	struct lcfg_writer_state st;
+	enum lcfg_status status;
+
+	memset(&st, 0, sizeof(st));
+	st.w = w;
+
+	status = lcfg_accept(c, lcfg_writer_visitor, &st);
+
+	while( st.depth > 0 )
+	{
+		st.depth--;
+		lcfg_writer_close(w, st.depth, st.levels[st.depth].list ? ']' : '}');
+	}
+
+	if( st.path != NULL )
+	{
+		lcfg_mem_free(w->mem, st.path, st.path_capacity);
+	}
+	if( st.levels != NULL )
+	{
+		lcfg_mem_free(w->mem, st.levels, st.capacity * sizeof(struct lcfg_writer_level));
+	}
+
+	return status;
+}
+
+enum lcfg_status lcfg_writer_finish(struct lcfg_writer *w, char **buf, size_t *len)
+{
+	char *shrunk;
+
+	if( w->line_open )
+	{
+		lcfg_writer_raw(w, "\n", 1);
+	}
+
+	if( w->fd >= 0 )
+	{
+		lcfg_writer_flush(w, w->buf, w->len);
+	}
+	else
+	{
+		*buf = NULL;
+		*len = 0;
+		lcfg_writer_raw(w, "", 1);
+
+		/* exact size, so that the caller knows what to free */
+		if( w->error == 0 && w->len != w->capacity )
+		{
+			if( (shrunk = lcfg_mem_try_realloc(w->mem, w->buf, w->capacity, w->len)) == NULL )
+			{
+				w->error = ENOMEM;
+			}
+			else
+			{
+				w->buf = shrunk;
+				w->capacity = w->len;
+			}
+		}
+
+		if( w->error == 0 )
+		{
+			*buf = w->buf;
+			*len = w->len - 1;
+			w->buf = NULL;
+		}
+	}
+
+	if( w->buf != NULL )
+	{
+		lcfg_mem_free(w->mem, w->buf, w->capacity);
+		w->buf = NULL;
+	}
+
+	return w->error == 0 ? lcfg_status_ok : lcfg_status_error;
+}
+
+void lcfg_writer_free(struct lcfg_writer *w, char **buf, size_t *len)
+{
+	if( *buf != NULL )
+	{
+		lcfg_mem_free(w->mem, *buf, *len + 1);
+	}
+
+	*buf = NULL;
+	*len = 0;
+}
@@ -25,18 +25,64 @@
   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include <lcfgx/lcfgx_tree.h>
+#include "lcfg/lcfg_mem.h"
+#include "lcfg/lcfg_parser.h"
+#include "lcfg/lcfg_writer.h"
 
-static struct lcfgx_tree_node *lcfgx_tree_node_new(enum lcfgx_type type, const char *key)
+struct lcfgx_tree_builder
 {
-	struct lcfgx_tree_node *node = malloc(sizeof(struct lcfgx_tree_node));
+	struct lcfgx_tree_node *root;
+	struct lcfg_mem *mem;
+};
+
+/* the root node is embedded in this so that lcfgx_tree_delete()
+ * finds the allocator the tree was built with */
+struct lcfgx_tree
+{
+	struct lcfgx_tree_node root;
+	struct lcfg_mem mem;
+
+	/* set for trees of lazily parsed configs, top-level subtrees are
+	 * built by lcfgx_get() when first looked up */
+	struct lcfg *lazy;
+	pthread_mutex_t lock;
+};
+
+/* every other node is embedded in this, so that lcfgx_tree_delete() can
+ * be passed any subtree */
+struct lcfgx_tree_entry
+{
+	struct lcfg_mem *mem;
+	struct lcfgx_tree_node node;
+};
+
+#define LCFGX_TREE_ENTRY(n) ((struct lcfgx_tree_entry *)((char *)(n) - offsetof(struct lcfgx_tree_entry, node)))
+
+/* the allocator of the tree that node belongs to */
+static struct lcfg_mem *lcfgx_tree_mem(struct lcfgx_tree_node *node)
+{
+	if( node->key == NULL )
+		return &((struct lcfgx_tree *)node)->mem;
+
+	return LCFGX_TREE_ENTRY(node)->mem;
+}
+
+static struct lcfgx_tree_node *lcfgx_tree_node_new(struct lcfg_mem *m, enum lcfgx_type type, const char *key)
+{
+	struct lcfgx_tree_entry *entry = lcfg_mem_alloc(m, sizeof(struct lcfgx_tree_entry));
+	struct lcfgx_tree_node *node = &entry->node;
 
+	entry->mem = m;
 	node->type = type;
 
 	if( key != NULL )
-		node->key = strdup(key);
+		node->key = lcfg_mem_strdup(m, key);
 	else
 		node->key = NULL;
 
@@ -48,23 +94,10 @@ static struct lcfgx_tree_node *lcfgx_tree_node_new(enum lcfgx_type type, const c
 
 void lcfgx_tree_dump(struct lcfgx_tree_node *node, int depth)
 {
-//	printf("%s node %p node->key %s depth %i\n", __PRETTY_FUNCTION__, node, node->key, depth);
-	void sp(int n)
-	{
-		int i;
-
-		for( i = 0; i < n; i++ )
-			printf("%c", ' ');
-	}
-
-	sp(depth);
-	if( node->key != NULL )
-		printf("%s", node->key);
-	else
-		printf("%s", "(none)");
-
 	struct lcfgx_tree_node *n;
 
+	printf("%*s%s", depth, "", node->key != NULL ? node->key : "(none)");
+
 	switch( node->type )
 	{
 		case lcfgx_string:
@@ -73,7 +106,7 @@ void lcfgx_tree_dump(struct lcfgx_tree_node *node, int depth)
 
 		case lcfgx_list:
 		case lcfgx_map:
-			printf("%c", '\n');
+			putchar('\n');
 			n = node->value.elements;
 			for( ; n != NULL; n = n->next )
 				lcfgx_tree_dump(n, depth + 2);
@@ -81,7 +114,67 @@ void lcfgx_tree_dump(struct lcfgx_tree_node *node, int depth)
 	}
 }
 
-static void lcfgx_tree_insert(int pathc, char **pathv, void *data, size_t len, struct lcfgx_tree_node *node)
+static void lcfgx_tree_write_node(struct lcfg_writer *w, struct lcfgx_tree_node *node, size_t depth, const char *key, int sibling)
+{
+	struct lcfgx_tree_node *n;
+
+	lcfg_writer_item(w, depth, key, sibling);
+
+	if( node->type == lcfgx_string )
+	{
+		lcfg_writer_string(w, node->value.string.data, node->value.string.len);
+		return;
+	}
+
+	lcfg_writer_raw(w, node->type == lcfgx_list ? "[" : "{", 1);
+	for( n = node->value.elements; n != NULL; n = n->next )
+	{
+		if( node->type == lcfgx_list )
+			lcfgx_tree_write_node(w, n, depth + 1, NULL, n != node->value.elements);
+		else
+			lcfgx_tree_write_node(w, n, depth + 1, n->key, 0);
+	}
+	lcfg_writer_close(w, depth, node->type == lcfgx_list ? ']' : '}');
+}
+
+static enum lcfg_status lcfgx_tree_write_to(struct lcfgx_tree_node *node, int fd, char **buf, size_t *len)
+{
+	struct lcfgx_tree *tree = (struct lcfgx_tree *)node;
+	struct lcfgx_tree_node *n;
+	struct lcfg_writer w;
+	enum lcfg_status status = lcfg_status_ok;
+
+	lcfg_writer_init(&w, lcfgx_tree_mem(node), fd);
+
+	/* a map is written as its statements, anything else as one statement */
+	if( node->key == NULL && tree->lazy != NULL )
+		status = lcfg_writer_config(&w, tree->lazy);
+	else if( node->type == lcfgx_map )
+		for( n = node->value.elements; n != NULL; n = n->next )
+			lcfgx_tree_write_node(&w, n, 0, n->key, 0);
+	else
+		lcfgx_tree_write_node(&w, node, 0, node->key, 0);
+
+	if( lcfg_writer_finish(&w, buf, len) != lcfg_status_ok )
+		return lcfg_status_error;
+
+	if( status != lcfg_status_ok && buf != NULL )
+		lcfg_writer_free(&w, buf, len);
+
+	return status;
+}
+
+enum lcfg_status lcfgx_tree_write(struct lcfgx_tree_node *node, int fd)
+{
+	return lcfgx_tree_write_to(node, fd, NULL, NULL);
+}
+
+enum lcfg_status lcfgx_tree_write_buffer(struct lcfgx_tree_node *node, char **buf, size_t *len)
+{
+	return lcfgx_tree_write_to(node, -1, buf, len);
+}
+
+static void lcfgx_tree_insert(struct lcfg_mem *m, int pathc, char **pathv, void *data, size_t len, struct lcfgx_tree_node *node)
 {
 	struct lcfgx_tree_node *n;
 
@@ -95,9 +188,9 @@ static void lcfgx_tree_insert(int pathc, char **pathv, void *data, size_t len, s
 		if( n == NULL )
 		{
 			/* not found, insert */
-			n = lcfgx_tree_node_new(lcfgx_string, pathv[0]);
+			n = lcfgx_tree_node_new(m, lcfgx_string, pathv[0]);
 			n->value.string.len = len;
-			n->value.string.data = malloc(len+1);
+			n->value.string.data = lcfg_mem_alloc(m, len+1);
 			memset(n->value.string.data, 0, len+1);
 			memcpy(n->value.string.data, data, len);
 			n->next = NULL;
@@ -119,7 +212,7 @@ static void lcfgx_tree_insert(int pathc, char **pathv, void *data, size_t len, s
 		if( n == NULL )
 		{
 			/* not found, insert it */
-			n = lcfgx_tree_node_new(lcfgx_map, pathv[0]);
+			n = lcfgx_tree_node_new(m, lcfgx_map, pathv[0]);
 			n->value.elements = NULL;
 			n->next = NULL;
 			if ( node->value.elements != NULL )
@@ -135,13 +228,13 @@ static void lcfgx_tree_insert(int pathc, char **pathv, void *data, size_t len, s
 		}
 
 		/* recurse into map/list */
-		lcfgx_tree_insert(pathc - 1, &pathv[1], data, len, n);
+		lcfgx_tree_insert(m, pathc - 1, &pathv[1], data, len, n);
 	}
 }
 
 enum lcfg_status lcfgx_tree_visitor(const char *key, void *data, size_t len, void *user_data)
 {
-	struct lcfgx_tree_node *root = user_data;
+	struct lcfgx_tree_builder *builder = user_data;
 	char path[strlen(key) + 1];
 	int path_components = 1;
 
@@ -159,7 +252,7 @@ enum lcfg_status lcfgx_tree_visitor(const char *key, void *data, size_t len, voi
 	while( (token = strtok_r(pathc == 0 ? path : NULL, ".", &saveptr)) != NULL )
 		pathv[pathc++] = token;
 
-	lcfgx_tree_insert(pathc, pathv, data, len, root);
+	lcfgx_tree_insert(builder->mem, pathc, pathv, data, len, builder->root);
 
 	return lcfg_status_ok;
 }
@@ -193,16 +286,55 @@ void lcfgx_correct_type(struct lcfgx_tree_node *node)
 
 struct lcfgx_tree_node *lcfgx_tree_new(struct lcfg *c)
 {
-	struct lcfgx_tree_node *root = lcfgx_tree_node_new(lcfgx_map, NULL);
+	return lcfgx_tree_new_allocator(c, &lcfg_mem_get(c)->allocator);
+}
+
+struct lcfgx_tree_node *lcfgx_tree_new_allocator(struct lcfg *c, const struct lcfg_allocator *a)
+{
+	struct lcfgx_tree_builder builder;
+	struct lcfgx_tree *tree;
+	struct lcfg_mem mem;
+	struct lcfg_stats *stats = lcfg_mem_get(c)->stats;
+	double start = 0.0;
+
+	if( stats != NULL )
+		start = lcfg_stats_clock();
+
+	lcfg_mem_init(&mem, a);
+	mem.stats = stats;
+
+	tree = lcfg_mem_alloc(&mem, sizeof(struct lcfgx_tree));
+	tree->mem = mem;
+	tree->root.type = lcfgx_map;
+	tree->root.key = NULL;
+	tree->root.value.elements = NULL;
+	tree->root.next = NULL;
+
+	builder.mem = &tree->mem;
+	builder.root = &tree->root;
 
-	root->value.elements = NULL;
+	if( lcfg_is_lazy(c) )
+	{
+		tree->lazy = c;
+		pthread_mutex_init(&tree->lock, NULL);
+	}
+	else
+	{
+		tree->lazy = NULL;
+		lcfg_accept(c, lcfgx_tree_visitor, &builder);
+		lcfgx_correct_type(builder.root);
+	}
+
+	/* the tree may outlive c, drop the reference to its statistics */
+	tree->mem.stats = NULL;
 
-	lcfg_accept(c, lcfgx_tree_visitor, root);
-	lcfgx_correct_type(root);
-	return root;
+	if( stats != NULL )
+		stats->build_time += lcfg_stats_clock() - start;
+
+	return builder.root;
 }
 
-void lcfgx_tree_delete(struct lcfgx_tree_node *n)
+static void lcfgx_tree_node_delete(struct lcfg_mem *mem, struct lcfgx_tree_node *n)
 {
 
 	if( n->type != lcfgx_string )
@@ -212,19 +344,40 @@ void lcfgx_tree_delete(struct lcfgx_tree_node *n)
 		for( m = n->value.elements; m != NULL; )
 		{
 			next = m->next;
-			lcfgx_tree_delete(m);
+			lcfgx_tree_node_delete(mem, m);
 			m = next;
 		}
 	}
 	else
 	{
-		free(n->value.string.data);
+		lcfg_mem_free(mem, n->value.string.data, n->value.string.len + 1);
 	}
 
 	if( n->key != NULL )
-		free(n->key);
+	{
+		lcfg_mem_free(mem, n->key, strlen(n->key) + 1);
+		lcfg_mem_free(mem, LCFGX_TREE_ENTRY(n), sizeof(struct lcfgx_tree_entry));
+	}
+}
+
+void lcfgx_tree_delete(struct lcfgx_tree_node *root)
+{
+	struct lcfgx_tree *tree = (struct lcfgx_tree *)root;
+	struct lcfg_mem mem;
 
-	free(n);
+	if( root->key != NULL )
+	{
+		lcfgx_tree_node_delete(lcfgx_tree_mem(root), root);
+		return;
+	}
+
+	mem = tree->mem;
+
+	if( tree->lazy != NULL )
+		pthread_mutex_destroy(&tree->lock);
+
+	lcfgx_tree_node_delete(&mem, root);
+	lcfg_mem_free(&mem, tree, sizeof(struct lcfgx_tree));
 }
 
 const char *lcfgx_path_access_strings[] =
@@ -256,7 +409,27 @@ struct lcfgx_tree_node *cfg_get_recursive(struct lcfgx_tree_node *node, int path
 }
 
 
-enum lcfgx_path_access lcfgx_get(struct lcfgx_tree_node *root, struct lcfgx_tree_node **n, const char *key, enum lcfgx_type type)
+/* build the subtree of a top-level key of a lazy tree, unless already done */
+static void lcfgx_tree_materialize(struct lcfgx_tree *tree, const char *top)
+{
+	struct lcfgx_tree_builder builder;
+	struct lcfgx_tree_node *it;
+
+	for( it = tree->root.value.elements; it != NULL; it = it->next )
+		if( strcmp(top, it->key) == 0 )
+			return;
+
+	builder.mem = &tree->mem;
+	builder.root = &tree->root;
+
+	lcfg_accept_subtree(tree->lazy, top, lcfgx_tree_visitor, &builder);
+
+	for( it = tree->root.value.elements; it != NULL; it = it->next )
+		if( strcmp(top, it->key) == 0 )
+			lcfgx_correct_type(it);
+}
+
+static enum lcfgx_path_access lcfgx_get_unlocked(struct lcfgx_tree_node *root, struct lcfgx_tree_node **n, const char *key, enum lcfgx_type type)
 {
 	char path[strlen(key) + 1];
 	int path_components = 1;
@@ -277,6 +450,10 @@ enum lcfgx_path_access lcfgx_get(struct lcfgx_tree_node *root, struct lcfgx_tree
 
 
 	struct lcfgx_tree_node *node;
+	struct lcfgx_tree *tree = (struct lcfgx_tree *)root;
+
+	if( pathc > 0 && root->key == NULL && tree->lazy != NULL )
+		lcfgx_tree_materialize(tree, pathv[0]);
 
 	if( pathc == 0 )
 		node = root;
@@ -294,6 +471,22 @@ enum lcfgx_path_access lcfgx_get(struct lcfgx_tree_node *root, struct lcfgx_tree
 	return LCFGX_PATH_FOUND_TYPE_OK;
 }
 
+enum lcfgx_path_access lcfgx_get(struct lcfgx_tree_node *root, struct lcfgx_tree_node **n, const char *key, enum lcfgx_type type)
+{
+	struct lcfgx_tree *tree = (struct lcfgx_tree *)root;
+	enum lcfgx_path_access axs;
+
+	/* only the root node of a tree carries the lcfgx_tree header */
+	if( root->key != NULL || tree->lazy == NULL )
+		return lcfgx_get_unlocked(root, n, key, type);
+
+	pthread_mutex_lock(&tree->lock);
+	axs = lcfgx_get_unlocked(root, n, key, type);
+	pthread_mutex_unlock(&tree->lock);
+
+	return axs;
+}
+
 enum lcfgx_path_access lcfgx_get_list(struct lcfgx_tree_node *root, struct lcfgx_tree_node **n, const char *key)
 {
 	return lcfgx_get(root, n, key, lcfgx_list);
@@ -25,9 +25,24 @@
   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
 #include <check.h>
 #include "../include/lcfg/lcfg.h"
+#include "../include/lcfg/lcfg_mem.h"
+#include "../include/lcfg/lcfg_string.h"
+#include "../include/lcfgx/lcfgx_tree.h"
 
 struct conf_value
 {
@@ -107,12 +122,1354 @@ START_TEST(test_example)
 }
 END_TEST
 
+static int count_visitor_total;
+
+static enum lcfg_status count_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	count_visitor_total++;
+	return lcfg_status_ok;
+}
+
+/* more than 2^16 lines must neither wrap error positions nor drop values */
+START_TEST(test_large_file)
+{
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	const int lines = 70000;
+	int fd = mkstemp(filename);
+	int i;
+
+	fail_unless(fd >= 0, "mkstemp failed");
+
+	FILE *f = fdopen(fd, "w");
+	for( i = 0; i < lines; i++ )
+	{
+		fprintf(f, "key%d = \"value %d\"\n", i, i);
+	}
+	fclose(f);
+
+	struct lcfg *c = lcfg_new(filename);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok,
+		"could not parse file: %s", lcfg_error_get(c));
+
+	count_visitor_total = 0;
+	lcfg_accept(c, count_visitor, NULL);
+	fail_unless(count_visitor_total == lines,
+		"expected %d values, got %d", lines, count_visitor_total);
+
+	void *data;
+	size_t len;
+	fail_unless(lcfg_value_get(c, "key69999", &data, &len) == lcfg_status_ok, NULL);
+	fail_unless(len == 11 && !memcmp(data, "value 69999", len), NULL);
+	lcfg_delete(c);
+
+	/* append a statement without `=' and check the reported position */
+	f = fopen(filename, "a");
+	fprintf(f, "broken \"value\"\n");
+	fclose(f);
+
+	c = lcfg_new(filename);
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	fail_unless(strstr(lcfg_error_get(c), "line 70001 ") != NULL,
+		"wrong error position: %s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	unlink(filename);
+}
+END_TEST
+
+START_TEST(test_stats)
+{
+	struct lcfg *c = lcfg_new("conf/example.conf");
+
+	fail_unless(lcfg_stats_get(c) == NULL, NULL);
+	lcfg_stats_enable(c);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok,
+		"could not parse file: %s", lcfg_error_get(c));
+
+	const struct lcfg_stats *stats = lcfg_stats_get(c);
+	fail_unless(stats != NULL, NULL);
+	fail_unless(stats->values == 13, "expected 13 values, got %zu", stats->values);
+	fail_unless(stats->max_depth == 4, "expected depth 4, got %zu", stats->max_depth);
+	fail_unless(stats->bytes_read > 0 && stats->read_calls > 0, NULL);
+	fail_unless(stats->allocations > 0 && stats->bytes_allocated > 0, NULL);
+	fail_unless(!strcmp(lcfg_stats_token_name(1), "T_IDENTIFIER"), NULL);
+	fail_unless(stats->tokens[1] == 10, "expected 10 identifiers, got %zu", stats->tokens[1]);
+	fail_unless(lcfg_stats_token_name(LCFG_STATS_TOKEN_TYPES) == NULL, NULL);
+
+	lcfg_delete(c);
+}
+END_TEST
+
+struct counting_allocator
+{
+	size_t allocations;
+	size_t frees;
+	size_t bytes;
+	size_t limit;   /* of bytes, 0 for none */
+};
+
+static void *counting_alloc(void *ctx, size_t size)
+{
+	struct counting_allocator *a = ctx;
+
+	if( a->limit != 0 && a->bytes + size > a->limit )
+		return NULL;
+
+	a->allocations++;
+	a->bytes += size;
+
+	return malloc(size);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+	struct counting_allocator *a = ctx;
+
+	if( a->limit != 0 && new_size > old_size && a->bytes + new_size - old_size > a->limit )
+		return NULL;
+
+	a->allocations++;
+	a->frees++;
+	a->bytes += new_size - old_size;
+
+	return realloc(ptr, new_size);
+}
+
+static void counting_free(void *ctx, void *ptr, size_t size)
+{
+	struct counting_allocator *a = ctx;
+
+	a->frees++;
+	a->bytes -= size;
+
+	free(ptr);
+}
+
+/* every byte must be allocated through the hooks and returned with the right size */
+START_TEST(test_allocator)
+{
+	struct counting_allocator counter = { 0, 0, 0 };
+	struct counting_allocator tree_counter = { 0, 0, 0 };
+	struct lcfg_allocator a = { counting_alloc, counting_realloc, counting_free, &counter };
+	struct lcfg_allocator tree_a = { counting_alloc, counting_realloc, counting_free, &tree_counter };
+
+	struct lcfg *c = lcfg_new_allocator("conf/example.conf", &a);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok,
+		"could not parse file: %s", lcfg_error_get(c));
+	fail_unless(counter.allocations > 0, NULL);
+
+	struct lcfgx_tree_node *root = lcfgx_tree_new_allocator(c, &tree_a);
+	fail_unless(tree_counter.allocations > 0, NULL);
+
+	struct lcfgx_tree_node *n;
+	fail_unless(lcfgx_get_string(root, &n, "map-value.foo") == LCFGX_PATH_FOUND_TYPE_OK, NULL);
+	fail_unless(!strcmp(n->value.string.data, "bar"), NULL);
+
+	/* the written buffer is exactly len + 1 bytes from the allocator */
+	char *buf;
+	size_t len;
+	fail_unless(lcfg_write_buffer(c, &buf, &len) == lcfg_status_ok, NULL);
+	counting_free(&counter, buf, len + 1);
+
+	counter.limit = counter.bytes + 16;
+	fail_unless(lcfg_write_buffer(c, &buf, &len) != lcfg_status_ok, NULL);
+	fail_unless(buf == NULL && len == 0, NULL);
+	counter.limit = 0;
+
+	lcfg_delete(c);
+	fail_unless(counter.bytes == 0, "%zu bytes leaked", counter.bytes);
+	fail_unless(counter.allocations == counter.frees, NULL);
+
+	/* a subtree can be deleted on its own once it is unlinked */
+	size_t bytes = tree_counter.bytes;
+	fail_unless(lcfgx_get_map(root, &n, "map-value") == LCFGX_PATH_FOUND_TYPE_OK, NULL);
+	struct lcfgx_tree_node **link = &root->value.elements;
+	while( *link != n )
+		link = &(*link)->next;
+	*link = n->next;
+	n->next = NULL;
+	lcfgx_tree_delete(n);
+	fail_unless(tree_counter.bytes < bytes, NULL);
+	fail_unless(lcfgx_get_map(root, &n, "map-value") == LCFGX_PATH_NOT_FOUND, NULL);
+
+	lcfgx_tree_delete(root);
+	fail_unless(tree_counter.bytes == 0, "%zu tree bytes leaked", tree_counter.bytes);
+	fail_unless(tree_counter.allocations == tree_counter.frees, NULL);
+}
+END_TEST
+
+/* parse n statements that produce tokens but no values, return allocations */
+static size_t count_token_allocations(int n)
+{
+	struct counting_allocator counter = { 0, 0, 0 };
+	struct lcfg_allocator a = { counting_alloc, counting_realloc, counting_free, &counter };
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	int fd = mkstemp(filename);
+	int i;
+
+	FILE *f = fdopen(fd, "w");
+	for( i = 0; i < n; i++ )
+	{
+		fprintf(f, "k%d = { } l%d = [ [ ], { } ] // comment\n", i % 10, i % 10);
+	}
+	fclose(f);
+
+	struct lcfg *c = lcfg_new_allocator(filename, &a);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok,
+		"could not parse file: %s", lcfg_error_get(c));
+	lcfg_delete(c);
+	unlink(filename);
+
+	return counter.allocations;
+}
+
+/* tokenization must not allocate once buffers have reached their size */
+START_TEST(test_token_allocations)
+{
+	size_t small = count_token_allocations(10);
+	size_t large = count_token_allocations(10000);
+
+	fail_unless(small == large,
+		"allocations grow with token count: %zu vs %zu", small, large);
+}
+END_TEST
+
+/* short strings live in the struct, longer ones move to the heap intact */
+START_TEST(test_string_allocations)
+{
+	struct counting_allocator counter = { 0, 0, 0, 0 };
+	struct lcfg_allocator a = { counting_alloc, counting_realloc, counting_free, &counter };
+	const char *long_value = "a value of more than 23 bytes, which does not fit inline";
+	struct lcfg_string *s, *copy;
+	struct lcfg_mem m;
+	size_t i;
+
+	lcfg_mem_init(&m, &a);
+
+	s = lcfg_string_new(&m);
+	fail_unless(counter.allocations == 1, NULL);
+	lcfg_string_cat_cstr(s, "server.port");
+	lcfg_string_cat_char(s, '.');
+	lcfg_string_cat_uint(s, 8080);
+	fail_unless(counter.allocations == 1, "%zu", counter.allocations);
+	fail_unless(!strcmp(lcfg_string_cstr(s), "server.port.8080"), "%s", lcfg_string_cstr(s));
+
+	copy = lcfg_string_new_copy(s);
+	fail_unless(counter.allocations == 2, "%zu", counter.allocations);
+	fail_unless(!strcmp(lcfg_string_cstr(copy), "server.port.8080"), "%s", lcfg_string_cstr(copy));
+	lcfg_string_delete(copy);
+
+	/* one allocation moves it to the heap, byte by byte growth reallocates */
+	lcfg_string_set(s, "");
+	for( i = 0; long_value[i] != '\0'; i++ )
+	{
+		lcfg_string_cat_char(s, long_value[i]);
+	}
+	fail_unless(!strcmp(lcfg_string_cstr(s), long_value), "%s", lcfg_string_cstr(s));
+	fail_unless(lcfg_string_len(s) == strlen(long_value), NULL);
+
+	copy = lcfg_string_new_copy(s);
+	fail_unless(!strcmp(lcfg_string_cstr(copy), long_value), "%s", lcfg_string_cstr(copy));
+	lcfg_string_trunc(copy, 5);
+	fail_unless(!strcmp(lcfg_string_cstr(copy), "a val"), "%s", lcfg_string_cstr(copy));
+	lcfg_string_delete(copy);
+
+	lcfg_string_delete(s);
+	fail_unless(counter.bytes == 0, "%zu bytes leaked", counter.bytes);
+	fail_unless(counter.allocations == counter.frees, NULL);
+}
+END_TEST
+
+static enum lcfg_status order_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	char *keys = user_data;
+
+	strcat(keys, key);
+	strcat(keys, " ");
+
+	return lcfg_status_ok;
+}
+
+static void write_file(const char *filename, const char *content)
+{
+	FILE *f = fopen(filename, "w");
+
+	fputs(content, f);
+	fclose(f);
+}
+
+START_TEST(test_lazy)
+{
+	char eager_keys[1024] = "", lazy_keys[1024] = "";
+	void *data;
+	size_t len;
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+	lcfg_accept(c, order_visitor, eager_keys);
+	lcfg_delete(c);
+
+	c = lcfg_new("conf/example.conf");
+	lcfg_stats_enable(c);
+	fail_unless(lcfg_parse_lazy(c) == lcfg_status_ok,
+		"could not index file: %s", lcfg_error_get(c));
+	fail_unless(lcfg_stats_get(c)->values == 0, NULL);
+
+	/* only the touched statement is parsed */
+	fail_unless(lcfg_value_get(c, "map-value.bar", &data, &len) == lcfg_status_ok, NULL);
+	fail_unless(len == 3 && !memcmp(data, "foo", 3), NULL);
+	fail_unless(lcfg_stats_get(c)->values == 2, "%zu values parsed", lcfg_stats_get(c)->values);
+	fail_unless(lcfg_value_get(c, "map-value.baz", &data, &len) != lcfg_status_ok, NULL);
+	fail_unless(lcfg_value_get(c, "map", &data, &len) != lcfg_status_ok, NULL);
+
+	/* traversal still follows file order */
+	lcfg_accept(c, order_visitor, lazy_keys);
+	fail_unless(!strcmp(eager_keys, lazy_keys), "%s != %s", eager_keys, lazy_keys);
+	fail_unless(lcfg_stats_get(c)->values == 13, NULL);
+	lcfg_delete(c);
+
+	/* lcfgx trees build subtrees on lookup */
+	c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse_lazy(c) == lcfg_status_ok, NULL);
+	struct lcfgx_tree_node *root = lcfgx_tree_new(c);
+	struct lcfgx_tree_node *n;
+	fail_unless(root->value.elements == NULL, NULL);
+	fail_unless(lcfgx_get_list(root, &n, "a.d.1") == LCFGX_PATH_FOUND_TYPE_OK, NULL);
+	fail_unless(lcfgx_get_string(root, &n, "a.d.1.1") == LCFGX_PATH_FOUND_TYPE_OK, NULL);
+	fail_unless(!strcmp(n->value.string.data, "r"), NULL);
+	fail_unless(root->value.elements != NULL && root->value.elements->next == NULL, NULL);
+	lcfgx_tree_delete(root);
+	lcfg_delete(c);
+
+	/* syntax errors inside a statement surface on access */
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	close(mkstemp(filename));
+	write_file(filename, "good = \"x\"\nbad = {\n  a = ,\n}\n");
+	c = lcfg_new(filename);
+	fail_unless(lcfg_parse_lazy(c) == lcfg_status_ok, NULL);
+	fail_unless(lcfg_value_get(c, "good", &data, &len) == lcfg_status_ok, NULL);
+	fail_unless(lcfg_value_get(c, "bad.a", &data, &len) != lcfg_status_ok, NULL);
+	fail_unless(strstr(lcfg_error_get(c), "line 3 column 7") != NULL, "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+	unlink(filename);
+}
+END_TEST
+
+START_TEST(test_filtered)
+{
+	const char *prefixes[] = { "map-value", "a.d.1", "nested-list.0.0", "string-value.x", NULL };
+	char keys[1024] = "";
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse_filtered(c, prefixes) == lcfg_status_ok,
+		"could not parse file: %s", lcfg_error_get(c));
+	lcfg_accept(c, order_visitor, keys);
+	fail_unless(!strcmp(keys, "map-value.foo map-value.bar nested-list.0.0.0.0 a.d.1.0 a.d.1.1 "), "%s", keys);
+	lcfg_delete(c);
+
+	/* skipped regions are still checked for balanced brackets */
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	close(mkstemp(filename));
+	write_file(filename, "skip = { a = \"}\" /* } */ b = [ \"\\\"\" ] }\nkeep = \"x\"\nbroken = [ \"x\"\n");
+	c = lcfg_new(filename);
+	fail_unless(lcfg_parse_filtered(c, prefixes) != lcfg_status_ok, NULL);
+	fail_unless(strstr(lcfg_error_get(c), "premature end of file") != NULL, "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	/* and for closers that match their openers, at any depth */
+	const char *mismatched[] = {
+		"skip = { a = [ \"x\" } ]\n",
+		"nested-list = [ [ ], { a = \"x\" ] ]\n",
+		"skip = [[[[[[[[[[[[[[[[[[[[ ]]]]]]]]]]]]]]]]]}]\n",
+		NULL
+	};
+	size_t i;
+	for( i = 0; mismatched[i] != NULL; i++ )
+	{
+		write_file(filename, mismatched[i]);
+		c = lcfg_new(filename);
+		fail_unless(lcfg_parse_filtered(c, prefixes) != lcfg_status_ok, "%s", mismatched[i]);
+		fail_unless(strstr(lcfg_error_get(c), "expected `") != NULL, "%s", lcfg_error_get(c));
+		lcfg_delete(c);
+	}
+
+	write_file(filename, "skip = [[[[[[[[[[[[[[[[[[[[ { a = \"]\" } ]]]]]]]]]]]]]]]]]]]]\nkeep = \"x\"\n");
+	c = lcfg_new(filename);
+	fail_unless(lcfg_parse_filtered(c, prefixes) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+	unlink(filename);
+}
+END_TEST
+
+START_TEST(test_feed)
+{
+	char expected[1024] = "";
+	char keys[1024];
+	char input[4096];
+	size_t sizes[] = { 1, 2, 7, 4096 };
+	size_t i, pos, n, len;
+	void *data;
+
+	FILE *f = fopen("conf/example.conf", "r");
+	len = fread(input, 1, sizeof(input), f);
+	fclose(f);
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+	lcfg_accept(c, order_visitor, expected);
+	lcfg_delete(c);
+
+	/* chunks split tokens, escapes and comments at every position */
+	for( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ )
+	{
+		c = lcfg_new(NULL);
+		for( pos = 0; pos < len; pos += n )
+		{
+			n = len - pos < sizes[i] ? len - pos : sizes[i];
+			fail_unless(lcfg_feed(c, input + pos, n) == lcfg_status_ok,
+				"chunk size %zu: %s", sizes[i], lcfg_error_get(c));
+		}
+		fail_unless(lcfg_feed_end(c) == lcfg_status_ok, "chunk size %zu: %s", sizes[i], lcfg_error_get(c));
+
+		keys[0] = '\0';
+		lcfg_accept(c, order_visitor, keys);
+		fail_unless(!strcmp(keys, expected), "%s", keys);
+		fail_unless(lcfg_value_get(c, "binary_string", &data, &n) == lcfg_status_ok, NULL);
+		fail_unless(n == 7 && !memcmp(data, "\0\xff\r\n\0\0\x4a", 7), NULL);
+		lcfg_delete(c);
+	}
+
+	/* unterminated input is only detected at the end */
+	c = lcfg_new(NULL);
+	fail_unless(lcfg_feed(c, "a = [ \"x", 8) == lcfg_status_ok, NULL);
+	fail_unless(lcfg_feed(c, "\", ", 3) == lcfg_status_ok, NULL);
+	fail_unless(lcfg_feed_end(c) != lcfg_status_ok, NULL);
+	fail_unless(strstr(lcfg_error_get(c), "unterminated") != NULL, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_feed(c, "]", 1) != lcfg_status_ok, NULL);
+	lcfg_delete(c);
+}
+END_TEST
+
+struct memory_reader
+{
+	const char *data;
+	size_t len;
+	size_t max;
+};
+
+/* hands out at most max bytes per call, fails once the input is gone */
+static ssize_t memory_read(void *ctx, void *buf, size_t len)
+{
+	struct memory_reader *r = ctx;
+
+	if( r->data == NULL )
+	{
+		errno = EIO;
+		return -1;
+	}
+
+	if( len > r->max )
+	{
+		len = r->max;
+	}
+	if( len > r->len )
+	{
+		len = r->len;
+	}
+
+	memcpy(buf, r->data, len);
+	r->data += len;
+	r->len -= len;
+
+	return len;
+}
+
+START_TEST(test_reader)
+{
+	char expected[1024] = "";
+	char keys[1024] = "";
+	char input[4096];
+	struct memory_reader r;
+	size_t len;
+
+	FILE *f = fopen("conf/example.conf", "r");
+	len = r.len = fread(input, 1, sizeof(input), f);
+	fclose(f);
+	r.data = input;
+	r.max = 3;
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+	lcfg_accept(c, order_visitor, expected);
+	lcfg_delete(c);
+
+	c = lcfg_new_reader(memory_read, &r, 5);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, order_visitor, keys);
+	fail_unless(!strcmp(keys, expected), "%s", keys);
+	fail_unless(lcfg_parse_lazy(c) != lcfg_status_ok, NULL);
+	lcfg_delete(c);
+
+	/* a reader instance allocates through the given hooks */
+	struct counting_allocator counter = { 0, 0, 0, 0 };
+	struct lcfg_allocator a = { counting_alloc, counting_realloc, counting_free, &counter };
+	r.data = input;
+	r.len = len;
+	keys[0] = '\0';
+	c = lcfg_new_reader_allocator(memory_read, &r, 5, &a);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, order_visitor, keys);
+	fail_unless(!strcmp(keys, expected), "%s", keys);
+	fail_unless(counter.allocations > 0, NULL);
+	lcfg_delete(c);
+	fail_unless(counter.bytes == 0, "%zu bytes leaked", counter.bytes);
+	fail_unless(counter.allocations == counter.frees, NULL);
+
+	r.data = NULL;
+	c = lcfg_new_reader(memory_read, &r, 0);
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	fail_unless(strstr(lcfg_error_get(c), "read()") != NULL, "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+}
+END_TEST
+
+START_TEST(test_compressed)
+{
+	char expected[1024] = "";
+	char keys[1024] = "";
+	char input[4096];
+	size_t len;
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+	lcfg_accept(c, order_visitor, expected);
+	lcfg_delete(c);
+
+	/* lazy parsing rejects it up front, with or without decompression */
+	c = lcfg_new("conf/example.conf.gz");
+	fail_unless(lcfg_parse_lazy(c) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(lcfg_error_get(c), "lazy parsing needs an uncompressed file"), "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	/* decompression is a build option */
+	c = lcfg_new("conf/example.conf.gz");
+	if( lcfg_parse(c) != lcfg_status_ok )
+	{
+		fail_unless(strstr(lcfg_error_get(c), "--enable-zlib") != NULL, "%s", lcfg_error_get(c));
+		lcfg_delete(c);
+		return;
+	}
+	lcfg_accept(c, order_visitor, keys);
+	fail_unless(!strcmp(keys, expected), "%s", keys);
+	lcfg_delete(c);
+
+	/* the inflate state (about 7k) comes from the allocator too, on top
+	 * of the 64k of compressed input buffer */
+	struct counting_allocator counter = { 0, 0, 0, 0 };
+	struct lcfg_allocator a = { counting_alloc, counting_realloc, counting_free, &counter };
+	size_t plain;
+	c = lcfg_new_allocator("conf/example.conf", &a);
+	lcfg_stats_enable(c);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	plain = lcfg_stats_get(c)->bytes_allocated;
+	lcfg_delete(c);
+	c = lcfg_new_allocator("conf/example.conf.gz", &a);
+	lcfg_stats_enable(c);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_stats_get(c)->bytes_allocated > plain + 0x10000 + 4096, "%zu", lcfg_stats_get(c)->bytes_allocated - plain);
+	lcfg_delete(c);
+	fail_unless(counter.bytes == 0, "%zu bytes leaked", counter.bytes);
+	fail_unless(counter.allocations == counter.frees, NULL);
+
+	FILE *f = fopen("conf/example.conf.gz", "r");
+	len = fread(input, 1, sizeof(input), f);
+	fclose(f);
+
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	int fd = mkstemp(filename);
+	fail_unless(write(fd, input, len - 10) == len - 10, NULL);
+	close(fd);
+	c = lcfg_new_allocator(filename, &a);
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	fail_unless(strstr(lcfg_error_get(c), "premature end of compressed input") != NULL, "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+	fail_unless(counter.bytes == 0, "%zu bytes leaked", counter.bytes);
+	fail_unless(counter.allocations == counter.frees, NULL);
+	unlink(filename);
+}
+END_TEST
+
+START_TEST(test_write)
+{
+	char expected[1024] = "";
+	char keys[1024] = "";
+	char *buf, *tree_buf;
+	size_t len, tree_len, n;
+	void *data;
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+	lcfg_accept(c, order_visitor, expected);
+	fail_unless(lcfg_write_buffer(c, &buf, &len) == lcfg_status_ok, NULL);
+	fail_unless(strlen(buf) == len, NULL);
+
+	/* the tree writer produces the same text */
+	struct lcfgx_tree_node *root = lcfgx_tree_new(c);
+	fail_unless(lcfgx_tree_write_buffer(root, &tree_buf, &tree_len) == lcfg_status_ok, NULL);
+	fail_unless(tree_len == len && !memcmp(buf, tree_buf, len), "%s", tree_buf);
+	free(tree_buf);
+	lcfgx_tree_delete(root);
+	lcfg_delete(c);
+
+	/* and it parses back to the same values */
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	int fd = mkstemp(filename);
+	c = lcfg_new(NULL);
+	fail_unless(lcfg_feed(c, buf, len) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_feed_end(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, order_visitor, keys);
+	fail_unless(!strcmp(keys, expected), "%s", keys);
+	fail_unless(lcfg_value_get(c, "binary_string", &data, &n) == lcfg_status_ok, NULL);
+	fail_unless(n == 7 && !memcmp(data, "\0\xff\r\n\0\0\x4a", 7), NULL);
+	fail_unless(lcfg_write(c, fd) == lcfg_status_ok, NULL);
+	close(fd);
+	lcfg_delete(c);
+
+	keys[0] = '\0';
+	c = lcfg_new(filename);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, order_visitor, keys);
+	fail_unless(!strcmp(keys, expected), "%s", keys);
+	lcfg_delete(c);
+	unlink(filename);
+	free(buf);
+}
+END_TEST
+
+/* one request of the lcfg --serve protocol, returns the status byte */
+static int serve_query(int fd, char op, const char *key, char *reply, uint32_t *len)
+{
+	char req[256];
+	uint32_t n = strlen(key) + 2;
+
+	req[0] = op;
+	req[1] = '\0';
+	memcpy(req + 2, key, n - 2);
+
+	n = htonl(n);
+	fail_unless(write(fd, &n, 4) == 4 && write(fd, req, ntohl(n)) == ntohl(n), NULL);
+	fail_unless(read(fd, &n, 4) == 4, NULL);
+	*len = ntohl(n);
+	fail_unless(recv(fd, reply, *len, MSG_WAITALL) == *len, NULL);
+
+	(*len)--;
+	return reply[0];
+}
+
+START_TEST(test_serve)
+{
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	struct sockaddr_un addr;
+	char reply[256];
+	uint32_t len;
+	int fd, i;
+	pid_t pid;
+
+	/* runs the tool from the build tree */
+	if( access("../tools/lcfg", X_OK) != 0 )
+		return;
+
+	close(mkstemp(filename));
+	write_file(filename, "a = \"1\"\nm = { x = \"2\" y = \"3\" }\n");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s.sock", filename);
+
+	if( (pid = fork()) == 0 )
+	{
+		execl("../tools/lcfg", "lcfg", "--serve", addr.sun_path, filename, (char *)NULL);
+		_exit(127);
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	for( i = 0; connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0; i++ )
+	{
+		fail_unless(i < 500, "server did not start");
+		usleep(10000);
+	}
+
+	fail_unless(serve_query(fd, 'g', "a", reply, &len) == 0 && len == 1 && reply[1] == '1', NULL);
+	fail_unless(serve_query(fd, 'g', "b", reply, &len) == 1, NULL);
+	fail_unless(serve_query(fd, 'l', "m", reply, &len) == 0, NULL);
+	fail_unless(len == 14 && !memcmp(reply + 1, "\0\0\0\3m.x\0\0\0\3m.y", 14), NULL);
+	fail_unless(serve_query(fd, 'p', "m.y", reply, &len) == 0, NULL);
+	fail_unless(len == 12 && !memcmp(reply + 1, "\0\0\0\3m.y\0\0\0\1" "3", 12), NULL);
+
+	/* changes are picked up by the next query */
+	write_file(filename, "a = \"22\"\n");
+	fail_unless(serve_query(fd, 'g', "a", reply, &len) == 0 && len == 2 && !memcmp(reply + 1, "22", 2), NULL);
+
+	close(fd);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	unlink(filename);
+}
+END_TEST
+
+START_TEST(test_shared)
+{
+	char expected[1024] = "";
+	char keys[1024] = "";
+	char name[64], image[80];
+	void *data;
+	size_t len;
+
+	snprintf(name, sizeof(name), "/check_liblcfg.%d", (int)getpid());
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+	lcfg_accept(c, order_visitor, expected);
+	fail_unless(lcfg_publish_shared(c, name) == lcfg_status_ok, "%s", lcfg_error_get(c));
+
+	struct lcfg *w = lcfg_new(NULL);
+	fail_unless(lcfg_attach_shared(w, name) == lcfg_status_ok, "%s", lcfg_error_get(w));
+	fail_unless(lcfg_shared_generation(w) == 1 && !lcfg_shared_stale(w), NULL);
+	lcfg_accept(w, order_visitor, keys);
+	fail_unless(!strcmp(keys, expected), "%s", keys);
+	fail_unless(lcfg_value_get(w, "binary_string", &data, &len) == lcfg_status_ok, NULL);
+	fail_unless(len == 7 && !memcmp(data, "\0\xff\r\n\0\0\x4a", 7), NULL);
+	fail_unless(lcfg_value_get(w, "a.d.2", &data, &len) == lcfg_status_ok && !strcmp(data, "my index is 2"), NULL);
+	fail_unless(lcfg_value_get(w, "a.d", &data, &len) != lcfg_status_ok, NULL);
+
+	/* the old image stays usable after republication */
+	fail_unless(lcfg_publish_shared(c, name) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_shared_stale(w), NULL);
+	fail_unless(lcfg_value_get(w, "string-value", &data, &len) == lcfg_status_ok && !strcmp(data, "foo"), NULL);
+	fail_unless(lcfg_attach_shared(w, name) == lcfg_status_ok, "%s", lcfg_error_get(w));
+	fail_unless(lcfg_shared_generation(w) == 2 && !lcfg_shared_stale(w), NULL);
+	lcfg_delete(w);
+	lcfg_delete(c);
+
+	snprintf(image, sizeof(image), "%s.2", name);
+	shm_unlink(image);
+	shm_unlink(name);
+}
+END_TEST
+
+static enum lcfg_status pair_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	char *pairs = user_data;
+
+	strcat(pairs, key);
+	strcat(pairs, "=");
+	strncat(pairs, data, len);
+	strcat(pairs, " ");
+
+	return lcfg_status_ok;
+}
+
+START_TEST(test_overlay)
+{
+	char base_file[] = "/tmp/check_liblcfg.XXXXXX";
+	char host_file[] = "/tmp/check_liblcfg.XXXXXX";
+	char pairs[1024] = "";
+	void *data;
+	size_t len;
+
+	close(mkstemp(base_file));
+	close(mkstemp(host_file));
+	write_file(base_file, "a = \"1\"\nm = { x = \"2\" y = \"3\" }\nl = [ \"4\", \"5\" ]\n");
+	write_file(host_file, "z = \"6\"\nm = { y = \"7\" }\nl = [ \"8\" ]\n");
+
+	struct lcfg *base = lcfg_new(base_file);
+	struct lcfg *host = lcfg_new(host_file);
+	fail_unless(lcfg_parse(base) == lcfg_status_ok && lcfg_parse(host) == lcfg_status_ok, NULL);
+
+	struct lcfg_overlay *o = lcfg_overlay_new();
+	fail_unless(lcfg_overlay_add(o, base) == 0 && lcfg_overlay_add(o, host) == 1, NULL);
+
+	fail_unless(lcfg_overlay_value_get(o, "m.y", &data, &len) == lcfg_status_ok && !strcmp(data, "7"), NULL);
+	fail_unless(lcfg_overlay_value_get(o, "m.x", &data, &len) == lcfg_status_ok && !strcmp(data, "2"), NULL);
+	fail_unless(lcfg_overlay_value_get(o, "q", &data, &len) != lcfg_status_ok, NULL);
+
+	lcfg_overlay_accept(o, pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "a=1 m.x=2 m.y=7 l.0=8 z=6 "), "%s", pairs);
+	fail_unless(lcfg_overlay_value_get(o, "l.1", &data, &len) != lcfg_status_ok, NULL);
+
+	pairs[0] = '\0';
+	lcfg_overlay_accept_subtree(o, "m", pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "m.x=2 m.y=7 "), "%s", pairs);
+
+	/* swapping a layer leaves the others alone */
+	lcfg_delete(host);
+	write_file(host_file, "a = \"9\"\n");
+	host = lcfg_new(host_file);
+	fail_unless(lcfg_parse(host) == lcfg_status_ok, NULL);
+	lcfg_overlay_set(o, 1, host);
+	fail_unless(lcfg_overlay_value_get(o, "a", &data, &len) == lcfg_status_ok && !strcmp(data, "9"), NULL);
+	fail_unless(lcfg_overlay_value_get(o, "m.y", &data, &len) == lcfg_status_ok && !strcmp(data, "3"), NULL);
+
+	/* a scalar replaces a map and the other way round */
+	lcfg_delete(host);
+	write_file(host_file, "m = \"s\"\na = { b = \"c\" }\n");
+	host = lcfg_new(host_file);
+	fail_unless(lcfg_parse(host) == lcfg_status_ok, NULL);
+	lcfg_overlay_set(o, 1, host);
+	pairs[0] = '\0';
+	lcfg_overlay_accept(o, pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "l.0=4 l.1=5 m=s a.b=c "), "%s", pairs);
+	fail_unless(lcfg_overlay_value_get(o, "m.x", &data, &len) != lcfg_status_ok, NULL);
+	fail_unless(lcfg_overlay_value_get(o, "a", &data, &len) != lcfg_status_ok, NULL);
+
+	lcfg_overlay_delete(o);
+	lcfg_delete(host);
+	lcfg_delete(base);
+	unlink(base_file);
+	unlink(host_file);
+}
+END_TEST
+
+START_TEST(test_include)
+{
+	char dir[] = "/tmp/check_liblcfg.XXXXXX";
+	char path[64], mid[64], leaf[64];
+	char pairs[1024] = "";
+	const char *prefixes[] = { "server.limits", NULL };
+
+	lcfg_include_cache_flush();
+
+	struct lcfg *c = lcfg_new("conf/include.conf");
+	lcfg_stats_enable(c);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "name=main timeout=30 limits.0=1 limits.1=2 user=www "
+		"server.timeout=30 server.limits.0=1 server.limits.1=2 server.user=www server.port=80 include=a key "), "%s", pairs);
+	fail_unless(lcfg_stats_get(c)->values == 11, "%zu", lcfg_stats_get(c)->values);
+	lcfg_delete(c);
+
+	/* included values are counted once, parsed or from the cache */
+	c = lcfg_new("conf/include.conf");
+	lcfg_stats_enable(c);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_stats_get(c)->values == 11, "%zu", lcfg_stats_get(c)->values);
+	lcfg_delete(c);
+
+	/* a second instance splices the cached fragments */
+	pairs[0] = '\0';
+	c = lcfg_new("conf/include.conf");
+	fail_unless(lcfg_parse_filtered(c, prefixes) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "server.limits.0=1 server.limits.1=2 "), "%s", pairs);
+	lcfg_delete(c);
+
+	c = lcfg_new("conf/include/cycle_a.conf");
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	fail_unless(strstr(lcfg_error_get(c), "include cycle") != NULL, "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	/* a change to a nested include, of the same size within the same
+	 * second, is seen through the cached outer fragment */
+	fail_unless(mkdtemp(dir) != NULL, NULL);
+	snprintf(path, sizeof(path), "%s/main.conf", dir);
+	write_file(path, "include \"mid.conf\"\n");
+	snprintf(mid, sizeof(mid), "%s/mid.conf", dir);
+	write_file(mid, "m = { include \"leaf.conf\" }\n");
+	snprintf(leaf, sizeof(leaf), "%s/leaf.conf", dir);
+	write_file(leaf, "v = \"1\"\n");
+
+	pairs[0] = '\0';
+	c = lcfg_new(path);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "m.v=1 "), "%s", pairs);
+	lcfg_delete(c);
+
+	write_file(leaf, "v = \"2\"\n");
+	pairs[0] = '\0';
+	c = lcfg_new(path);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "m.v=2 "), "%s", pairs);
+	lcfg_delete(c);
+
+	unlink(leaf);
+	unlink(mid);
+	unlink(path);
+	rmdir(dir);
+
+	lcfg_include_cache_flush();
+}
+END_TEST
+
+START_TEST(test_interpolation)
+{
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	char pairs[1024] = "";
+	const struct lcfg_schema_rule rules[] =
+	{
+		{ "port", lcfg_schema_integer, 1, 1, 65535, NULL },
+		{ "color", lcfg_schema_boolean, 0, 0, 0, NULL },
+		{ NULL, 0, 0, 0, 0, NULL }
+	};
+
+	close(mkstemp(filename));
+	write_file(filename, "url = \"${cache}:${ports.1}\"\ncache = \"${cluster.name}-cache\"\n"
+		"cluster = { name = \"east\" }\nports = [ \"80\", \"443\" ]\nliteral = \"$${cache} $5 ${\"\nmissing = \"${nope}\"\n");
+
+	struct lcfg *c = lcfg_new(filename);
+	lcfg_interpolation_set(c, lcfg_interpolation_keep);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_accept(c, pair_visitor, pairs);
+	fail_unless(!strcmp(pairs, "url=east-cache:443 cache=east-cache cluster.name=east ports.0=80 ports.1=443 "
+		"literal=${cache} $5 ${ missing=${nope} "), "%s", pairs);
+	lcfg_delete(c);
+
+	c = lcfg_new(filename);
+	lcfg_interpolation_set(c, lcfg_interpolation_strict);
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(lcfg_error_get(c), "unresolved reference `${nope}' near line 6 column 11"), "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	write_file(filename, "a = \"${b}\"\nb = { c = \"x${a}\" }\n");
+	c = lcfg_new(filename);
+	lcfg_interpolation_set(c, lcfg_interpolation_strict);
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	lcfg_delete(c);
+
+	write_file(filename, "a = \"${b.c}\"\nb = { c = \"x${a}\" }\n");
+	c = lcfg_new(filename);
+	lcfg_interpolation_set(c, lcfg_interpolation_strict);
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(lcfg_error_get(c), "reference cycle through `a' near line 1 column 5"), "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	/* the schema checks the resolved values */
+	write_file(filename, "base_port = \"8000\"\nport = \"${base_port}\"\nflag = \"on\"\ncolor = \"${flag}\"\nname = \"${flag}x\"\n");
+	c = lcfg_new(filename);
+	lcfg_interpolation_set(c, lcfg_interpolation_strict);
+	fail_unless(lcfg_schema_set(c, rules) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	write_file(filename, "flag = \"on\"\nport = \"${flag}\"\n");
+	c = lcfg_new(filename);
+	lcfg_interpolation_set(c, lcfg_interpolation_strict);
+	fail_unless(lcfg_schema_set(c, rules) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_parse(c) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(lcfg_error_get(c), "`port' must be an integer near line 2 column 8"), "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+
+	/* a long chain of references does not exhaust the call stack */
+	size_t i, chain = 200000;
+	void *data;
+	size_t len;
+	FILE *f = fopen(filename, "w");
+	for( i = 0; i < chain; i++ )
+		fprintf(f, "k%zu = \"${k%zu}\"\n", i, i + 1);
+	fprintf(f, "k%zu = \"end\"\n", chain);
+	fclose(f);
+	c = lcfg_new(filename);
+	lcfg_interpolation_set(c, lcfg_interpolation_strict);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_value_get(c, "k0", &data, &len) == lcfg_status_ok, NULL);
+	fail_unless(len == 3 && !memcmp(data, "end", 3), NULL);
+	lcfg_delete(c);
+
+	unlink(filename);
+}
+END_TEST
+
+static enum lcfg_status schema_parse(const char *filename, const struct lcfg_schema_rule *rules, const char *content, char *error)
+{
+	enum lcfg_status status;
+
+	write_file(filename, content);
+
+	struct lcfg *c = lcfg_new(filename);
+	fail_unless(lcfg_schema_set(c, rules) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	status = lcfg_parse(c);
+	strcpy(error, lcfg_error_get(c));
+	lcfg_delete(c);
+
+	return status;
+}
+
+START_TEST(test_schema)
+{
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	char error[0xff];
+	const char *levels[] = { "debug", "info", "error", NULL };
+	const struct lcfg_schema_rule rules[] =
+	{
+		{ "port", lcfg_schema_integer, 1, 1, 65535, NULL },
+		{ "log.level", lcfg_schema_string, 0, 0, 0, levels },
+		{ "log.color", lcfg_schema_boolean, 0, 0, 0, NULL },
+		{ "upstreams", lcfg_schema_list, 1, 1, 4, NULL },
+		{ "upstreams.*.host", lcfg_schema_string, 1, 0, 0, NULL },
+		{ NULL, 0, 0, 0, 0, NULL }
+	};
+	const struct lcfg_schema_rule conflicting[] =
+	{
+		{ "port", lcfg_schema_integer, 0, 0, 0, NULL },
+		{ "port.x", lcfg_schema_string, 0, 0, 0, NULL },
+		{ NULL, 0, 0, 0, 0, NULL }
+	};
+
+	close(mkstemp(filename));
+
+	fail_unless(schema_parse(filename, rules, "port = \"80\"\nlog = { level = \"info\" color = \"yes\" }\n"
+		"upstreams = [ { host = \"a\" }, { host = \"b\" weight = \"2\" } ]\nextra = \"unchecked\"\n", error) == lcfg_status_ok, "%s", error);
+
+	fail_unless(schema_parse(filename, rules, "port = \"80000\"\nupstreams = [ { host = \"a\" } ]\n", error) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(error, "`port' must be between 1 and 65535 near line 1 column 8"), "%s", error);
+
+	fail_unless(schema_parse(filename, rules, "port = \"80\"\nlog = { level = \"loud\" }\nupstreams = [ { host = \"a\" } ]\n", error) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(error, "`log.level' has a value that is not allowed (\"loud\") near line 2 column 17"), "%s", error);
+
+	fail_unless(schema_parse(filename, rules, "port = \"80\"\nupstreams = [ { host = \"a\" }, { weight = \"1\" } ]\n", error) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(error, "missing required key `upstreams.1.host' near line 2 column 46"), "%s", error);
+
+	fail_unless(schema_parse(filename, rules, "port = \"80\"\nupstreams = [ ]\n", error) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(error, "`upstreams' must have between 1 and 4 elements near line 2 column 15"), "%s", error);
+
+	fail_unless(schema_parse(filename, rules, "upstreams = [ { host = \"a\" } ]\n", error) != lcfg_status_ok, NULL);
+	fail_unless(strstr(error, "missing required key `port'") != NULL, "%s", error);
+
+	fail_unless(schema_parse(filename, rules, "port = \"80\"\nupstreams = \"a\"\n", error) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(error, "`upstreams' must be a list near line 2 column 13"), "%s", error);
+
+	struct lcfg *c = lcfg_new(filename);
+	fail_unless(lcfg_schema_set(c, conflicting) != lcfg_status_ok, NULL);
+	lcfg_delete(c);
+
+	unlink(filename);
+}
+END_TEST
+
+static void error_collector(const char *message, void *user_data)
+{
+	strcat(user_data, message);
+	strcat(user_data, "\n");
+}
+
+START_TEST(test_validate)
+{
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	char errors[2048] = "";
+
+	close(mkstemp(filename));
+	write_file(filename, "a = \"1\"\nb \"2\"\nc = { d = { e } }\nf = \"bad \\q escape\"\ng = [ \"3\" ]\nh = ? \"4\"\ni = { j = \"5\"\n");
+
+	struct lcfg *c = lcfg_new(filename);
+	lcfg_stats_enable(c);
+	fail_unless(lcfg_validate(c, error_collector, errors) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(errors,
+		"invalid token (T_STRING) near line 2 column 3: expected `='\n"
+		"invalid token (`}') near line 3 column 15: expected `='\n"
+		"invalid string escape sequence `q' near line 4, col 11\n"
+		"parse error: invalid input character `?' (0x3f) near line 6, col 5\n"
+		"unexpected end of file: unterminated list/map?\n"), "%s", errors);
+	fail_unless(lcfg_stats_get(c)->values == 0, NULL);
+	lcfg_delete(c);
+
+	c = lcfg_new("conf/example.conf");
+	fail_unless(lcfg_validate(c, NULL, NULL) == lcfg_status_ok, NULL);
+	lcfg_delete(c);
+
+	unlink(filename);
+}
+END_TEST
+
+static enum lcfg_status size_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	size_t *sizes = user_data;
+
+	sizes[0] += strlen(key) + 1;
+	sizes[1] += len + 1;
+
+	return lcfg_status_ok;
+}
+
+START_TEST(test_memory_usage)
+{
+	struct lcfg_memory_usage u;
+	size_t sizes[2] = { 0, 0 };
+
+	struct lcfg *c = lcfg_new("conf/example.conf");
+	lcfg_interpolation_set(c, lcfg_interpolation_keep);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+	lcfg_accept(c, size_visitor, sizes);
+
+	lcfg_memory_usage(c, &u);
+	fail_unless(u.keys == sizes[0] && u.values == sizes[1], "%zu %zu", u.keys, u.values);
+	fail_unless(u.indexes > 0 && u.overhead > 0 && u.shared == 0, NULL);
+	lcfg_delete(c);
+}
+END_TEST
+
+START_TEST(test_intern)
+{
+	struct lcfg_memory_usage u[2];
+	const struct lcfg_stats *stats;
+	void *v[2];
+	size_t len;
+	int i;
+
+	for( i = 0; i < 2; i++ )
+	{
+		struct lcfg *c = lcfg_new("conf/intern.conf");
+		lcfg_stats_enable(c);
+		if( i == 1 )
+		{
+			lcfg_intern_enable(c);
+		}
+		fail_unless(lcfg_parse(c) == lcfg_status_ok, NULL);
+		lcfg_memory_usage(c, &u[i]);
+
+		stats = lcfg_stats_get(c);
+		fail_unless(stats->values == 11, NULL);
+		fail_unless(stats->values_interned == (i == 1 ? 6 : 0), "%zu", stats->values_interned);
+		fail_unless(stats->bytes_interned == (i == 1 ? 41 : 0), "%zu", stats->bytes_interned);
+
+		fail_unless(lcfg_value_get(c, "host1.user", &v[0], &len) == lcfg_status_ok && len == 6, NULL);
+		fail_unless(lcfg_value_get(c, "host3.user", &v[1], &len) == lcfg_status_ok && len == 6, NULL);
+		fail_unless(!strcmp(v[0], "deploy") && (v[0] == v[1]) == (i == 1), NULL);
+		lcfg_delete(c);
+	}
+
+	fail_unless(u[0].keys == u[1].keys, NULL);
+	fail_unless(u[1].values + 41 == u[0].values, "%zu %zu", u[0].values, u[1].values);
+}
+END_TEST
+
+static enum lcfg_status batch_visitor(const struct lcfg_batch *b, void *user_data)
+{
+	size_t i;
+
+	fail_unless(b->count > 0 && b->count <= 4, "%zu", b->count);
+	for( i = 0; i < b->count; i++ )
+	{
+		fail_unless(b->key_lens[i] == strlen(b->keys[i]), NULL);
+		pair_visitor(b->keys[i], (void *)b->values[i], b->value_lens[i], user_data);
+	}
+
+	return lcfg_status_ok;
+}
+
+START_TEST(test_iter)
+{
+	char expected[1024] = "";
+	char pairs[1024];
+	struct lcfg_iter it;
+	struct lcfg_entry e;
+	int lazy;
+
+	for( lazy = 0; lazy < 2; lazy++ )
+	{
+		struct lcfg *c = lcfg_new("conf/intern.conf");
+		fail_unless((lazy ? lcfg_parse_lazy(c) : lcfg_parse(c)) == lcfg_status_ok, NULL);
+		if( !lazy )
+		{
+			lcfg_accept(c, pair_visitor, expected);
+		}
+
+		pairs[0] = '\0';
+		fail_unless(lcfg_iter_begin(c, &it) == lcfg_status_ok, NULL);
+		while( lcfg_iter_next(&it, &e) )
+		{
+			fail_unless(e.key_len == strlen(e.key), NULL);
+			pair_visitor(e.key, (void *)e.value, e.value_len, pairs);
+		}
+		fail_unless(!lcfg_iter_next(&it, &e), NULL);
+		fail_unless(!strcmp(pairs, expected), "%s", pairs);
+
+		pairs[0] = '\0';
+		fail_unless(lcfg_accept_batched(c, 4, batch_visitor, pairs) == lcfg_status_ok, NULL);
+		fail_unless(!strcmp(pairs, expected), "%s", pairs);
+		lcfg_delete(c);
+	}
+}
+END_TEST
+
+static enum lcfg_status token_visitor(enum lcfg_scan_token token, const char *text, size_t len, uint64_t line, uint64_t col, void *user_data)
+{
+	char *tokens = user_data;
+
+	strncat(tokens, &"i=s[],{}"[token], 1);
+	if( text != NULL )
+	{
+		strncat(tokens, text, len);
+	}
+
+	return lcfg_status_ok;
+}
+
+START_TEST(test_scan)
+{
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	char tokens[256] = "";
+
+	close(mkstemp(filename));
+	write_file(filename, "a = \"x\"\nm = { b = [ \"1\", \"2\" ] }\n");
+
+	struct lcfg *c = lcfg_new(filename);
+	fail_unless(lcfg_scan(c, token_visitor, tokens) == lcfg_status_ok, NULL);
+	fail_unless(!strcmp(tokens, "ia=sxim={ib=[s1,s2]}"), "%s", tokens);
+	fail_unless(lcfg_value_get(c, "a", NULL, NULL) != lcfg_status_ok, NULL);
+	lcfg_delete(c);
+	unlink(filename);
+}
+END_TEST
+
+START_TEST(test_generate)
+{
+	char dir[] = "/tmp/check_liblcfg.XXXXXX";
+	char path[256], cmd[4 * PATH_MAX + 256], out[256] = "";
+	char tools[PATH_MAX], include[PATH_MAX], libs[PATH_MAX];
+	FILE *p;
+
+	/* runs the tool and a compiler from the build tree */
+	if( realpath("../tools/lcfg", tools) == NULL || realpath("../include", include) == NULL ||
+		realpath("../src/.libs", libs) == NULL || system("cc --version >/dev/null 2>&1") != 0 )
+		return;
+
+	fail_unless(mkdtemp(dir) != NULL, NULL);
+
+	snprintf(path, sizeof(path), "%s/schema.conf", dir);
+	write_file(path,
+		"name = \"string\"\n"
+		"server = { host = \"string\" port = \"integer\" tls-on = \"boolean\" limits = { max = \"integer\" } }\n"
+		"debug = \"boolean\"\n");
+	snprintf(path, sizeof(path), "%s/main.c", dir);
+	write_file(path,
+		"#include <stdio.h>\n"
+		"#include \"gencfg.h\"\n"
+		"int main(int argc, char **argv)\n"
+		"{\n"
+		"\tstruct lcfg *c = lcfg_new(argv[1]);\n"
+		"\tstruct gencfg cfg;\n"
+		"\tif( gencfg_load(c, &cfg) != lcfg_status_ok )\n"
+		"\t\tprintf(\"%s\", lcfg_error_get(c));\n"
+		"\telse\n"
+		"\t\tprintf(\"%s %s %lld %d %lld %d\", cfg.name, cfg.server.host, cfg.server.port, cfg.server.tls_on, cfg.server.limits.max, cfg.debug);\n"
+		"\tgencfg_free(&cfg);\n"
+		"\tlcfg_delete(c);\n"
+		"\treturn argc != 2;\n"
+		"}\n");
+	snprintf(path, sizeof(path), "%s/test.conf", dir);
+	write_file(path,
+		"name = \"n\"\n"
+		"unknown = [ { a = \"1\" } ]\n"
+		"server = {\n"
+		"\thost = \"h\"\n"
+		"\tport = \"8080\"\n"
+		"\ttls-on = \"yes\"\n"
+		"\tlimits = { max = \"16\" }\n"
+		"}\n"
+		"debug = \"off\"\n");
+
+	snprintf(cmd, sizeof(cmd), "cd %s && %s --generate=gencfg schema.conf && "
+		"cc -std=c99 -Wall -Wextra -Werror -I%s -o gen main.c gencfg.c -L%s -Wl,-rpath,%s -llcfg", dir, tools, include, libs, libs);
+	fail_unless(system(cmd) == 0, "%s", cmd);
+
+	snprintf(cmd, sizeof(cmd), "%s/gen %s", dir, path);
+	p = popen(cmd, "r");
+	fail_unless(p != NULL && fgets(out, sizeof(out), p) != NULL, NULL);
+	pclose(p);
+	fail_unless(!strcmp(out, "n h 8080 1 16 0"), "%s", out);
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	fail_unless(system(cmd) == 0, NULL);
+}
+END_TEST
+
+struct bind_object
+{
+	const char *host;
+	long long port;
+	int color;
+	long long workers;
+	const char *level;
+};
+
+START_TEST(test_bind)
+{
+	char filename[] = "/tmp/check_liblcfg.XXXXXX";
+	struct bind_object o = { NULL, 0, 0, 0, "unset" };
+	const struct lcfg_binding table[] =
+	{
+		{ "server.host", offsetof(struct bind_object, host), lcfg_schema_string, NULL },
+		{ "server.port", offsetof(struct bind_object, port), lcfg_schema_integer, "80" },
+		{ "log.color", offsetof(struct bind_object, color), lcfg_schema_boolean, "on" },
+		{ "workers", offsetof(struct bind_object, workers), lcfg_schema_integer, "4" },
+		{ "log.level", offsetof(struct bind_object, level), lcfg_schema_string, NULL },
+		{ NULL, 0, 0, NULL }
+	};
+
+	close(mkstemp(filename));
+	write_file(filename, "server = { host = \"example.org\" port = \"8080\" }\nlog = { color = \"no\" }\nserver = { port = \"1\" }\n");
+
+	struct lcfg *c = lcfg_new(filename);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_bind(c, table, &o) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(!strcmp(o.host, "example.org"), NULL);
+	fail_unless(o.port == 8080, NULL);
+	fail_unless(o.color == 0, NULL);
+	fail_unless(o.workers == 4, NULL);
+	fail_unless(!strcmp(o.level, "unset"), NULL);
+	lcfg_delete(c);
+
+	write_file(filename, "workers = \"many\"\n");
+	c = lcfg_new(filename);
+	fail_unless(lcfg_parse(c) == lcfg_status_ok, "%s", lcfg_error_get(c));
+	fail_unless(lcfg_bind(c, table, &o) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(lcfg_error_get(c), "`workers' must be an integer"), "%s", lcfg_error_get(c));
+
+	const struct lcfg_binding twice[] =
+	{
+		{ "workers", offsetof(struct bind_object, workers), lcfg_schema_integer, "4" },
+		{ "log.level", offsetof(struct bind_object, level), lcfg_schema_string, NULL },
+		{ "workers", offsetof(struct bind_object, port), lcfg_schema_integer, NULL },
+		{ NULL, 0, 0, NULL }
+	};
+	fail_unless(lcfg_bind(c, twice, &o) != lcfg_status_ok, NULL);
+	fail_unless(!strcmp(lcfg_error_get(c), "`workers' is bound more than once"), "%s", lcfg_error_get(c));
+	lcfg_delete(c);
+	unlink(filename);
+}
+END_TEST
+
 Suite *liblcfg_suite(void)
 {
 	Suite *s = suite_create("liblcfg");
 
 	TCase *tc_core = tcase_create("Core");
 	tcase_add_test(tc_core, test_example);
+	tcase_add_test(tc_core, test_large_file);
+	tcase_add_test(tc_core, test_stats);
+	tcase_add_test(tc_core, test_allocator);
+	tcase_add_test(tc_core, test_token_allocations);
+	tcase_add_test(tc_core, test_string_allocations);
+	tcase_add_test(tc_core, test_lazy);
+	tcase_add_test(tc_core, test_filtered);
+	tcase_add_test(tc_core, test_feed);
+	tcase_add_test(tc_core, test_reader);
+	tcase_add_test(tc_core, test_compressed);
+	tcase_add_test(tc_core, test_write);
+	tcase_add_test(tc_core, test_serve);
+	tcase_add_test(tc_core, test_shared);
+	tcase_add_test(tc_core, test_overlay);
+	tcase_add_test(tc_core, test_include);
+	tcase_add_test(tc_core, test_interpolation);
+	tcase_add_test(tc_core, test_schema);
+	tcase_add_test(tc_core, test_validate);
+	tcase_add_test(tc_core, test_memory_usage);
+	tcase_add_test(tc_core, test_intern);
+	tcase_add_test(tc_core, test_iter);
+	tcase_add_test(tc_core, test_scan);
+	tcase_add_test(tc_core, test_generate);
+	tcase_add_test(tc_core, test_bind);
 	suite_add_tcase(s, tc_core);
 	
 	return s;
@@ -29,26 +29,61 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <string.h>
+#include <unistd.h>
 #include <lcfg/lcfg.h>
 #include <lcfgx/lcfgx_tree.h>
 
+#include "lcfg_bench.h"
+#include "lcfg_check.h"
+#include "lcfg_gen.h"
+#include "lcfg_serve.h"
+
 const char *help =
                    "Usage: %s [OPTION] CONFIGFILE\n"
+                   "  or:  %s --serve=SOCKET CONFIGFILE...\n"
+                   "  or:  %s --check [--jobs=N] CONFIGFILE...\n"
+                   "  or:  %s --generate=NAME SCHEMAFILE\n"
                    "Read all or specific key/value-pairs from the lcfg configuration file CONFIGFILE.\n"
                    "The default is to read and print all values found in CONFIGFILE, non-printable\n"
                    "characters are substituted with a dot.\n"
                    "\n"
                    "Mandatory arguments to long options are mandatory for short options too.\n"
                    "  -k, --key=KEY              only read the (possibly binary) value of KEY\n"
-                   "                               and print it unfiltered to stdout\n"
+                   "                               and print it unfiltered to stdout, may be\n"
+                   "                               given several times\n"
+                   "  -i, --stdin-keys           read further keys from stdin, one per line\n"
+                   "                               (NUL-separated with -0)\n"
                    "  -n, --newline              print a newline character (\\n) after KEY value\n"
+                   "  -0, --null                 terminate each value with a NUL byte, the\n"
+                   "                               default for more than one KEY\n"
+                   "  -l, --length               print each value as a netstring: its length\n"
+                   "                               in decimal, `:', the value and `,'\n"
+                   "  -s, --stats                print parse statistics to stderr\n"
+                   "  -w, --write                print the config in canonical lcfg syntax\n"
+                   "      --bench                time traversals of the config with a visitor,\n"
+                   "                               the iterator and a batched visitor\n"
+                   "      --serve=SOCKET         keep the CONFIGFILEs parsed and answer queries\n"
+                   "                               on the UNIX socket SOCKET, re-parsing files\n"
+                   "                               when they change. see lcfg_serve.c for the\n"
+                   "                               protocol\n"
+                   "      --check                only check the syntax of the CONFIGFILEs and\n"
+                   "                               report all errors, exit status is 2 if any\n"
+                   "                               file has errors\n"
+                   "  -j, --jobs=N               check N files in parallel, default is one per\n"
+                   "                               CPU\n"
+                   "      --generate=NAME        write NAME.h and NAME.c with a struct for the\n"
+                   "                               configs described by SCHEMAFILE and a loader\n"
+                   "                               that fills it in one pass, see lcfg_gen.h\n"
                    "\n"
                    "SELINUX options:\n"
                    "\n"
                    "      --help     display this help and exit\n"
                    "      --version  output version information and exit\n"
                    "\n"
-                   "Exit status is 0 if OK, 1 if the requested KEY was not found, 2 if some serious\n"
+                   "Values are printed in the order of the keys, a key that is not found yields an\n"
+                   "empty value.\n"
+                   "\n"
+                   "Exit status is 0 if OK, 1 if a requested KEY was not found, 2 if some serious\n"
                    "error occured (parse error, file not found, etc.)\n"
                    "\n"
                    "Report bugs to <pb_remove_everything_except_pb@carnivore.it>.\n";
@@ -61,16 +96,23 @@ int get_revision()
 }
 enum lcfg_status print_all_visitor(const char *key, void *data, size_t len, void *user_data)
 {
-	int i;
-	char c;
+	char buf[4096];
+	size_t i, n;
 
-	printf("%s ", key);
-	for( i = 0; i < len; i++ )
+	fputs(key, stdout);
+	putchar(' ');
+	while( len > 0 )
 	{
-		c = *((const char *)(data + i));
-		printf("%c", isprint(c) ? c : '.');
+		n = len < sizeof(buf) ? len : sizeof(buf);
+		for( i = 0; i < n; i++ )
+		{
+			buf[i] = isprint(((char *)data)[i]) ? ((char *)data)[i] : '.';
+		}
+		fwrite(buf, 1, n, stdout);
+		data += n;
+		len -= n;
 	}
-	puts("");
+	putchar('\n');
 
 	return lcfg_status_ok;
 }
@@ -78,14 +120,10 @@ enum lcfg_status print_all_visitor(const char *key, void *data, size_t len, void
 enum lcfg_status dump_key_visitor(const char *key, void *data, size_t len, void *user_data)
 {
 	const char *search_key = user_data;
-	int i;
 
 	if( !strcmp(search_key, key) )
 	{
-		for( i = 0; i < len; i++ )
-		{
-			fprintf(stdout, "%c", *((char *)(data + i)));
-		}
+		fwrite(data, 1, len, stdout);
 
 		/* abuse the error handling to indicate that we found the key */
 		return lcfg_status_error;
@@ -94,6 +132,149 @@ enum lcfg_status dump_key_visitor(const char *key, void *data, size_t len, void
 	return lcfg_status_ok;
 }
 
+/* keys of a batch query, answered in one pass over the config */
+struct batch_key
+{
+	char *key;
+	size_t index;        /* position in the query */
+	void *data;
+	size_t len;
+	int found;
+};
+
+struct batch
+{
+	struct batch_key *keys;
+	size_t count;
+	size_t capacity;
+};
+
+enum output_format
+{
+	output_raw,
+	output_null,
+	output_netstring,
+};
+
+void batch_add(struct batch *b, const char *key)
+{
+	if( b->count == b->capacity )
+	{
+		b->capacity = b->capacity == 0 ? 16 : b->capacity * 2;
+		b->keys = realloc(b->keys, b->capacity * sizeof(struct batch_key));
+		if( b->keys == NULL )
+		{
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+	}
+
+	b->keys[b->count].key = strdup(key);
+	if( b->keys[b->count].key == NULL )
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	b->keys[b->count].index = b->count;
+	b->keys[b->count].found = 0;
+	b->count++;
+}
+
+void batch_free(struct batch *b)
+{
+	size_t i;
+
+	for( i = 0; i < b->count; i++ )
+		free(b->keys[i].key);
+	free(b->keys);
+}
+
+int batch_key_compare(const void *a, const void *b)
+{
+	return strcmp(((const struct batch_key *)a)->key, ((const struct batch_key *)b)->key);
+}
+
+int batch_index_compare(const void *a, const void *b)
+{
+	size_t x = ((const struct batch_key *)a)->index;
+	size_t y = ((const struct batch_key *)b)->index;
+
+	return x < y ? -1 : x > y;
+}
+
+/* the keys are sorted by name, a key may have been asked for repeatedly */
+enum lcfg_status batch_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct batch *b = user_data;
+	struct batch_key k, *found;
+
+	k.key = (char *)key;
+	found = bsearch(&k, b->keys, b->count, sizeof(struct batch_key), batch_key_compare);
+	if( found == NULL )
+	{
+		return lcfg_status_ok;
+	}
+
+	while( found > b->keys && !strcmp(found[-1].key, key) )
+	{
+		found--;
+	}
+
+	for( ; found < b->keys + b->count && !strcmp(found->key, key); found++ )
+	{
+		found->data = data;
+		found->len = len;
+		found->found = 1;
+	}
+
+	return lcfg_status_ok;
+}
+
+void print_value(const void *data, size_t len, enum output_format format, int print_nl)
+{
+	if( format == output_netstring )
+	{
+		printf("%zu:", len);
+	}
+
+	fwrite(data, 1, len, stdout);
+
+	if( format == output_netstring )
+	{
+		putchar(',');
+	}
+	else if( format == output_null )
+	{
+		putchar('\0');
+	}
+	else if( print_nl )
+	{
+		putchar('\n');
+	}
+}
+
+void print_stats(const struct lcfg_stats *stats)
+{
+	unsigned int i;
+
+	fprintf(stderr, "bytes read:      %zu\n", stats->bytes_read);
+	fprintf(stderr, "read calls:      %zu\n", stats->read_calls);
+	for( i = 0; i < LCFG_STATS_TOKEN_TYPES; i++ )
+	{
+		if( stats->tokens[i] != 0 )
+		{
+			fprintf(stderr, "tokens %-9s %zu\n", lcfg_stats_token_name(i), stats->tokens[i]);
+		}
+	}
+	fprintf(stderr, "values:          %zu\n", stats->values);
+	fprintf(stderr, "max depth:       %zu\n", stats->max_depth);
+	fprintf(stderr, "bytes allocated: %zu\n", stats->bytes_allocated);
+	fprintf(stderr, "allocations:     %zu\n", stats->allocations);
+	fprintf(stderr, "scan time:       %.6fs\n", stats->scan_time);
+	fprintf(stderr, "parse time:      %.6fs\n", stats->parse_time);
+	fprintf(stderr, "build time:      %.6fs\n", stats->build_time);
+}
+
 int main(int argc, char **argv)
 {
 	const char *filename;
@@ -103,11 +284,26 @@ int main(int argc, char **argv)
 	{
 		lcfg_mode_visitor,
 		lcfg_mode_tree,
+		lcfg_mode_write,
+		lcfg_mode_bench,
 	} mode;
 
 	mode = lcfg_mode_visitor;
 	enum lcfgx_type type = lcfgx_string;
 	int print_nl = 0;
+	int print_stats_flag = 0;
+	int stdin_keys = 0;
+	const char *serve_socket = NULL;
+	int check_flag = 0;
+	const char *generate_name = NULL;
+	int jobs = 0;
+	enum output_format format = output_raw;
+	struct batch batch = { NULL, 0, 0 };
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t n;
+	size_t i;
+	int status = 0;
 
 
 	int c;
@@ -119,30 +315,72 @@ int main(int argc, char **argv)
 		{
 			{ "newline", no_argument, NULL, 'n'},
 			{ "key", required_argument, NULL, 'k'},
+			{ "stdin-keys", no_argument, NULL, 'i'},
+			{ "null", no_argument, NULL, '0'},
+			{ "length", no_argument, NULL, 'l'},
+			{ "stats", no_argument, NULL, 's'},
+			{ "write", no_argument, NULL, 'w'},
+			{ "bench", no_argument, NULL, 'B'},
+			{ "serve", required_argument, NULL, 'S'},
+			{ "check", no_argument, NULL, 'C'},
+			{ "jobs", required_argument, NULL, 'j'},
+			{ "generate", required_argument, NULL, 'G'},
 			{ "help", no_argument, NULL, 'h'},
-			{ "version", no_argument, NULL, 'v'}
+			{ "version", no_argument, NULL, 'v'},
+			{ NULL, 0, NULL, 0 }
 		};
 
-		c = getopt_long (argc, argv, "k:tT:hvn", long_options, &option_index);
+		c = getopt_long (argc, argv, "k:tT:hvnswi0lj:", long_options, &option_index);
 		if( c == -1 )
 			break;
 
 		switch( c )
 		{
 			case 'k':
-				key = optarg;
-				if( key == '\0' )
-					key = NULL;
+				if( *optarg != '\0' )
+					batch_add(&batch, optarg);
+				break;
+			case 'i':
+				stdin_keys = 1;
+				break;
+			case '0':
+				format = output_null;
+				break;
+			case 'l':
+				format = output_netstring;
 				break;
 			case 'h':
-				fprintf(stdout, help, argv[0]);
+				fprintf(stdout, help, argv[0], argv[0], argv[0], argv[0]);
+				batch_free(&batch);
 				return 0;
 				break;
 			case 'n':
 				print_nl = 1;
 				break;
+			case 's':
+				print_stats_flag = 1;
+				break;
+			case 'w':
+				mode = lcfg_mode_write;
+				break;
+			case 'B':
+				mode = lcfg_mode_bench;
+				break;
+			case 'S':
+				serve_socket = optarg;
+				break;
+			case 'C':
+				check_flag = 1;
+				break;
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+			case 'G':
+				generate_name = optarg;
+				break;
 			case 'v':
 				fprintf(stdout, "%s 10.01.%d (c) 2007--2010 Paul Baecher\n", argv[0], get_revision());
+				batch_free(&batch);
 				return 0;
 				break;
 
@@ -162,49 +400,94 @@ int main(int argc, char **argv)
 						else
 						{
 
-							fprintf(stdout, help, argv[0]);
+							fprintf(stdout, help, argv[0], argv[0], argv[0], argv[0]);
+							batch_free(&batch);
 							return 0;
 						}
 				break;
 
 			default:
+				batch_free(&batch);
 				return 2;
 		}
 	}
 
-	if( optind != (argc - 1) )
+	if( serve_socket != NULL && optind < argc )
+	{
+		batch_free(&batch);
+		return serve(serve_socket, argc - optind, argv + optind);
+	}
+	else if( check_flag && optind < argc )
+	{
+		batch_free(&batch);
+		return check(argc - optind, argv + optind, jobs);
+	}
+	else if( generate_name != NULL && optind == argc - 1 )
+	{
+		batch_free(&batch);
+		return generate(generate_name, argv[optind]);
+	}
+	else if( optind != (argc - 1) )
 	{
-		fprintf(stderr, help, argv[0]);
+		fprintf(stderr, help, argv[0], argv[0], argv[0], argv[0]);
+		batch_free(&batch);
+		return 2;
+	}
+	else if( stdin_keys && mode != lcfg_mode_visitor )
+	{
+		fprintf(stderr, "%s: --stdin-keys only works without -t, -w and --bench\n", argv[0]);
+		batch_free(&batch);
 		return 2;
 	}
 	else
 	{
 		filename = argv[optind];
 
+		while( stdin_keys && (n = getdelim(&line, &line_size, format == output_null ? '\0' : '\n', stdin)) > 0 )
+		{
+			if( line[n - 1] == '\n' || line[n - 1] == '\0' )
+				line[--n] = '\0';
+			if( n > 0 )
+				batch_add(&batch, line);
+		}
+		free(line);
+
+		key = batch.count > 0 ? batch.keys[0].key : NULL;
+		if( batch.count > 1 && format == output_raw )
+			format = output_null;
+
 		struct lcfg *c = lcfg_new(filename);
 
 		if( c == NULL )
 		{
 			fprintf(stderr, "%s: out of memory\n", argv[0]);
 			lcfg_delete(c);
+			batch_free(&batch);
 			return 2;
 		}
 
+		if( print_stats_flag )
+		{
+			lcfg_stats_enable(c);
+		}
+
 		if( lcfg_parse(c) != lcfg_status_ok )
 		{
 			fprintf(stderr, "%s: liblcfg error: %s\n", argv[0], lcfg_error_get(c));
 			lcfg_delete(c);
+			batch_free(&batch);
 			return 2;
 		}
 		else
 		{
 			if( mode == lcfg_mode_visitor )
 			{
-				if( key == NULL )
+				if( batch.count == 0 )
 				{
-					lcfg_accept(c, print_all_visitor, 0);
+					if( !stdin_keys )
+						lcfg_accept(c, print_all_visitor, 0);
 				}
-				else
+				else if( batch.count == 1 && format == output_raw )
 				{
 					void *data;
 					size_t len;
@@ -212,23 +495,46 @@ int main(int argc, char **argv)
 					if( lcfg_value_get(c, key, &data, &len) != lcfg_status_ok )
 					{
 						fprintf(stderr, "%s: key %s not found in %s\n", argv[0], key, filename);
-						return 1;
+						status = 1;
 					}
 					else
 					{
-						int i;
-						for( i = 0; i < len; i++ )
-						{
-							fprintf(stdout, "%c", *((char *)(data + i)));
-						}
+						print_value(data, len, format, print_nl);
+					}
+				}
+				else
+				{
+					/* one pass over the config instead of a lookup per key */
+					qsort(batch.keys, batch.count, sizeof(struct batch_key), batch_key_compare);
+					lcfg_accept(c, batch_visitor, &batch);
+					qsort(batch.keys, batch.count, sizeof(struct batch_key), batch_index_compare);
 
-						if( print_nl )
+					for( i = 0; i < batch.count; i++ )
+					{
+						if( !batch.keys[i].found )
 						{
-							fprintf(stdout, "%c", '\n');
+							fprintf(stderr, "%s: key %s not found in %s\n", argv[0], batch.keys[i].key, filename);
+							status = 1;
 						}
+						print_value(batch.keys[i].data, batch.keys[i].found ? batch.keys[i].len : 0, format, print_nl);
 					}
 				}
 			}
+			else if( mode == lcfg_mode_bench )
+			{
+				bench(c);
+			}
+			else if( mode == lcfg_mode_write )
+			{
+				fflush(stdout);
+				if( lcfg_write(c, STDOUT_FILENO) != lcfg_status_ok )
+				{
+					fprintf(stderr, "%s: liblcfg error: %s\n", argv[0], lcfg_error_get(c));
+					lcfg_delete(c);
+					batch_free(&batch);
+					return 2;
+				}
+			}
 			else
 				if( mode == lcfg_mode_tree )
 				{
@@ -249,10 +555,16 @@ int main(int argc, char **argv)
 					lcfgx_tree_delete(root);
 				}
 
+			if( print_stats_flag )
+			{
+				print_stats(lcfg_stats_get(c));
+			}
 		}
 
 		lcfg_delete(c);
 	}
 
-	return 0;
+	batch_free(&batch);
+
+	return status;
 }
@@ -0,0 +1,131 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <time.h>
+#include <lcfg/lcfg.h>
+
+#include "lcfg_bench.h"
+
+/* every traversal does the same work per element */
+struct bench_sum
+{
+	size_t count;
+	size_t bytes;
+};
+
+#define BENCH_TIME 0.25   /* seconds per traversal */
+
+static double bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static enum lcfg_status bench_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct bench_sum *sum = user_data;
+
+	sum->count++;
+	sum->bytes += len + (unsigned char)key[0];
+
+	return lcfg_status_ok;
+}
+
+static enum lcfg_status bench_batch_visitor(const struct lcfg_batch *b, void *user_data)
+{
+	struct bench_sum *sum = user_data;
+	size_t i;
+
+	for( i = 0; i < b->count; i++ )
+	{
+		sum->bytes += b->value_lens[i] + (unsigned char)b->keys[i][0];
+	}
+	sum->count += b->count;
+
+	return lcfg_status_ok;
+}
+
+static enum lcfg_status bench_iter(struct lcfg *c, struct bench_sum *sum)
+{
+	struct lcfg_iter it;
+	struct lcfg_entry e;
+
+	if( lcfg_iter_begin(c, &it) != lcfg_status_ok )
+	{
+		return lcfg_status_error;
+	}
+
+	while( lcfg_iter_next(&it, &e) )
+	{
+		sum->count++;
+		sum->bytes += e.value_len + (unsigned char)e.key[0];
+	}
+
+	return lcfg_status_ok;
+}
+
+static void bench_report(const char *name, struct bench_sum *sum, double seconds)
+{
+	printf("%-9s %8.2f ns/element (%zu elements, checksum %zu)\n", name, sum->count == 0 ? 0.0 : seconds * 1e9 / sum->count, sum->count, sum->bytes);
+}
+
+void bench(struct lcfg *c)
+{
+	struct bench_sum sum;
+	double start, now;
+	enum lcfg_status status;
+	int path;
+
+	for( path = 0; path < 3; path++ )
+	{
+		sum.count = sum.bytes = 0;
+		start = now = bench_clock();
+
+		do
+		{
+			switch( path )
+			{
+				case 0:
+					status = lcfg_accept(c, bench_visitor, &sum);
+					break;
+				case 1:
+					status = bench_iter(c, &sum);
+					break;
+				default:
+					status = lcfg_accept_batched(c, 0, bench_batch_visitor, &sum);
+					break;
+			}
+			now = bench_clock();
+		}
+		while( status == lcfg_status_ok && sum.count != 0 && now - start < BENCH_TIME );
+
+		bench_report(path == 0 ? "visitor" : path == 1 ? "iterator" : "batched", &sum, now - start);
+	}
+}
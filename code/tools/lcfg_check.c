@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <lcfg/lcfg.h>
+
+#include "lcfg_check.h"
+
+struct checker
+{
+	char **files;
+	int count;
+	int next;            /* index of the next file to check */
+	int failed;          /* number of files with errors */
+	pthread_mutex_t lock;
+};
+
+struct check_report
+{
+	const char *filename;
+	FILE *out;           /* errors of one file, printed in one piece */
+};
+
+static void check_error(const char *message, void *user_data)
+{
+	struct check_report *r = user_data;
+
+	fprintf(r->out, "%s: %s\n", r->filename, message);
+}
+
+static void *check_thread(void *arg)
+{
+	struct checker *ch = arg;
+	struct check_report r;
+	char *buf;
+	size_t len;
+	int i;
+
+	for( ;; )
+	{
+		pthread_mutex_lock(&ch->lock);
+		i = ch->next++;
+		pthread_mutex_unlock(&ch->lock);
+
+		if( i >= ch->count )
+		{
+			break;
+		}
+
+		r.filename = ch->files[i];
+		r.out = open_memstream(&buf, &len);
+		if( r.out == NULL )
+		{
+			perror("open_memstream");
+			exit(2);
+		}
+
+		struct lcfg *c = lcfg_new(r.filename);
+		enum lcfg_status status = lcfg_validate(c, check_error, &r);
+		lcfg_delete(c);
+
+		fclose(r.out);
+
+		pthread_mutex_lock(&ch->lock);
+		if( status != lcfg_status_ok )
+		{
+			ch->failed++;
+			fwrite(buf, 1, len, stderr);
+		}
+		pthread_mutex_unlock(&ch->lock);
+
+		free(buf);
+	}
+
+	return NULL;
+}
+
+int check(int filec, char **filev, int jobs)
+{
+	struct checker ch;
+	pthread_t *threads;
+	int i;
+
+	if( jobs <= 0 )
+	{
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if( jobs > filec )
+	{
+		jobs = filec;
+	}
+	if( jobs < 1 )
+	{
+		jobs = 1;
+	}
+
+	ch.files = filev;
+	ch.count = filec;
+	ch.next = 0;
+	ch.failed = 0;
+	pthread_mutex_init(&ch.lock, NULL);
+
+	threads = malloc(sizeof(pthread_t) * jobs);
+	if( threads == NULL )
+	{
+		fprintf(stderr, "out of memory\n");
+		return 2;
+	}
+
+	for( i = 0; i < jobs; i++ )
+	{
+		if( pthread_create(&threads[i], NULL, check_thread, &ch) != 0 )
+		{
+			break;
+		}
+	}
+
+	/* the threads that did start check all files */
+	if( i == 0 )
+	{
+		check_thread(&ch);
+	}
+
+	while( i-- > 0 )
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+	pthread_mutex_destroy(&ch.lock);
+
+	return ch.failed == 0 ? 0 : 2;
+}
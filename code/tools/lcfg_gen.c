@@ -0,0 +1,693 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <lcfg/lcfg.h>
+
+#include "lcfg_gen.h"
+
+enum gen_type { gen_map, gen_string, gen_integer, gen_boolean };
+
+static const char *gen_c_types[] = { NULL, "char *", "long long ", "int " };
+static const char *gen_type_names[] = { "a map", "a string", "an integer", "a boolean (true, false, yes, no, on or off)" };
+
+/* a key of the schema, maps become nested structs */
+struct gen_node
+{
+	char *key;
+	char *field;           /* member of the parent struct */
+	char *path;            /* dotted key, for messages */
+	char *member;          /* access from the top-level struct, e.g. server.port */
+	char *type_name;       /* struct of a map */
+	enum gen_type type;
+	int id;                /* 0 is the top level */
+	struct gen_node *children;
+	struct gen_node *next;
+};
+
+struct generator
+{
+	const char *name;
+	const char *schema_file;
+	struct gen_node root;
+	int count;             /* of nodes including the root */
+	int depth;             /* of nested maps */
+	int types;             /* bit per gen_type in use */
+};
+
+static char *gen_strdup_printf(const char *fmt, const char *a, const char *b)
+{
+	size_t len = snprintf(NULL, 0, fmt, a, b) + 1;
+	char *s = malloc(len);
+
+	snprintf(s, len, fmt, a, b);
+
+	return s;
+}
+
+/* config keys that are also C identifiers, up to a `-' for an `_' */
+static char *gen_identifier(const char *key, size_t len)
+{
+	char *id;
+	size_t i;
+
+	if( len == 0 || !(isalpha((unsigned char)key[0]) || key[0] == '_') )
+	{
+		return NULL;
+	}
+
+	id = malloc(len + 1);
+	for( i = 0; i < len; i++ )
+	{
+		if( !isalnum((unsigned char)key[i]) && key[i] != '_' && key[i] != '-' )
+		{
+			free(id);
+			return NULL;
+		}
+		id[i] = key[i] == '-' ? '_' : key[i];
+	}
+	id[len] = '\0';
+
+	return id;
+}
+
+static struct gen_node *gen_child(struct generator *g, struct gen_node *parent, const char *key, size_t len, enum gen_type type)
+{
+	struct gen_node *n, **tail;
+	char *field = gen_identifier(key, len);
+
+	if( field == NULL )
+	{
+		fprintf(stderr, "%s: `%.*s' is not a C identifier (lists are not supported)\n", g->schema_file, (int)len, key);
+		return NULL;
+	}
+
+	for( tail = &parent->children; *tail != NULL; tail = &(*tail)->next )
+	{
+		n = *tail;
+		if( strcmp(n->field, field) != 0 )
+		{
+			continue;
+		}
+
+		free(field);
+
+		if( n->type == gen_map && type == gen_map )
+		{
+			return n;
+		}
+		else if( strlen(n->key) == len && !memcmp(n->key, key, len) )
+		{
+			fprintf(stderr, "%s: `%s' is given twice\n", g->schema_file, n->path);
+		}
+		else
+		{
+			fprintf(stderr, "%s: `%s' and `%.*s' are the same field\n", g->schema_file, n->key, (int)len, key);
+		}
+		return NULL;
+	}
+
+	n = calloc(1, sizeof(struct gen_node));
+	n->key = malloc(len + 1);
+	memcpy(n->key, key, len);
+	n->key[len] = '\0';
+	n->field = field;
+	n->path = parent->id == 0 ? strdup(n->key) : gen_strdup_printf("%s.%s", parent->path, n->key);
+	n->member = parent->id == 0 ? strdup(field) : gen_strdup_printf("%s.%s", parent->member, field);
+	n->type_name = type == gen_map ? gen_strdup_printf("%s_%s", parent->type_name, field) : NULL;
+	n->type = type;
+	n->id = g->count++;
+	*tail = n;
+	g->types |= 1 << type;
+
+	return n;
+}
+
+static int gen_add(struct generator *g, const struct lcfg_entry *e)
+{
+	static const char *types[] = { NULL, "string", "integer", "boolean", NULL };
+	struct gen_node *n = &g->root;
+	const char *key = e->key, *dot;
+	int type, depth = 0;
+
+	for( type = gen_string; types[type] != NULL && strcmp(types[type], e->value) != 0; type++ );
+	if( types[type] == NULL )
+	{
+		fprintf(stderr, "%s: `%s' has the unknown type `%s', expected string, integer or boolean\n", g->schema_file, e->key, e->value);
+		return -1;
+	}
+
+	while( (dot = strchr(key, '.')) != NULL )
+	{
+		if( (n = gen_child(g, n, key, dot - key, gen_map)) == NULL )
+		{
+			return -1;
+		}
+		if( ++depth > g->depth )
+		{
+			g->depth = depth;
+		}
+		key = dot + 1;
+	}
+
+	return gen_child(g, n, key, strlen(key), type) == NULL ? -1 : 0;
+}
+
+static void gen_free(struct gen_node *n)
+{
+	struct gen_node *c, *next;
+
+	for( c = n->children; c != NULL; c = next )
+	{
+		next = c->next;
+		gen_free(c);
+		free(c->key);
+		free(c->field);
+		free(c->path);
+		free(c->member);
+		free(c->type_name);
+		free(c);
+	}
+}
+
+/* nested structs first */
+static void gen_struct(FILE *out, struct gen_node *n)
+{
+	struct gen_node *c;
+
+	for( c = n->children; c != NULL; c = c->next )
+	{
+		if( c->type == gen_map )
+		{
+			gen_struct(out, c);
+		}
+	}
+
+	fprintf(out, "struct %s\n{\n", n->type_name);
+	for( c = n->children; c != NULL; c = c->next )
+	{
+		if( c->type == gen_map )
+		{
+			fprintf(out, "\tstruct %s %s;\n", c->type_name, c->field);
+		}
+		else
+		{
+			fprintf(out, "\t%s%s;\n", gen_c_types[c->type], c->field);
+		}
+	}
+	fprintf(out, "};\n\n");
+}
+
+static void gen_header(FILE *out, struct generator *g)
+{
+	const char *s;
+
+	fprintf(out, "/* generated by lcfg --generate=%s %s, do not edit */\n", g->name, g->schema_file);
+	fprintf(out, "#ifndef ");
+	for( s = g->name; *s != '\0'; s++ )
+	{
+		fputc(toupper((unsigned char)*s), out);
+	}
+	fprintf(out, "_H\n#define ");
+	for( s = g->name; *s != '\0'; s++ )
+	{
+		fputc(toupper((unsigned char)*s), out);
+	}
+	fprintf(out, "_H\n\n#include <lcfg/lcfg.h>\n\n");
+
+	gen_struct(out, &g->root);
+
+	fprintf(out,
+		"/* fill cfg from the input of c in one pass, strings are allocated with\n"
+		" * malloc(). keys that are not in the schema are skipped, missing ones\n"
+		" * are left zero. on errors cfg is released, see lcfg_error_get(). */\n"
+		"enum lcfg_status %s_load(struct lcfg *c, struct %s *cfg);\n\n"
+		"void %s_free(struct %s *cfg);\n\n"
+		"#endif\n", g->name, g->name, g->name, g->name);
+}
+
+static void gen_collect(struct gen_node **nodes, struct gen_node *n)
+{
+	struct gen_node *c;
+
+	for( c = n->children; c != NULL; c = c->next )
+	{
+		nodes[c->id] = c;
+		if( c->type == gen_map )
+		{
+			gen_collect(nodes, c);
+		}
+	}
+}
+
+/* ids are given in the order keys appear in the schema, the table is
+ * indexed by them */
+static void gen_fields(FILE *out, struct generator *g)
+{
+	struct gen_node **nodes = calloc(g->count, sizeof(struct gen_node *));
+	int i;
+
+	gen_collect(nodes, &g->root);
+	for( i = 1; i < g->count; i++ )
+	{
+		fprintf(out, "\t{ \"%s\", \"%s\", %d },\n", nodes[i]->path, gen_type_names[nodes[i]->type], nodes[i]->type == gen_map);
+	}
+	free(nodes);
+}
+
+/* switch on the key length, then compare */
+static void gen_dispatch(FILE *out, struct gen_node *n)
+{
+	struct gen_node *c, *d;
+	size_t len;
+
+	fprintf(out, "\t\tcase %d:\n\t\t\tswitch( len )\n\t\t\t{\n", n->id);
+	for( c = n->children; c != NULL; c = c->next )
+	{
+		len = strlen(c->key);
+		for( d = n->children; d != c && strlen(d->key) != len; d = d->next );
+		if( d != c )
+		{
+			continue;
+		}
+
+		fprintf(out, "\t\t\t\tcase %zu:\n", len);
+		for( d = c; d != NULL; d = d->next )
+		{
+			if( strlen(d->key) == len )
+			{
+				fprintf(out, "\t\t\t\t\tif( !memcmp(key, \"%s\", %zu) )\n\t\t\t\t\t\treturn %d;\n", d->key, len, d->id);
+			}
+		}
+		fprintf(out, "\t\t\t\t\tbreak;\n");
+	}
+	fprintf(out, "\t\t\t}\n\t\t\tbreak;\n");
+
+	for( c = n->children; c != NULL; c = c->next )
+	{
+		if( c->type == gen_map )
+		{
+			gen_dispatch(out, c);
+		}
+	}
+}
+
+static void gen_stores(FILE *out, const char *name, struct gen_node *n)
+{
+	struct gen_node *c;
+	static const char *stores[] = { NULL, "string", "integer", "boolean" };
+	static const char *args[] = { NULL, "value, len", "value, len, line, col", "value, line, col" };
+
+	for( c = n->children; c != NULL; c = c->next )
+	{
+		if( c->type == gen_map )
+		{
+			gen_stores(out, name, c);
+		}
+		else
+		{
+			fprintf(out, "\t\tcase %d:\n\t\t\treturn %s_%s(l, &l->cfg->%s, %s);\n", c->id, name, stores[c->type], c->member, args[c->type]);
+		}
+	}
+}
+
+static void gen_frees(FILE *out, struct gen_node *n)
+{
+	struct gen_node *c;
+
+	for( c = n->children; c != NULL; c = c->next )
+	{
+		if( c->type == gen_map )
+		{
+			gen_frees(out, c);
+		}
+		else if( c->type == gen_string )
+		{
+			fprintf(out, "\tfree(cfg->%s);\n", c->member);
+		}
+	}
+}
+
+/* the generated code names everything after the config: print text with
+ * every %s replaced by name and %% by % */
+static void gen_print(FILE *out, const char *name, const char *text)
+{
+	const char *s;
+
+	for( s = text; *s != '\0'; s++ )
+	{
+		if( s[0] == '%' && s[1] == 's' )
+		{
+			fputs(name, out);
+			s++;
+		}
+		else if( s[0] == '%' && s[1] == '%' )
+		{
+			fputc('%', out);
+			s++;
+		}
+		else
+		{
+			fputc(*s, out);
+		}
+	}
+}
+
+static void gen_source(FILE *out, struct generator *g)
+{
+	fprintf(out, "/* generated by lcfg --generate=%s %s, do not edit */\n", g->name, g->schema_file);
+	gen_print(out, g->name,
+		"#include <stdlib.h>\n"
+		"#include <string.h>\n"
+		"#include <errno.h>\n"
+		"#include <inttypes.h>\n"
+		"\n"
+		"#include \"%s.h\"\n"
+		"\n");
+	gen_print(out, g->name,
+		"enum %s_expect { %s_expect_key, %s_expect_equals, %s_expect_value, %s_expect_skip };\n"
+		"\n"
+		"struct %s_loader\n"
+		"{\n"
+		"\tstruct lcfg *lcfg;\n"
+		"\tstruct %s *cfg;\n"
+		"\tenum %s_expect expect;\n"
+		"\tint field;                /* id of the current key, -1 if it is not in the schema */\n");
+	fprintf(out, "\tint maps[%d];              /* ids of the open maps */\n", g->depth + 1);
+	gen_print(out, g->name,
+		"\tint depth;\n"
+		"\tsize_t skip;              /* open brackets of a skipped value */\n"
+		"};\n"
+		"\n"
+		"/* by id, 0 is the top level */\n"
+		"static const struct { const char *path; const char *type; int map; } %s_fields[] =\n"
+		"{\n"
+		"\t{ \"\", \"a map\", 1 },\n");
+	gen_fields(out, g);
+	gen_print(out, g->name,
+		"};\n"
+		"\n"
+		"static const char *%s_tokens[] = { \"identifier\", \"`='\", \"string\", \"`['\", \"`]'\", \"`,'\", \"`{'\", \"`}'\" };\n"
+		"\n"
+		"/* id of key in a map, -1 if it is not in the schema */\n"
+		"static int %s_field(int map, const char *key, size_t len)\n"
+		"{\n"
+		"\tswitch( map )\n"
+		"\t{\n");
+	gen_dispatch(out, &g->root);
+	gen_print(out, g->name,
+		"\t}\n"
+		"\n"
+		"\treturn -1;\n"
+		"}\n"
+		"\n"
+		"static enum lcfg_status %s_mismatch(struct %s_loader *l, uint64_t line, uint64_t col)\n"
+		"{\n"
+		"\tlcfg_error_set(l->lcfg, \"`%%s' must be %%s near line %%\" PRIu64 \" column %%\" PRIu64, %s_fields[l->field].path, %s_fields[l->field].type, line, col);\n"
+		"\treturn lcfg_status_error;\n"
+		"}\n"
+		"\n");
+
+	if( g->types & (1 << gen_string) )
+	{
+		gen_print(out, g->name,
+			"static enum lcfg_status %s_string(struct %s_loader *l, char **field, const char *value, size_t len)\n"
+			"{\n"
+			"\tfree(*field);\n"
+			"\tif( (*field = malloc(len + 1)) == NULL )\n"
+			"\t{\n"
+			"\t\tlcfg_error_set(l->lcfg, \"%%s\", \"out of memory\");\n"
+			"\t\treturn lcfg_status_error;\n"
+			"\t}\n"
+			"\tmemcpy(*field, value, len + 1);\n"
+			"\n"
+			"\treturn lcfg_status_ok;\n"
+			"}\n"
+			"\n");
+	}
+
+	if( g->types & (1 << gen_integer) )
+	{
+		gen_print(out, g->name,
+			"static enum lcfg_status %s_integer(struct %s_loader *l, long long *field, const char *value, size_t len, uint64_t line, uint64_t col)\n"
+			"{\n"
+			"\tchar *end;\n"
+			"\n"
+			"\terrno = 0;\n"
+			"\t*field = strtoll(value, &end, 10);\n"
+			"\tif( len == 0 || end != value + len || errno != 0 )\n"
+			"\t{\n"
+			"\t\treturn %s_mismatch(l, line, col);\n"
+			"\t}\n"
+			"\n"
+			"\treturn lcfg_status_ok;\n"
+			"}\n"
+			"\n");
+	}
+
+	if( g->types & (1 << gen_boolean) )
+	{
+		gen_print(out, g->name,
+			"static enum lcfg_status %s_boolean(struct %s_loader *l, int *field, const char *value, uint64_t line, uint64_t col)\n"
+			"{\n"
+			"\tif( !strcmp(value, \"true\") || !strcmp(value, \"yes\") || !strcmp(value, \"on\") )\n"
+			"\t{\n"
+			"\t\t*field = 1;\n"
+			"\t}\n"
+			"\telse if( !strcmp(value, \"false\") || !strcmp(value, \"no\") || !strcmp(value, \"off\") )\n"
+			"\t{\n"
+			"\t\t*field = 0;\n"
+			"\t}\n"
+			"\telse\n"
+			"\t{\n"
+			"\t\treturn %s_mismatch(l, line, col);\n"
+			"\t}\n"
+			"\n"
+			"\treturn lcfg_status_ok;\n"
+			"}\n"
+			"\n");
+	}
+
+	gen_print(out, g->name,
+		"static enum lcfg_status %s_store(struct %s_loader *l, const char *value, size_t len, uint64_t line, uint64_t col)\n"
+		"{\n"
+		"\tswitch( l->field )\n"
+		"\t{\n");
+
+	gen_stores(out, g->name, &g->root);
+
+	gen_print(out, g->name,
+		"\t}\n"
+		"\n"
+		"\treturn %s_mismatch(l, line, col);\n"
+		"}\n"
+		"\n"
+		"static enum lcfg_status %s_token(enum lcfg_scan_token token, const char *text, size_t len, uint64_t line, uint64_t col, void *user_data)\n"
+		"{\n"
+		"\tstruct %s_loader *l = user_data;\n"
+		"\n"
+		"\tswitch( l->expect )\n"
+		"\t{\n"
+		"\t\tcase %s_expect_key:\n"
+		"\t\t\tif( token == lcfg_scan_identifier )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tl->field = %s_field(l->maps[l->depth], text, len);\n"
+		"\t\t\t\tl->expect = %s_expect_equals;\n"
+		"\t\t\t\treturn lcfg_status_ok;\n"
+		"\t\t\t}\n"
+		"\t\t\telse if( token == lcfg_scan_map_close && l->depth > 0 )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tl->depth--;\n"
+		"\t\t\t\treturn lcfg_status_ok;\n"
+		"\t\t\t}\n"
+		"\t\t\tbreak;\n"
+		"\t\tcase %s_expect_equals:\n"
+		"\t\t\tif( token == lcfg_scan_equals )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tl->expect = %s_expect_value;\n"
+		"\t\t\t\treturn lcfg_status_ok;\n"
+		"\t\t\t}\n"
+		"\t\t\tbreak;\n"
+		"\t\tcase %s_expect_value:\n"
+		"\t\t\tl->expect = %s_expect_key;\n"
+		"\t\t\tif( token == lcfg_scan_string && l->field < 0 )\n"
+		"\t\t\t{\n"
+		"\t\t\t\treturn lcfg_status_ok;\n"
+		"\t\t\t}\n"
+		"\t\t\telse if( token == lcfg_scan_string )\n"
+		"\t\t\t{\n"
+		"\t\t\t\treturn %s_store(l, text, len, line, col);\n"
+		"\t\t\t}\n"
+		"\t\t\telse if( token != lcfg_scan_map_open && token != lcfg_scan_list_open )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tbreak;\n"
+		"\t\t\t}\n"
+		"\t\t\telse if( l->field < 0 )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tl->expect = %s_expect_skip;\n"
+		"\t\t\t\tl->skip = 1;\n"
+		"\t\t\t\treturn lcfg_status_ok;\n"
+		"\t\t\t}\n"
+		"\t\t\telse if( token == lcfg_scan_map_open && %s_fields[l->field].map )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tl->maps[++l->depth] = l->field;\n"
+		"\t\t\t\treturn lcfg_status_ok;\n"
+		"\t\t\t}\n"
+		"\t\t\treturn %s_mismatch(l, line, col);\n"
+		"\t\tcase %s_expect_skip:\n"
+		"\t\t\t/* only brackets are counted, as in lcfg_parse_filtered() */\n"
+		"\t\t\tif( token == lcfg_scan_map_open || token == lcfg_scan_list_open )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tl->skip++;\n"
+		"\t\t\t}\n"
+		"\t\t\telse if( (token == lcfg_scan_map_close || token == lcfg_scan_list_close) && --l->skip == 0 )\n"
+		"\t\t\t{\n"
+		"\t\t\t\tl->expect = %s_expect_key;\n"
+		"\t\t\t}\n"
+		"\t\t\treturn lcfg_status_ok;\n"
+		"\t}\n"
+		"\n"
+		"\tlcfg_error_set(l->lcfg, \"invalid token (%%s) near line %%\" PRIu64 \" column %%\" PRIu64, %s_tokens[token], line, col);\n"
+		"\treturn lcfg_status_error;\n"
+		"}\n"
+		"\n"
+		"enum lcfg_status %s_load(struct lcfg *c, struct %s *cfg)\n"
+		"{\n"
+		"\tstruct %s_loader l;\n"
+		"\tenum lcfg_status status;\n"
+		"\n"
+		"\tmemset(cfg, 0, sizeof(struct %s));\n"
+		"\tmemset(&l, 0, sizeof(struct %s_loader));\n"
+		"\tl.lcfg = c;\n"
+		"\tl.cfg = cfg;\n"
+		"\tl.expect = %s_expect_key;\n"
+		"\n"
+		"\tstatus = lcfg_scan(c, %s_token, &l);\n"
+		"\n"
+		"\tif( status == lcfg_status_ok && (l.expect != %s_expect_key || l.depth != 0) )\n"
+		"\t{\n"
+		"\t\tlcfg_error_set(c, \"%%s\", \"unexpected end of input\");\n"
+		"\t\tstatus = lcfg_status_error;\n"
+		"\t}\n"
+		"\n"
+		"\tif( status != lcfg_status_ok )\n"
+		"\t{\n"
+		"\t\t%s_free(cfg);\n"
+		"\t}\n"
+		"\n"
+		"\treturn status;\n"
+		"}\n"
+		"\n"
+		"void %s_free(struct %s *cfg)\n"
+		"{\n");
+	gen_frees(out, &g->root);
+	gen_print(out, g->name,
+		"\tmemset(cfg, 0, sizeof(struct %s));\n"
+		"}\n");
+}
+
+static int gen_write(struct generator *g, const char *suffix, void (*emit)(FILE *, struct generator *))
+{
+	char *filename = gen_strdup_printf("%s%s", g->name, suffix);
+	FILE *out = fopen(filename, "w");
+
+	if( out == NULL )
+	{
+		perror(filename);
+		free(filename);
+		return -1;
+	}
+
+	emit(out, g);
+
+	if( fclose(out) != 0 )
+	{
+		perror(filename);
+		free(filename);
+		return -1;
+	}
+
+	free(filename);
+
+	return 0;
+}
+
+int generate(const char *name, const char *schema_file)
+{
+	struct generator g;
+	struct lcfg *c;
+	struct lcfg_iter it;
+	struct lcfg_entry e;
+	char *id = gen_identifier(name, strlen(name));
+	int status = 0;
+
+	if( id == NULL || strcmp(id, name) != 0 )
+	{
+		fprintf(stderr, "%s: the name must be a C identifier\n", name);
+		free(id);
+		return 2;
+	}
+	free(id);
+
+	memset(&g, 0, sizeof(struct generator));
+	g.name = name;
+	g.schema_file = schema_file;
+	g.root.type = gen_map;
+	g.root.type_name = (char *)name;
+	g.count = 1;
+
+	c = lcfg_new(schema_file);
+	if( lcfg_parse(c) != lcfg_status_ok || lcfg_iter_begin(c, &it) != lcfg_status_ok )
+	{
+		fprintf(stderr, "%s: %s\n", schema_file, lcfg_error_get(c));
+		lcfg_delete(c);
+		return 2;
+	}
+
+	while( status == 0 && lcfg_iter_next(&it, &e) )
+	{
+		status = gen_add(&g, &e);
+	}
+	lcfg_delete(c);
+
+	if( status == 0 && g.root.children == NULL )
+	{
+		fprintf(stderr, "%s: the schema has no keys\n", schema_file);
+		status = -1;
+	}
+
+	if( status == 0 && (gen_write(&g, ".h", gen_header) != 0 || gen_write(&g, ".c", gen_source) != 0) )
+	{
+		status = -1;
+	}
+
+	gen_free(&g.root);
+
+	return status == 0 ? 0 : 2;
+}
@@ -0,0 +1,388 @@
+/*
+  Copyright (c) 2012, Paul Baecher
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the name of the <organization> nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <THE COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <lcfg/lcfg.h>
+
+#include "lcfg_serve.h"
+
+/*
+ * protocol, all lengths are 32 bit big endian:
+ *
+ *   request:  length, op, file name, NUL, key
+ *   response: length, status, payload
+ *
+ * op `g' answers the value of key, `p' all keys at or below key with their
+ * values (each as length, key, length, value) and `l' only those keys
+ * (each as length, key). an empty file name selects the first file. status
+ * is one of the SERVE_* codes below.
+ */
+#define SERVE_OK        0
+#define SERVE_NOT_FOUND 1
+#define SERVE_ERROR     2
+
+#define SERVE_MAX_REQUEST 0x10000
+
+struct served_config
+{
+	const char *filename;
+	struct lcfg *lcfg;
+	struct stat st;      /* of the file version last parsed */
+};
+
+struct server
+{
+	struct served_config *configs;
+	int count;
+	pthread_rwlock_t lock;
+};
+
+struct reply
+{
+	char *buf;
+	size_t len;
+	size_t capacity;
+};
+
+static const char *serve_socket_path;
+
+static void reply_add(struct reply *r, const void *data, size_t len)
+{
+	if( r->capacity - r->len < len )
+	{
+		while( r->capacity - r->len < len )
+			r->capacity = r->capacity == 0 ? 256 : r->capacity * 2;
+
+		if( (r->buf = realloc(r->buf, r->capacity)) == NULL )
+		{
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+	}
+
+	memcpy(r->buf + r->len, data, len);
+	r->len += len;
+}
+
+static void reply_add_u32(struct reply *r, uint32_t n)
+{
+	n = htonl(n);
+	reply_add(r, &n, sizeof(n));
+}
+
+static enum lcfg_status prefix_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct reply *r = user_data;
+
+	reply_add_u32(r, strlen(key));
+	reply_add(r, key, strlen(key));
+	reply_add_u32(r, len);
+	reply_add(r, data, len);
+
+	return lcfg_status_ok;
+}
+
+static enum lcfg_status list_visitor(const char *key, void *data, size_t len, void *user_data)
+{
+	struct reply *r = user_data;
+
+	reply_add_u32(r, strlen(key));
+	reply_add(r, key, strlen(key));
+
+	return lcfg_status_ok;
+}
+
+static int stat_changed(const struct stat *a, const struct stat *b)
+{
+	return a->st_ino != b->st_ino || a->st_dev != b->st_dev || a->st_size != b->st_size ||
+		a->st_mtim.tv_sec != b->st_mtim.tv_sec || a->st_mtim.tv_nsec != b->st_mtim.tv_nsec;
+}
+
+static int config_load(struct served_config *sc)
+{
+	struct lcfg *c = lcfg_new(sc->filename);
+
+	if( lcfg_parse(c) != lcfg_status_ok )
+	{
+		fprintf(stderr, "%s: liblcfg error: %s\n", sc->filename, lcfg_error_get(c));
+		lcfg_delete(c);
+		return -1;
+	}
+
+	if( sc->lcfg != NULL )
+		lcfg_delete(sc->lcfg);
+	sc->lcfg = c;
+
+	return 0;
+}
+
+/* re-parse a file that changed since it was parsed. a broken update keeps
+ * the previous version and is not retried until the file changes again. */
+static void config_refresh(struct server *s, struct served_config *sc)
+{
+	struct stat st;
+	int changed;
+
+	if( stat(sc->filename, &st) != 0 )
+		return;
+
+	/* sc->st is written under the write lock below */
+	pthread_rwlock_rdlock(&s->lock);
+	changed = stat_changed(&st, &sc->st);
+	pthread_rwlock_unlock(&s->lock);
+
+	if( !changed )
+		return;
+
+	pthread_rwlock_wrlock(&s->lock);
+	if( stat(sc->filename, &st) == 0 && stat_changed(&st, &sc->st) )
+	{
+		sc->st = st;
+		config_load(sc);
+	}
+	pthread_rwlock_unlock(&s->lock);
+}
+
+static void serve_request(struct server *s, char *req, size_t len, struct reply *r)
+{
+	struct served_config *sc = NULL;
+	char *name, *key, *end;
+	void *data;
+	size_t value_len;
+	char status = SERVE_OK;
+	int i;
+
+	/* status byte, filled in below */
+	reply_add(r, &status, 1);
+
+	/* the status byte follows the length */
+	if( len < 2 || (end = memchr(req + 1, '\0', len - 1)) == NULL )
+	{
+		r->buf[4] = SERVE_ERROR;
+		return;
+	}
+	req[len] = '\0';
+	name = req + 1;
+	key = end + 1;
+
+	for( i = 0; i < s->count; i++ )
+		if( *name == '\0' || !strcmp(name, s->configs[i].filename) )
+		{
+			sc = &s->configs[i];
+			break;
+		}
+
+	if( sc == NULL )
+	{
+		r->buf[4] = SERVE_NOT_FOUND;
+		return;
+	}
+
+	config_refresh(s, sc);
+
+	pthread_rwlock_rdlock(&s->lock);
+	switch( req[0] )
+	{
+		case 'g':
+			if( lcfg_value_get(sc->lcfg, key, &data, &value_len) == lcfg_status_ok )
+				reply_add(r, data, value_len);
+			else
+				status = SERVE_NOT_FOUND;
+			break;
+		case 'p':
+			lcfg_accept_subtree(sc->lcfg, key, prefix_visitor, r);
+			break;
+		case 'l':
+			lcfg_accept_subtree(sc->lcfg, key, list_visitor, r);
+			break;
+		default:
+			status = SERVE_ERROR;
+	}
+	pthread_rwlock_unlock(&s->lock);
+
+	r->buf[4] = status;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	while( len > 0 )
+	{
+		n = read(fd, buf, len);
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	while( len > 0 )
+	{
+		n = write(fd, buf, len);
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+struct connection
+{
+	struct server *server;
+	int fd;
+};
+
+static void *serve_connection(void *arg)
+{
+	struct connection *conn = arg;
+	struct reply r = { NULL, 0, 0 };
+	char *req = malloc(SERVE_MAX_REQUEST + 1);
+	uint32_t len;
+
+	while( req != NULL && read_full(conn->fd, &len, sizeof(len)) == 0 )
+	{
+		len = ntohl(len);
+		if( len > SERVE_MAX_REQUEST || read_full(conn->fd, req, len) != 0 )
+			break;
+
+		/* room for the length, patched in when the reply is complete */
+		r.len = 0;
+		reply_add_u32(&r, 0);
+		serve_request(conn->server, req, len, &r);
+		*(uint32_t *)r.buf = htonl(r.len - sizeof(uint32_t));
+
+		if( write_full(conn->fd, r.buf, r.len) != 0 )
+			break;
+	}
+
+	close(conn->fd);
+	free(conn);
+	free(req);
+	free(r.buf);
+
+	return NULL;
+}
+
+static void serve_signal(int sig)
+{
+	unlink(serve_socket_path);
+	_exit(0);
+}
+
+int serve(const char *socket_path, int filec, char **filev)
+{
+	struct server s;
+	struct sockaddr_un addr;
+	struct connection *conn;
+	pthread_t thread;
+	int fd, i;
+
+	if( strlen(socket_path) >= sizeof(addr.sun_path) )
+	{
+		fprintf(stderr, "%s: socket path too long\n", socket_path);
+		return 2;
+	}
+
+	s.count = filec;
+	s.configs = calloc(filec, sizeof(struct served_config));
+	pthread_rwlock_init(&s.lock, NULL);
+
+	for( i = 0; i < filec; i++ )
+	{
+		s.configs[i].filename = filev[i];
+		if( stat(filev[i], &s.configs[i].st) != 0 || config_load(&s.configs[i]) != 0 )
+		{
+			fprintf(stderr, "%s: cannot load\n", filev[i]);
+			return 2;
+		}
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(socket_path);
+	if( fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0 )
+	{
+		fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+		return 2;
+	}
+
+	serve_socket_path = socket_path;
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, serve_signal);
+	signal(SIGTERM, serve_signal);
+
+	for( ;; )
+	{
+		conn = malloc(sizeof(struct connection));
+
+		if( conn == NULL || (conn->fd = accept(fd, NULL, NULL)) < 0 )
+		{
+			free(conn);
+			if( errno == EINTR || errno == ECONNABORTED )
+				continue;
+			fprintf(stderr, "accept(): %s\n", strerror(errno));
+			unlink(socket_path);
+			return 2;
+		}
+		conn->server = &s;
+
+		if( pthread_create(&thread, NULL, serve_connection, conn) != 0 )
+		{
+			close(conn->fd);
+			free(conn);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+}